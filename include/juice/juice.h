@@ -85,6 +85,29 @@ typedef struct juice_log_config {
 	void *user_ptr;
 } juice_log_config_t;
 
+// ICE timing, fields set to 0 take the default value
+typedef struct juice_timing_config {
+	unsigned int pacing_time;                // Ta in msecs, default 50, minimum 5
+	unsigned int retransmission_timeout;     // initial RTO in msecs, default 500
+	unsigned int min_retransmission_timeout; // lower bound of the RTO in msecs, default 500
+	int max_retransmissions;                 // default 5 (~30s with exponential backoff)
+	unsigned int keepalive_period;           // Tr in msecs, default 15000, minimum 15000
+	unsigned int fail_timeout;               // trickling timeout in msecs, default 30000
+	unsigned int failover_timeout;           // msecs without consent on the selected pair before
+	                                         // switching to a backup pair, 0 disables failover
+} juice_timing_config_t;
+
+typedef enum juice_timing_preset {
+	JUICE_TIMING_PRESET_DEFAULT,    // RFC 8445 recommended values
+	JUICE_TIMING_PRESET_DATACENTER, // low latency and reliable links, RTO below the RFC minimum
+	JUICE_TIMING_PRESET_MOBILE      // high latency and lossy links
+} juice_timing_preset_t;
+
+typedef enum juice_nomination_policy {
+	JUICE_NOMINATION_POLICY_PRIORITY,  // nominate the highest-priority pair (default)
+	JUICE_NOMINATION_POLICY_LOWEST_RTT // nominate the lowest-RTT pair within the tolerance
+} juice_nomination_policy_t;
+
 typedef struct juice_config {
 	const char *stun_server_host;
 	uint16_t stun_server_port;
@@ -103,8 +126,50 @@ typedef struct juice_config {
 	void *user_ptr;
 
 	juice_log_config_t logging;
+
+	juice_timing_config_t timing;
+
+	// Only used by the controlling agent. The tolerance is a difference of candidate type
+	// preferences (host 126, peer reflexive 110, server reflexive 100, relayed 0) between a pair
+	// and the highest-priority succeeded pair, for instance 26 allows any non-relayed pair.
+	juice_nomination_policy_t nomination_policy;
+	unsigned int nomination_rtt_tolerance;
+
+	// Deliver datagrams directly to a co-located agent in the same process once connected to it,
+	// instead of sending them on the network. Both agents must enable it.
+	bool enable_shortcut;
 } juice_config_t;
 
+// Application datagrams on a path type
+typedef struct juice_path_stats {
+	uint64_t bytes_sent;
+	uint64_t packets_sent;
+	uint64_t bytes_received;
+	uint64_t packets_received;
+} juice_path_stats_t;
+
+typedef struct juice_agent_stats {
+	juice_path_stats_t direct;
+	juice_path_stats_t relayed;
+
+	uint64_t checks_sent;          // connectivity check requests, including retransmissions
+	uint64_t checks_retransmitted; // connectivity check retransmissions
+	uint64_t datagrams_dropped;    // datagrams received from unknown addresses
+
+	int64_t connected_time; // msecs from gathering to connected, -1 if not reached
+	int64_t completed_time; // msecs from gathering to completed, -1 if not reached
+
+	int64_t rtt;     // smoothed RTT of the selected pair in usecs, 0 if not measured
+	int64_t min_rtt; // usecs, 0 if not measured
+	int64_t avg_rtt; // usecs, 0 if not measured
+
+	int turn_allocations_count; // TURN servers
+	int turn_allocations_ready; // succeeded TURN allocations
+	int turn_allocations_failed;
+
+	juice_path_stats_t shortcut; // delivered in-process to or from a co-located agent
+} juice_agent_stats_t;
+
 JUICE_EXPORT juice_agent_t *juice_create(const juice_config_t *config);
 JUICE_EXPORT void juice_destroy(juice_agent_t *agent);
 
@@ -113,6 +178,10 @@ JUICE_EXPORT int juice_get_local_description(juice_agent_t *agent, char *buffer,
 JUICE_EXPORT int juice_set_remote_description(juice_agent_t *agent, const char *sdp);
 JUICE_EXPORT int juice_add_remote_candidate(juice_agent_t *agent, const char *sdp);
 JUICE_EXPORT int juice_set_remote_gathering_done(juice_agent_t *agent);
+// Generates new local credentials and gathers candidates again while keeping the socket and TURN
+// allocations. Data keeps flowing on the selected pair until a new pair is selected. Connectivity
+// checks restart once the remote description with new credentials is set.
+JUICE_EXPORT int juice_restart_ice(juice_agent_t *agent);
 JUICE_EXPORT int juice_send(juice_agent_t *agent, const char *data, size_t size);
 JUICE_EXPORT int juice_send_diffserv(juice_agent_t *agent, const char *data, size_t size, int ds);
 JUICE_EXPORT juice_state_t juice_get_state(juice_agent_t *agent);
@@ -120,8 +189,29 @@ JUICE_EXPORT int juice_get_selected_candidates(juice_agent_t *agent, char *local
                                                char *remote, size_t remote_size);
 JUICE_EXPORT int juice_get_selected_addresses(juice_agent_t *agent, char *local, size_t local_size,
                                               char *remote, size_t remote_size);
+JUICE_EXPORT int juice_get_selected_rtt(juice_agent_t *agent, int64_t *rtt_us,
+                                        int64_t *min_rtt_us);
+JUICE_EXPORT int juice_get_stats(juice_agent_t *agent, juice_agent_stats_t *stats);
 JUICE_EXPORT const char *juice_state_to_string(juice_state_t state);
 
+JUICE_EXPORT void juice_set_timing_preset(juice_timing_config_t *timing,
+                                          juice_timing_preset_t preset);
+
+// Address resolution
+
+// Resolves a STUN or TURN server hostname in the background and caches the result so agents
+// using it do not wait for DNS. Calling it again refreshes the cached result.
+// If port is 0, the default port 3478 is used.
+JUICE_EXPORT int juice_prefetch_address(const char *hostname, uint16_t port);
+
+// TURN allocation pool
+
+// Keeps count allocations on the TURN server ready and refreshed in the background. An agent
+// gathering candidates with the same server and credentials takes one over along with its
+// socket, so the relayed candidate is available immediately. An allocation is only taken if its
+// port is in the agent port range, when set. Calling it again changes the count, 0 releases them.
+JUICE_EXPORT int juice_prewarm_turn_allocations(const juice_turn_server_t *turn_server, int count);
+
 // ICE server
 
 typedef struct juice_server juice_server_t;
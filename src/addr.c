@@ -249,7 +249,8 @@ int addr_resolve(const char *hostname, const char *service, addr_record_t *recor
 	hints.ai_flags = AI_ADDRCONFIG;
 	struct addrinfo *ai_list = NULL;
 	if (getaddrinfo(hostname, service, &hints, &ai_list)) {
-		JLOG_WARN(logger, "Address resolution failed for %s:%s", hostname, service);
+		if (logger)
+			JLOG_WARN(logger, "Address resolution failed for %s:%s", hostname, service);
 		return -1;
 	}
 
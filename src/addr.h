@@ -42,7 +42,8 @@ typedef struct addr_record {
 } addr_record_t;
 
 int addr_resolve(const char *hostname, const char *service, addr_record_t *records, size_t count,
-                 juice_logger_t *logger);
+                 juice_logger_t *logger // logger may be NULL
+);
 
 bool addr_record_is_equal(const addr_record_t *a, const addr_record_t *b, bool compare_ports);
 unsigned long addr_record_hash(const addr_record_t *record, bool with_port);
@@ -29,6 +29,7 @@
 #include <inttypes.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,8 +46,16 @@
 // RFC 8656: Channel bindings last for 10 minutes unless refreshed
 #define BIND_LIFETIME 600000 // ms
 
+// Channels of the selected and backup pairs are bound again halfway through the permission
+// lifetime, as ChannelBind also refreshes the permission
+#define BINDING_REFRESH_PERIOD (PERMISSION_LIFETIME / 2) // ms
+#define MAX_BINDING_ATTEMPTS_SHIFT 4
+
 #define BUFFER_SIZE 4096
-#define DEFAULT_MAX_RECORDS_COUNT 8
+#define MAX_HOST_RECORDS_COUNT (2 * MAX_HOST_CANDIDATES_COUNT)
+
+#define AGENT_INITIAL_CAPACITY 8
+#define AGENT_ARENA_BLOCK_SIZE 4096
 
 static char *alloc_string_copy(const char *orig) {
 	if (!orig)
@@ -64,6 +73,23 @@ static void *alloc_copy(const void *orig, size_t size) {
 	return copy;
 }
 
+static unsigned long transaction_id_hash(const uint8_t *transaction_id) {
+	// Transaction IDs are random, so the first bytes are enough
+	unsigned long hash = 0;
+	for (int i = 0; i < 4; ++i)
+		hash = (hash << 8) | transaction_id[i];
+	return hash;
+}
+
+static hmac_key_t *create_short_term_hmac_key(const char *password, juice_logger_t *logger) {
+	if (*password == '\0')
+		return NULL;
+
+	stun_credentials_t credentials;
+	memset(&credentials, 0, sizeof(credentials));
+	return stun_create_hmac_key(&credentials, password, logger);
+}
+
 juice_agent_t *agent_create(const juice_config_t *config) {
 	juice_logger_t *logger = juice_logger_create(&config->logging);
 	if (logger == NULL) {
@@ -89,11 +115,40 @@ juice_agent_t *agent_create(const juice_config_t *config) {
 
 	agent->logger = logger;
 
+	agent->sock = INVALID_SOCKET;
+
 	mutex_init(&agent->mutex, MUTEX_RECURSIVE);
 	mutex_init(&agent->send_mutex, 0);
+	shortcut_init(&agent->shortcut, &agent->wakeup);
+
+	if (wakeup_init(&agent->wakeup, logger) < 0) {
+		JLOG_FATAL(logger, "Wakeup creation for agent failed");
+		goto error;
+	}
 
 	agent->config = *config;
 
+	// Apply timing defaults and limits
+	juice_timing_config_t *timing = &agent->config.timing;
+	if (!timing->pacing_time)
+		timing->pacing_time = STUN_PACING_TIME;
+	else if (timing->pacing_time < MIN_STUN_PACING_TIME)
+		timing->pacing_time = MIN_STUN_PACING_TIME; // RFC 8445: Ta MUST NOT be less than 5 ms
+	if (!timing->retransmission_timeout)
+		timing->retransmission_timeout = MIN_STUN_RETRANSMISSION_TIMEOUT;
+	if (!timing->min_retransmission_timeout)
+		timing->min_retransmission_timeout = MIN_STUN_RETRANSMISSION_TIMEOUT;
+	if (timing->min_retransmission_timeout > timing->retransmission_timeout)
+		timing->min_retransmission_timeout = timing->retransmission_timeout;
+	if (timing->max_retransmissions <= 0)
+		timing->max_retransmissions = MAX_STUN_RETRANSMISSION_COUNT;
+	if (timing->keepalive_period < STUN_KEEPALIVE_PERIOD)
+		timing->keepalive_period = STUN_KEEPALIVE_PERIOD;
+	if (!timing->fail_timeout)
+		timing->fail_timeout = ICE_FAIL_TIMEOUT;
+	if (timing->failover_timeout && timing->failover_timeout < MIN_FAILOVER_TIMEOUT)
+		timing->failover_timeout = MIN_FAILOVER_TIMEOUT;
+
 	if (agent->config.stun_server_host) {
 	agent->config.stun_server_host = alloc_string_copy(agent->config.stun_server_host);
 		if (!agent->config.stun_server_host) {
@@ -124,7 +179,6 @@ juice_agent_t *agent_create(const juice_config_t *config) {
 
 	agent->state = JUICE_STATE_DISCONNECTED;
 	agent->mode = AGENT_MODE_UNKNOWN;
-	agent->sock = INVALID_SOCKET;
 	agent->send_ds = 0;
 
 #ifdef NO_ATOMICS
@@ -133,7 +187,9 @@ juice_agent_t *agent_create(const juice_config_t *config) {
 	atomic_init(&agent->selected_entry, NULL);
 #endif
 
+	arena_init(&agent->arena, AGENT_ARENA_BLOCK_SIZE);
 	ice_create_local_description(&agent->local, logger);
+	ice_init_description(&agent->remote);
 
 	// RFC 8445: 16.1. Attributes
 	// The content of the [ICE-CONTROLLED/ICE-CONTROLLING] attribute is a 64-bit
@@ -145,6 +201,7 @@ juice_agent_t *agent_create(const juice_config_t *config) {
 	// number.
 	juice_random(&agent->ice_tiebreaker, sizeof(agent->ice_tiebreaker), logger);
 
+	agent_update_hmac_keys(agent);
 	return agent;
 
 error:
@@ -158,18 +215,41 @@ void agent_do_destroy(juice_agent_t *agent) {
 	if (agent->sock != INVALID_SOCKET)
 		closesocket(agent->sock);
 
+	// Pending resolutions are completed and freed by the resolver, releasing them first ensures
+	// the callback does not trigger the wakeup afterwards
+	for (int i = 0; i < agent->resolutions_count; ++i)
+		if (agent->resolutions[i].request)
+			resolver_release(agent->resolutions[i].request);
+	free(agent->resolutions);
+
+	// Co-located agents and the address watch must stop triggering the wakeup first
+	shortcut_cleanup(&agent->shortcut);
+	udp_unwatch_addrs(&agent->addrs_watcher);
+	wakeup_destroy(&agent->wakeup);
+
 	mutex_destroy(&agent->mutex);
 	mutex_destroy(&agent->send_mutex);
 
 	// Free credentials in entries
 	for (int i = 0; i < agent->entries_count; ++i) {
-		agent_stun_entry_t *entry = agent->entries + i;
+		agent_stun_entry_t *entry = agent->entries[i];
 		if (entry->turn) {
 			turn_destroy_map(&entry->turn->map);
-		free(entry->turn);
-	}
+			free(entry->turn);
+		}
 	}
 
+	free(agent->entries);
+	free(agent->schedule);
+	free(agent->candidate_pairs);
+	free(agent->ordered_pairs);
+	arena_destroy(&agent->arena);
+
+	ice_destroy_description(&agent->local);
+	ice_destroy_description(&agent->remote);
+	hmac_key_destroy(agent->local_hmac_key);
+	hmac_key_destroy(agent->remote_hmac_key);
+
 	// Free strings in config
 	free((void *)agent->config.stun_server_host);
 	for (int i = 0; i < agent->config.turn_servers_count; ++i) {
@@ -216,38 +296,97 @@ int agent_gather_candidates(juice_agent_t *agent) {
 		return 0;
 	}
 
-	udp_socket_config_t socket_config;
-	memset(&socket_config, 0, sizeof(socket_config));
-	socket_config.port_begin = agent->config.local_port_range_begin;
-	socket_config.port_end = agent->config.local_port_range_end;
-	agent->sock = udp_create_socket(&socket_config, agent->logger);
-	if (agent->sock == INVALID_SOCKET) {
-		JLOG_FATAL(agent->logger, "UDP socket creation for agent failed");
+	// A pre-warmed TURN allocation comes with its socket, which then becomes the agent socket
+	turn_pool_allocation_t allocation;
+	for (int i = 0; i < agent->config.turn_servers_count; ++i) {
+		juice_turn_server_t *turn_server = agent->config.turn_servers + i;
+		if (turn_pool_adopt(turn_server, agent->config.local_port_range_begin,
+		                    agent->config.local_port_range_end, &allocation) == 0) {
+			JLOG_INFO(agent->logger, "Using pre-warmed TURN allocation on %s:%hu",
+			          turn_server->host, turn_server->port ? turn_server->port : 3478);
+			agent->pooled_turn_server = turn_server;
+			agent->sock = allocation.sock;
+			break;
+		}
+	}
+
+	if (!agent->pooled_turn_server) {
+		udp_socket_config_t socket_config;
+		memset(&socket_config, 0, sizeof(socket_config));
+		socket_config.port_begin = agent->config.local_port_range_begin;
+		socket_config.port_end = agent->config.local_port_range_end;
+		agent->sock = udp_create_socket(&socket_config, agent->logger);
+		if (agent->sock == INVALID_SOCKET) {
+			JLOG_FATAL(agent->logger, "UDP socket creation for agent failed");
+			mutex_unlock(&agent->mutex);
+			return -1;
+		}
+	}
+	if (agent->config.enable_shortcut &&
+	    shortcut_register(&agent->shortcut, agent->local.ice_ufrag, agent->local.ice_pwd) < 0)
+		JLOG_WARN(agent->logger, "Failed to register agent for in-process delivery");
+
+	agent->gathering_timestamp = current_timestamp();
+	agent_change_state(agent, JUICE_STATE_GATHERING);
+
+	// Local address changes wake up the agent thread so host candidates are gathered again
+	udp_watch_addrs(&agent->addrs_watcher, &agent->wakeup);
+	agent_gather_host_candidates(agent);
+
+	if (agent->pooled_turn_server &&
+	    agent_add_pooled_relay_entry(agent, agent->pooled_turn_server, &allocation) < 0) {
+		JLOG_ERROR(agent->logger, "Failed to use pre-warmed TURN allocation");
+		agent->pooled_turn_server = NULL; // resolve and allocate as usual
+	}
+
+	if (agent->mode == AGENT_MODE_UNKNOWN) {
+		JLOG_DEBUG(agent->logger, "Assuming controlling mode");
+		agent->mode = AGENT_MODE_CONTROLLING;
+	}
+	int ret = thread_init(&agent->thread, agent_thread_entry, agent);
+	if (ret) {
+		JLOG_FATAL(agent->logger, "thread_create for agent failed, error=%d", ret);
 		mutex_unlock(&agent->mutex);
 		return -1;
 	}
-	agent_change_state(agent, JUICE_STATE_GATHERING);
+	agent->thread_started = true;
+	mutex_unlock(&agent->mutex);
+	return 0;
+}
 
-	addr_record_t records[ICE_MAX_CANDIDATES_COUNT - 1];
-	int records_count =
-	    udp_get_addrs(agent->sock, records, ICE_MAX_CANDIDATES_COUNT - 1, agent->logger);
+int agent_gather_host_candidates(juice_agent_t *agent) {
+	// Read the generation first so a concurrent change is not missed
+	agent->addrs_generation = udp_get_addrs_generation();
+
+	addr_record_t records[MAX_HOST_RECORDS_COUNT];
+	int records_count = udp_get_addrs(agent->sock, records, MAX_HOST_RECORDS_COUNT, agent->logger);
 	if (records_count < 0) {
 		JLOG_ERROR(agent->logger, "Failed to gather local host candidates");
 		records_count = 0;
 	} else if (records_count == 0) {
 		JLOG_WARN(agent->logger, "No local host candidates gathered");
-	} else if (records_count > ICE_MAX_CANDIDATES_COUNT - 1)
-		records_count = ICE_MAX_CANDIDATES_COUNT - 1;
+	} else if (records_count > MAX_HOST_RECORDS_COUNT)
+		records_count = MAX_HOST_RECORDS_COUNT;
+
+	int host_count = 0;
+	for (int i = 0; i < agent->local.candidates_count; ++i)
+		if (agent->local.candidates[i]->type == ICE_CANDIDATE_TYPE_HOST)
+			++host_count;
 
+	ice_candidate_t *added[MAX_HOST_RECORDS_COUNT];
+	int added_count = 0;
 	JLOG_VERBOSE(agent->logger, "Adding %d local host candidates", records_count);
 	for (int i = 0; i < records_count; ++i) {
+		if (ice_find_candidate_from_addr(&agent->local, records + i, ICE_CANDIDATE_TYPE_HOST))
+			continue; // already gathered
+
 		ice_candidate_t candidate;
 		if (ice_create_local_candidate(ICE_CANDIDATE_TYPE_HOST, 1, records + i, &candidate,
 		                               agent->logger)) {
 			JLOG_ERROR(agent->logger, "Failed to create host candidate");
 			continue;
 		}
-		if (agent->local.candidates_count >= MAX_HOST_CANDIDATES_COUNT) {
+		if (host_count >= MAX_HOST_CANDIDATES_COUNT) {
 			JLOG_WARN(agent->logger,
 			          "Local description already has the maximum number of host candidates");
 			break;
@@ -256,16 +395,20 @@ int agent_gather_candidates(juice_agent_t *agent) {
 			JLOG_ERROR(agent->logger, "Failed to add candidate to local description");
 			continue;
 		}
+		added[added_count++] = agent->local.candidates[agent->local.candidates_count - 1];
+		++host_count;
 	}
+	if (added_count == 0)
+		return 0;
+
 	ice_sort_candidates(&agent->local);
 
 	for (int i = 0; i < agent->entries_count; ++i)
-		agent_translate_host_candidate_entry(agent, agent->entries + i);
+		agent_translate_host_candidate_entry(agent, agent->entries[i]);
 
 	char buffer[BUFFER_SIZE];
-	for (int i = 0; i < agent->local.candidates_count; ++i) {
-		ice_candidate_t *candidate = agent->local.candidates + i;
-		if (ice_generate_candidate_sdp(candidate, buffer, BUFFER_SIZE, agent->logger) < 0) {
+	for (int i = 0; i < added_count; ++i) {
+		if (ice_generate_candidate_sdp(added[i], buffer, BUFFER_SIZE, agent->logger) < 0) {
 			JLOG_ERROR(agent->logger, "Failed to generate SDP for local candidate");
 			continue;
 		}
@@ -275,20 +418,7 @@ int agent_gather_candidates(juice_agent_t *agent) {
 		if (agent->config.cb_candidate)
 			agent->config.cb_candidate(agent, buffer, agent->config.user_ptr);
 	}
-
-	if (agent->mode == AGENT_MODE_UNKNOWN) {
-		JLOG_DEBUG(agent->logger, "Assuming controlling mode");
-		agent->mode = AGENT_MODE_CONTROLLING;
-	}
-	int ret = thread_init(&agent->thread, agent_thread_entry, agent);
-	if (ret) {
-		JLOG_FATAL(agent->logger, "thread_create for agent failed, error=%d", ret);
-		mutex_unlock(&agent->mutex);
-		return -1;
-	}
-	agent->thread_started = true;
-	mutex_unlock(&agent->mutex);
-	return 0;
+	return added_count;
 }
 
 int agent_get_local_description(juice_agent_t *agent, char *buffer, size_t size) {
@@ -311,34 +441,64 @@ int agent_get_local_description(juice_agent_t *agent, char *buffer, size_t size)
 int agent_set_remote_description(juice_agent_t *agent, const char *sdp) {
 	mutex_lock(&agent->mutex);
 	JLOG_VERBOSE(agent->logger, "Setting remote SDP description: %s", sdp);
-	int ret = ice_parse_sdp(sdp, &agent->remote, agent->logger);
+	char previous_ufrag[256 + 1];
+	char previous_pwd[256 + 1];
+	strcpy(previous_ufrag, agent->remote.ice_ufrag);
+	strcpy(previous_pwd, agent->remote.ice_pwd);
+
+	// Parse into a new description so the previous candidates can be released
+	ice_description_t remote;
+	ice_init_description(&remote);
+	int ret = ice_parse_sdp(sdp, &remote, agent->logger);
 	if (ret < 0) {
 		if (ret == ICE_PARSE_ERROR)
 			JLOG_ERROR(agent->logger, "Failed to parse remote SDP description");
 
+		ice_destroy_description(&remote);
 		mutex_unlock(&agent->mutex);
 		return -1;
 	}
-	if (!*agent->remote.ice_ufrag) {
+	if (!*remote.ice_ufrag) {
 		JLOG_ERROR(agent->logger, "Missing ICE user fragment in remote description");
+		ice_destroy_description(&remote);
 		mutex_unlock(&agent->mutex);
 		return -1;
 	}
-	if (!*agent->remote.ice_pwd) {
+	if (!*remote.ice_pwd) {
 		JLOG_ERROR(agent->logger, "Missing ICE password in remote description");
+		ice_destroy_description(&remote);
+		mutex_unlock(&agent->mutex);
+		return -1;
+	}
+	if (agent_replace_remote_description(agent, &remote) < 0) {
+		ice_destroy_description(&remote);
 		mutex_unlock(&agent->mutex);
 		return -1;
 	}
+	// RFC 8445 9. ICE Restarts: new credentials in the remote description mean an ICE restart
+	if (*previous_ufrag && (strcmp(previous_ufrag, agent->remote.ice_ufrag) != 0 ||
+	                        strcmp(previous_pwd, agent->remote.ice_pwd) != 0)) {
+		JLOG_INFO(agent->logger, "Remote credentials changed, restarting connectivity checks");
+		agent_restart_checks(agent);
+		shortcut_unlink(&agent->shortcut); // until a pair is selected again
+	}
+	shortcut_set_remote(&agent->shortcut, agent->remote.ice_ufrag, agent->remote.ice_pwd);
+	if (strcmp(previous_pwd, agent->remote.ice_pwd) != 0 || !agent->remote_hmac_key)
+		agent_update_hmac_keys(agent);
+
+	// Cached requests embed the credentials
+	agent_invalidate_cached_requests(agent);
+
 	// There is only one component, therefore we can unfreeze already existing pairs now
 	JLOG_DEBUG(agent->logger, "Unfreezing %d existing candidate pairs",
 	           (int)agent->candidate_pairs_count);
 	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
-		agent_unfreeze_candidate_pair(agent, agent->candidate_pairs + i);
+		agent_unfreeze_candidate_pair(agent, agent->candidate_pairs[i]);
 	}
 	JLOG_DEBUG(agent->logger, "Adding %d candidates from remote description",
 	           (int)agent->remote.candidates_count);
 	for (int i = 0; i < agent->remote.candidates_count; ++i) {
-		ice_candidate_t *remote = agent->remote.candidates + i;
+		ice_candidate_t *remote = agent->remote.candidates[i];
 		if (agent_add_candidate_pairs_for_remote(agent, remote))
 			JLOG_WARN(agent->logger, "Failed to add candidate pair from remote description");
 	}
@@ -351,6 +511,46 @@ int agent_set_remote_description(juice_agent_t *agent, const char *sdp) {
 	return 0;
 }
 
+int agent_replace_remote_description(juice_agent_t *agent, ice_description_t *remote) {
+	// Pairs may reference candidates of the current description, move them to the new one
+	ice_candidate_t **copies = NULL;
+	if (agent->candidate_pairs_count > 0) {
+		copies = calloc(agent->candidate_pairs_count, sizeof(ice_candidate_t *));
+		if (!copies) {
+			JLOG_ERROR(agent->logger, "calloc for candidates failed");
+			return -1;
+		}
+	}
+	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
+		ice_candidate_t *candidate = agent->candidate_pairs[i]->remote;
+		if (!candidate)
+			continue;
+
+		// Pairs sharing a remote candidate keep sharing it
+		for (int j = 0; j < i && !copies[i]; ++j)
+			if (agent->candidate_pairs[j]->remote == candidate)
+				copies[i] = copies[j];
+
+		if (!copies[i]) {
+			copies[i] = arena_alloc(&remote->arena, sizeof(ice_candidate_t));
+			if (!copies[i]) {
+				JLOG_ERROR(agent->logger, "alloc for candidate failed");
+				free(copies);
+				return -1;
+			}
+			*copies[i] = *candidate;
+		}
+	}
+	for (int i = 0; i < agent->candidate_pairs_count; ++i)
+		if (copies[i])
+			agent->candidate_pairs[i]->remote = copies[i];
+
+	free(copies);
+	ice_destroy_description(&agent->remote);
+	agent->remote = *remote;
+	return 0;
+}
+
 int agent_add_remote_candidate(juice_agent_t *agent, const char *sdp) {
 	mutex_lock(&agent->mutex);
 	JLOG_VERBOSE(agent->logger, "Adding remote candidate: %s", sdp);
@@ -370,7 +570,7 @@ int agent_add_remote_candidate(juice_agent_t *agent, const char *sdp) {
 		mutex_unlock(&agent->mutex);
 		return -1;
 	}
-	ice_candidate_t *remote = agent->remote.candidates + agent->remote.candidates_count - 1;
+	ice_candidate_t *remote = agent->remote.candidates[agent->remote.candidates_count - 1];
 	ret = agent_add_candidate_pairs_for_remote(agent, remote);
 	mutex_unlock(&agent->mutex);
 	agent_interrupt(agent);
@@ -385,6 +585,57 @@ int agent_set_remote_gathering_done(juice_agent_t *agent) {
 	return 0;
 }
 
+int agent_restart_ice(juice_agent_t *agent) {
+	mutex_lock(&agent->mutex);
+	ice_description_t description;
+	if (ice_create_local_description(&description, agent->logger)) {
+		JLOG_ERROR(agent->logger, "Failed to create new local credentials");
+		mutex_unlock(&agent->mutex);
+		return -1;
+	}
+	strcpy(agent->local.ice_ufrag, description.ice_ufrag);
+	strcpy(agent->local.ice_pwd, description.ice_pwd);
+	ice_destroy_description(&description);
+	agent_update_hmac_keys(agent);
+	agent_invalidate_cached_requests(agent);
+
+	if (agent->sock == INVALID_SOCKET) {
+		// Gathering has not started, new credentials are enough
+		mutex_unlock(&agent->mutex);
+		return 0;
+	}
+
+	if (agent->config.enable_shortcut &&
+	    shortcut_register(&agent->shortcut, agent->local.ice_ufrag, agent->local.ice_pwd) < 0)
+		JLOG_WARN(agent->logger, "Failed to register agent for in-process delivery");
+
+	JLOG_INFO(agent->logger, "Restarting ICE, gathering candidates again");
+	agent->local.finished = false;
+	agent->gathering_done = false;
+
+	// The socket is kept, so are previous host candidates
+	agent_gather_host_candidates(agent);
+
+	// Refresh server reflexive candidates, keep TURN allocations and retry failed ones
+	for (int i = 0; i < agent->entries_count; ++i) {
+		agent_stun_entry_t *entry = agent->entries[i];
+		if (entry->type == AGENT_STUN_ENTRY_TYPE_SERVER ||
+		    (entry->type == AGENT_STUN_ENTRY_TYPE_RELAY &&
+		     entry->state == AGENT_STUN_ENTRY_STATE_FAILED)) {
+			agent_renew_transaction_id(agent, entry);
+			entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
+			agent_arm_transmission(agent, entry, 0);
+			agent->pairs_changed = true;
+		}
+	}
+
+	// Checks restart when the remote description with new credentials is set
+	agent_update_gathering_done(agent);
+	mutex_unlock(&agent->mutex);
+	agent_interrupt(agent);
+	return 0;
+}
+
 int agent_send(juice_agent_t *agent, const char *data, size_t size, int ds) {
 	// For performance reasons, try not to lock the global mutex if the platform has atomics
 #ifdef NO_ATOMICS
@@ -404,16 +655,52 @@ int agent_send(juice_agent_t *agent, const char *data, size_t size, int ds) {
 		return -1;
 	}
 
+	// If the remote agent is in the same process, deliver the datagram to it directly
+	if (shortcut_send(&agent->shortcut, data, size) == 0) {
+		agent_counter_add(&agent->counters.shortcut.bytes_sent, size);
+		agent_counter_add(&agent->counters.shortcut.packets_sent, 1);
+		return (int)size;
+	}
+
 	if (selected_entry->relay_entry) {
-		// The datagram should be sent through the relay, use a channel to minimize overhead
-		mutex_lock(&agent->mutex); // We have to lock the mutex
-		int ret = agent_channel_send(agent, selected_entry->relay_entry, &selected_entry->record,
-		                             data, size, ds);
-		mutex_unlock(&agent->mutex);
+		// The datagram should be sent through the relay, use the channel kept bound by the agent
+		// thread to minimize overhead
+#ifdef NO_ATOMICS
+		uint16_t channel = selected_entry->channel;
+#else
+		uint16_t channel = atomic_load(&selected_entry->channel);
+#endif
+		int ret;
+		if (channel) {
+			ret = agent_channel_send(agent, selected_entry->relay_entry, channel, data, size, ds);
+		} else {
+			// Until the channel is bound, fall back to a Send indication if permitted, as control
+			// traffic is left to the agent thread
+			mutex_lock(&agent->mutex); // We have to lock the mutex
+			agent_stun_entry_t *relay_entry = selected_entry->relay_entry;
+			if (relay_entry->turn && turn_has_permission(&relay_entry->turn->map,
+			                                             &selected_entry->record, agent->logger)) {
+				ret = agent_relay_send(agent, relay_entry, &selected_entry->record, data, size,
+				                       ds);
+			} else {
+				JLOG_VERBOSE(agent->logger, "No TURN permission for the selected pair yet");
+				ret = -1;
+			}
+			mutex_unlock(&agent->mutex);
+		}
+		if (ret >= 0) {
+			agent_counter_add(&agent->counters.relayed.bytes_sent, size);
+			agent_counter_add(&agent->counters.relayed.packets_sent, 1);
+		}
 		return ret;
 	}
 
-	return agent_direct_send(agent, &selected_entry->record, data, size, ds);
+	int ret = agent_direct_send(agent, &selected_entry->record, data, size, ds);
+	if (ret >= 0) {
+		agent_counter_add(&agent->counters.direct.bytes_sent, size);
+		agent_counter_add(&agent->counters.direct.packets_sent, 1);
+	}
+	return ret;
 }
 
 int agent_direct_send(juice_agent_t *agent, const addr_record_t *dst, const char *data, size_t size,
@@ -438,7 +725,7 @@ int agent_direct_send(juice_agent_t *agent, const addr_record_t *dst, const char
 	int ret = sendto(agent->sock, data, size, 0, (const struct sockaddr *)&dst->addr, dst->len);
 #endif
 	if (ret < 0 && sockerrno != SEAGAIN && sockerrno != SEWOULDBLOCK)
-		JLOG_WARN(agent->logger, "Send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(agent->logger, "Send failed, errno=%d", sockerrno);
 
 	mutex_unlock(&agent->send_mutex);
 	return ret;
@@ -472,40 +759,29 @@ int agent_relay_send(juice_agent_t *agent, agent_stun_entry_t *entry, const addr
 	char buffer[BUFFER_SIZE];
 	size = stun_write(buffer, BUFFER_SIZE, &msg, NULL, agent->logger); // no password
 	if (size <= 0) {
-		JLOG_ERROR(agent->logger, "STUN message write failed");
+		JLOG_ERROR_LIMITED(agent->logger, "STUN message write failed");
 		return -1;
 	}
 	if (agent_direct_send(agent, &entry->record, buffer, size, ds) < 0) {
-		JLOG_WARN(agent->logger, "STUN message send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(agent->logger, "STUN message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 	return 0;
 }
 
-int agent_channel_send(juice_agent_t *agent, agent_stun_entry_t *entry, const addr_record_t *record,
+int agent_channel_send(juice_agent_t *agent, agent_stun_entry_t *entry, uint16_t channel,
                        const char *data, size_t size, int ds) {
-	if (!entry->turn) {
-		JLOG_ERROR(agent->logger, "Missing TURN state on relay entry");
-		return -1;
-	}
-
-	// Send ChannelBind if necessary
-	uint16_t channel;
-	if (!turn_get_bound_channel(&entry->turn->map, record, &channel, agent->logger))
-		if (agent_send_turn_channel_bind_request(agent, entry, record, ds, &channel) < 0)
-		return -1;
-
 	JLOG_VERBOSE(agent->logger, "Sending datagram via channel 0x%hX, size=%d", channel, size);
 
 	// Send the data wrapped as ChannelData
 	char buffer[BUFFER_SIZE];
 	int len = turn_wrap_channel_data(buffer, BUFFER_SIZE, data, size, channel, agent->logger);
 	if (len <= 0) {
-		JLOG_ERROR(agent->logger, "TURN ChannelData wrapping failed");
+		JLOG_ERROR_LIMITED(agent->logger, "TURN ChannelData wrapping failed");
 		return -1;
 	}
 	if (agent_direct_send(agent, &entry->record, buffer, len, ds) < 0) {
-		JLOG_WARN(agent->logger, "ChannelData message send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(agent->logger, "ChannelData message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 	return 0;
@@ -518,142 +794,104 @@ juice_state_t agent_get_state(juice_agent_t *agent) {
 	return state;
 }
 
-int agent_get_selected_candidate_pair(juice_agent_t *agent, ice_candidate_t *local,
-                                      ice_candidate_t *remote) {
+int agent_get_selected_rtt(juice_agent_t *agent, int64_t *rtt, int64_t *min_rtt) {
 	mutex_lock(&agent->mutex);
 	ice_candidate_pair_t *pair = agent->selected_pair;
-	if (!pair) {
+	if (!pair || !pair->rtt) {
 		mutex_unlock(&agent->mutex);
 		return -1;
 	}
 
-	if (local)
-		*local = pair->local ? *pair->local : agent->local.candidates[0];
-	if (remote)
-		*remote = *pair->remote;
+	if (rtt)
+		*rtt = pair->rtt;
+	if (min_rtt)
+		*min_rtt = pair->min_rtt;
 
 	mutex_unlock(&agent->mutex);
 	return 0;
 }
 
-void agent_run(juice_agent_t *agent) {
-	mutex_lock(&agent->mutex);
-	agent_change_state(agent, JUICE_STATE_CONNECTING);
-
-	// TURN server resolution
-	if (agent->config.turn_servers_count > 0) {
-		int count = 0;
-		for (int i = 0; i < agent->config.turn_servers_count; ++i) {
-			if (count >= MAX_RELAY_ENTRIES_COUNT)
-				break;
-
-			juice_turn_server_t *turn_server = agent->config.turn_servers + i;
-			if (!turn_server->port)
-				turn_server->port = 3478; // default TURN port
-
-			char service[8];
-			snprintf(service, 8, "%hu", turn_server->port);
+static void get_path_stats(const agent_path_counters_t *counters, juice_path_stats_t *stats) {
+	stats->bytes_sent = agent_counter_load(&counters->bytes_sent);
+	stats->packets_sent = agent_counter_load(&counters->packets_sent);
+	stats->bytes_received = agent_counter_load(&counters->bytes_received);
+	stats->packets_received = agent_counter_load(&counters->packets_received);
+}
 
-			addr_record_t records[DEFAULT_MAX_RECORDS_COUNT];
-			int records_count = addr_resolve(turn_server->host, service, records,
-			                                 DEFAULT_MAX_RECORDS_COUNT, agent->logger);
-			if (records_count > 0) {
-				if (records_count > DEFAULT_MAX_RECORDS_COUNT)
-					records_count = DEFAULT_MAX_RECORDS_COUNT;
+void agent_get_stats(juice_agent_t *agent, juice_agent_stats_t *stats) {
+	memset(stats, 0, sizeof(*stats));
+	get_path_stats(&agent->counters.direct, &stats->direct);
+	get_path_stats(&agent->counters.relayed, &stats->relayed);
+	get_path_stats(&agent->counters.shortcut, &stats->shortcut);
+	stats->checks_sent = agent_counter_load(&agent->counters.checks_sent);
+	stats->checks_retransmitted = agent_counter_load(&agent->counters.checks_retransmitted);
+	stats->datagrams_dropped = agent_counter_load(&agent->counters.datagrams_dropped);
 
-				JLOG_INFO(agent->logger, "Using TURN server %s:%s", turn_server->host, service);
+	mutex_lock(&agent->mutex);
+	stats->connected_time = agent->connected_timestamp
+	                            ? agent->connected_timestamp - agent->gathering_timestamp
+	                            : -1;
+	stats->completed_time = agent->completed_timestamp
+	                            ? agent->completed_timestamp - agent->gathering_timestamp
+	                            : -1;
 
-				addr_record_t *record = NULL;
-				for (int j = 0; j < records_count; ++j) {
-					int family = records[j].addr.ss_family;
-					// Prefer IPv4 for TURN
-					if (family == AF_INET) {
-						record = records + j;
-						break;
-					}
-					if (family == AF_INET6 && !record)
-						record = records + j;
-				}
-				if (record) {
-					JLOG_VERBOSE(agent->logger, "Registering STUN entry %d for relay request",
-					             agent->entries_count);
-					agent_stun_entry_t *entry = agent->entries + agent->entries_count;
-					entry->type = AGENT_STUN_ENTRY_TYPE_RELAY;
-					entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
-					entry->pair = NULL;
-					entry->record = *record;
-					entry->turn = calloc(1, sizeof(agent_turn_state_t));
-					if (!entry->turn) {
-						JLOG_ERROR(agent->logger, "calloc for TURN state failed");
-						break;
-					}
-					if (turn_init_map(&entry->turn->map, AGENT_TURN_MAP_SIZE, agent->logger) < 0) {
-						free(entry->turn);
-						break;
-					}
-					snprintf(entry->turn->credentials.username, STUN_MAX_USERNAME_LEN, "%s",
-					         turn_server->username);
-					entry->turn->password = turn_server->password;
-					juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
-					++agent->entries_count;
+	ice_candidate_pair_t *pair = agent->selected_pair;
+	if (pair && pair->rtt_count > 0) {
+		stats->rtt = pair->rtt;
+		stats->min_rtt = pair->min_rtt;
+		stats->avg_rtt = pair->rtt_sum / pair->rtt_count;
+	}
 
-					agent_arm_transmission(agent, entry, STUN_PACING_TIME * i);
+	stats->turn_allocations_count = agent->relay_entries_count;
+	for (int i = 0; i < agent->relay_entries_count; ++i) {
+		agent_stun_entry_t *entry = agent->relay_entries[i];
+		if (entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED ||
+		    entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE)
+			++stats->turn_allocations_ready;
+		else if (entry->state == AGENT_STUN_ENTRY_STATE_FAILED)
+			++stats->turn_allocations_failed;
+	}
+	mutex_unlock(&agent->mutex);
+}
 
-					++count;
-				}
-			} else {
-				JLOG_ERROR(agent->logger, "TURN address resolution failed");
-			}
-		}
+int agent_get_selected_candidate_pair(juice_agent_t *agent, ice_candidate_t *local,
+                                      ice_candidate_t *remote) {
+	mutex_lock(&agent->mutex);
+	ice_candidate_pair_t *pair = agent->selected_pair;
+	if (!pair) {
+		mutex_unlock(&agent->mutex);
+		return -1;
 	}
 
-	// STUN server resolution
-	// The entry is added after so the TURN server address will be matched in priority
-	if (agent->config.stun_server_host) {
-		if (!agent->config.stun_server_port)
-			agent->config.stun_server_port = 3478; // default STUN port
+	if (local)
+		*local = pair->local ? *pair->local : *agent->local.candidates[0];
+	if (remote)
+		*remote = *pair->remote;
 
-		char service[8];
-		snprintf(service, 8, "%hu", agent->config.stun_server_port);
-		addr_record_t records[MAX_STUN_SERVER_RECORDS_COUNT];
-		int records_count = addr_resolve(agent->config.stun_server_host, service, records,
-		                                 MAX_STUN_SERVER_RECORDS_COUNT, agent->logger);
-		if (records_count > 0) {
-			if (records_count > MAX_STUN_SERVER_RECORDS_COUNT)
-				records_count = MAX_STUN_SERVER_RECORDS_COUNT;
-
-			JLOG_INFO(agent->logger, "Using STUN server %s:%s", agent->config.stun_server_host,
-			          service);
-
-			for (int i = 0; i < records_count; ++i) {
-				if (i >= MAX_SERVER_ENTRIES_COUNT)
-					break;
-				JLOG_VERBOSE(agent->logger, "Registering STUN entry %d for server request",
-				             agent->entries_count);
-				agent_stun_entry_t *entry = agent->entries + agent->entries_count;
-				entry->type = AGENT_STUN_ENTRY_TYPE_SERVER;
-				entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
-				entry->pair = NULL;
-				entry->record = records[i];
-				juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
-				++agent->entries_count;
+	mutex_unlock(&agent->mutex);
+	return 0;
+}
 
-				agent_arm_transmission(agent, entry, STUN_PACING_TIME * i);
-			}
-		} else {
-			JLOG_ERROR(agent->logger, "STUN server address resolution failed");
-		}
-	}
+void agent_run(juice_agent_t *agent) {
+	mutex_lock(&agent->mutex);
+	agent_change_state(agent, JUICE_STATE_CONNECTING);
 
+	agent_resolve_servers(agent);
+	agent_update_resolutions(agent); // results might already be cached
 	agent_update_gathering_done(agent);
 
 	// Main loop
 	timestamp_t next_timestamp;
+	timestamp_update();
 	while (agent_bookkeeping(agent, &next_timestamp) == 0) {
 		timediff_t timediff = next_timestamp - current_timestamp();
 		if (timediff < 0)
 			timediff = 0;
 
+		// Do not wait if datagrams from a co-located agent are pending
+		if (!shortcut_prepare_wait(&agent->shortcut))
+			timediff = 0;
+
 		JLOG_VERBOSE(agent->logger, "Setting select timeout to %ld ms", (long)timediff);
 		struct timeval timeout;
 		timeout.tv_sec = (long)(timediff / 1000);
@@ -662,13 +900,18 @@ void agent_run(juice_agent_t *agent) {
 		fd_set readfds;
 		FD_ZERO(&readfds);
 		FD_SET(agent->sock, &readfds);
+		FD_SET(agent->wakeup.read_fd, &readfds);
 		int n = SOCKET_TO_INT(agent->sock) + 1;
+		if (n < SOCKET_TO_INT(agent->wakeup.read_fd) + 1)
+			n = SOCKET_TO_INT(agent->wakeup.read_fd) + 1;
 
 		JLOG_VERBOSE(agent->logger, "Entering select");
 		mutex_unlock(&agent->mutex);
 		int ret = select(n, &readfds, NULL, NULL, &timeout);
 		mutex_lock(&agent->mutex);
 		JLOG_VERBOSE(agent->logger, "Leaving select");
+		timestamp_update();
+		shortcut_end_wait(&agent->shortcut);
 		if (ret < 0) {
 			if (sockerrno == SEINTR || sockerrno == SEAGAIN) {
 				JLOG_VERBOSE(agent->logger, "select interrupted");
@@ -684,16 +927,232 @@ void agent_run(juice_agent_t *agent) {
 			break;
 		}
 
+		if (FD_ISSET(agent->wakeup.read_fd, &readfds)) {
+			wakeup_drain(&agent->wakeup);
+			agent_update_resolutions(agent);
+		}
+
 		if (FD_ISSET(agent->sock, &readfds)) {
 			if (agent_recv(agent) < 0)
 				break;
 		}
+
+		agent_recv_shortcut(agent);
 	}
 	JLOG_DEBUG(agent->logger, "Leaving agent thread");
+	timestamp_reset();
 	agent_change_state(agent, JUICE_STATE_DISCONNECTED);
 	mutex_unlock(&agent->mutex);
 }
 
+static void agent_resolver_callback(void *user_ptr) {
+	juice_agent_t *agent = user_ptr;
+	wakeup_trigger(&agent->wakeup);
+}
+
+int agent_resolve_servers(juice_agent_t *agent) {
+	// One resolution per TURN server plus one for the STUN server
+	agent->resolutions = calloc(agent->config.turn_servers_count + 1, sizeof(agent_resolution_t));
+	if (!agent->resolutions) {
+		JLOG_ERROR(agent->logger, "calloc for resolutions failed");
+		return -1;
+	}
+
+	for (int i = 0; i < agent->config.turn_servers_count; ++i) {
+		juice_turn_server_t *turn_server = agent->config.turn_servers + i;
+		if (!turn_server->port)
+			turn_server->port = 3478; // default TURN port
+
+		if (turn_server == agent->pooled_turn_server)
+			continue; // already allocated
+
+		char service[8];
+		snprintf(service, 8, "%hu", turn_server->port);
+
+		agent_resolution_t *resolution = agent->resolutions + agent->resolutions_count;
+		resolution->request = resolver_submit(turn_server->host, service, agent_resolver_callback,
+		                                      agent, agent->logger);
+		if (!resolution->request) {
+			JLOG_ERROR(agent->logger, "TURN address resolution failed");
+			continue;
+		}
+		resolution->turn_server = turn_server;
+		++agent->resolutions_count;
+	}
+
+	if (agent->config.stun_server_host) {
+		if (!agent->config.stun_server_port)
+			agent->config.stun_server_port = 3478; // default STUN port
+
+		char service[8];
+		snprintf(service, 8, "%hu", agent->config.stun_server_port);
+
+		agent_resolution_t *resolution = agent->resolutions + agent->resolutions_count;
+		resolution->request = resolver_submit(agent->config.stun_server_host, service,
+		                                      agent_resolver_callback, agent, agent->logger);
+		if (!resolution->request) {
+			JLOG_ERROR(agent->logger, "STUN server address resolution failed");
+			return 0;
+		}
+		resolution->turn_server = NULL;
+		++agent->resolutions_count;
+	}
+
+	return 0;
+}
+
+void agent_update_resolutions(juice_agent_t *agent) {
+	bool changed = false;
+	for (int i = 0; i < agent->resolutions_count; ++i) {
+		agent_resolution_t *resolution = agent->resolutions + i;
+		if (!resolution->request)
+			continue;
+
+		addr_record_t records[RESOLVER_MAX_RECORDS_COUNT];
+		int records_count =
+		    resolver_get_result(resolution->request, records, RESOLVER_MAX_RECORDS_COUNT);
+		if (records_count == RESOLVER_PENDING)
+			continue;
+
+		resolver_release(resolution->request);
+		resolution->request = NULL;
+		changed = true;
+
+		juice_turn_server_t *turn_server = resolution->turn_server;
+		if (turn_server) {
+			if (records_count > 0) {
+				JLOG_INFO(agent->logger, "Using TURN server %s:%hu", turn_server->host,
+				          turn_server->port);
+				agent_add_relay_entry(agent, turn_server, records, records_count);
+			} else {
+				JLOG_ERROR(agent->logger, "TURN address resolution failed for %s:%hu",
+				           turn_server->host, turn_server->port);
+			}
+		} else {
+			if (records_count > 0) {
+				JLOG_INFO(agent->logger, "Using STUN server %s:%hu",
+				          agent->config.stun_server_host, agent->config.stun_server_port);
+				agent_add_server_entries(agent, records, records_count);
+			} else {
+				JLOG_ERROR(agent->logger, "STUN server address resolution failed for %s:%hu",
+				           agent->config.stun_server_host, agent->config.stun_server_port);
+			}
+		}
+	}
+
+	if (changed)
+		agent_update_gathering_done(agent);
+}
+
+int agent_add_server_entries(juice_agent_t *agent, const addr_record_t *records, int count) {
+	if (count > MAX_STUN_SERVER_RECORDS_COUNT)
+		count = MAX_STUN_SERVER_RECORDS_COUNT;
+
+	for (int i = 0; i < count; ++i) {
+		if (i >= MAX_SERVER_ENTRIES_COUNT)
+			break;
+		JLOG_VERBOSE(agent->logger, "Registering STUN entry %d for server request",
+		             agent->entries_count);
+		agent_stun_entry_t *entry = arena_alloc(&agent->arena, sizeof(agent_stun_entry_t));
+		if (!entry) {
+			JLOG_ERROR(agent->logger, "alloc for STUN entry failed");
+			return -1;
+		}
+		entry->type = AGENT_STUN_ENTRY_TYPE_SERVER;
+		entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
+		entry->pair = NULL;
+		entry->record = records[i];
+		juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
+		if (agent_add_entry(agent, entry) < 0)
+			return -1;
+
+		agent_arm_transmission(agent, entry, 0); // transmissions are paced by the schedule
+	}
+	return 0;
+}
+
+int agent_add_relay_entry(juice_agent_t *agent, const juice_turn_server_t *turn_server,
+                          const addr_record_t *records, int count) {
+	if (agent->relay_entries_count >= MAX_RELAY_ENTRIES_COUNT) {
+		JLOG_DEBUG(agent->logger, "Ignoring TURN server, maximum number of relays reached");
+		return -1;
+	}
+
+	const addr_record_t *record = NULL;
+	for (int i = 0; i < count; ++i) {
+		int family = records[i].addr.ss_family;
+		// Prefer IPv4 for TURN
+		if (family == AF_INET) {
+			record = records + i;
+			break;
+		}
+		if (family == AF_INET6 && !record)
+			record = records + i;
+	}
+	if (!record)
+		return -1;
+
+	JLOG_VERBOSE(agent->logger, "Registering STUN entry %d for relay request",
+	             agent->entries_count);
+	agent_stun_entry_t *entry = arena_alloc(&agent->arena, sizeof(agent_stun_entry_t));
+	if (!entry) {
+		JLOG_ERROR(agent->logger, "alloc for STUN entry failed");
+		return -1;
+	}
+	entry->type = AGENT_STUN_ENTRY_TYPE_RELAY;
+	entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
+	entry->pair = NULL;
+	entry->record = *record;
+	entry->turn = calloc(1, sizeof(agent_turn_state_t));
+	if (!entry->turn) {
+		JLOG_ERROR(agent->logger, "calloc for TURN state failed");
+		return -1;
+	}
+	if (turn_init_map(&entry->turn->map, AGENT_TURN_MAP_SIZE, agent->logger) < 0) {
+		free(entry->turn);
+		return -1;
+	}
+	snprintf(entry->turn->credentials.username, STUN_MAX_USERNAME_LEN, "%s",
+	         turn_server->username);
+	entry->turn->password = turn_server->password;
+	juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
+	if (agent_add_entry(agent, entry) < 0) {
+		turn_destroy_map(&entry->turn->map);
+		free(entry->turn);
+		return -1;
+	}
+	agent->relay_entries[agent->relay_entries_count++] = entry;
+
+	agent_arm_transmission(agent, entry, 0);
+	return 0;
+}
+
+int agent_add_pooled_relay_entry(juice_agent_t *agent, const juice_turn_server_t *turn_server,
+                                 const turn_pool_allocation_t *allocation) {
+	if (agent_add_relay_entry(agent, turn_server, &allocation->server, 1) < 0)
+		return -1;
+
+	// The allocation is done already, only refreshes are left
+	agent_stun_entry_t *entry = agent->relay_entries[agent->relay_entries_count - 1];
+	entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE;
+	entry->turn->credentials = allocation->credentials;
+	entry->relayed = allocation->relayed;
+	timediff_t delay = allocation->refresh_timestamp - cached_timestamp();
+	agent_arm_transmission(agent, entry, delay > 0 ? delay : 0);
+
+	if (allocation->mapped.len &&
+	    agent_add_local_reflexive_candidate(agent, ICE_CANDIDATE_TYPE_SERVER_REFLEXIVE,
+	                                        &allocation->mapped)) {
+		JLOG_WARN(agent->logger,
+		          "Failed to add local server reflexive candidate from TURN mapped address");
+	}
+
+	if (agent_add_local_relayed_candidate(agent, &allocation->relayed))
+		JLOG_WARN(agent->logger, "Failed to add local relayed candidate from TURN relayed address");
+
+	return 0;
+}
+
 int agent_recv(juice_agent_t *agent) {
 	JLOG_VERBOSE(agent->logger, "Receiving datagrams");
 	while (true) {
@@ -718,13 +1177,9 @@ int agent_recv(juice_agent_t *agent) {
 				JLOG_VERBOSE(agent->logger, "No more datagrams to receive");
 				break;
 			}
-			JLOG_ERROR(agent->logger, "recvfrom failed, errno=%d", sockerrno);
+			JLOG_ERROR_LIMITED(agent->logger, "recvfrom failed, errno=%d", sockerrno);
 			return -1;
 		}
-		if (len == 0) {
-			// Empty datagram (used to interrupt)
-			continue;
-		}
 
 		addr_unmap_inet6_v4mapped((struct sockaddr *)&record.addr, &record.len);
 		agent_input(agent, buffer, len, &record, NULL);
@@ -733,15 +1188,83 @@ int agent_recv(juice_agent_t *agent) {
 	return 0;
 }
 
+int agent_recv_shortcut(juice_agent_t *agent) {
+	// Process a bounded batch so bookkeeping is not delayed, the next select will not wait
+	int count = 0;
+	const shortcut_slot_t *slot;
+	while (count < SHORTCUT_RING_SIZE && (slot = shortcut_peek(&agent->shortcut))) {
+		JLOG_VERBOSE(agent->logger, "Received datagram from co-located agent, size=%zu",
+		             slot->size);
+		agent_counter_add(&agent->counters.shortcut.bytes_received, slot->size);
+		agent_counter_add(&agent->counters.shortcut.packets_received, 1);
+		if (agent->config.cb_recv)
+			agent->config.cb_recv(agent, slot->data, slot->size, agent->config.user_ptr);
+
+		shortcut_release(&agent->shortcut);
+		++count;
+	}
+	return count;
+}
+
+// Checks the header of a STUN message so unexpected ones are dropped before decoding attributes
+static bool is_expected_stun(juice_agent_t *agent, const stun_view_t *view) {
+	switch (view->msg_method) {
+	case STUN_METHOD_BINDING:
+		break;
+
+	case STUN_METHOD_ALLOCATE:
+	case STUN_METHOD_REFRESH:
+	case STUN_METHOD_CREATE_PERMISSION:
+	case STUN_METHOD_CHANNEL_BIND:
+		// The agent is only a TURN client
+		if (!STUN_IS_RESPONSE(view->msg_class)) {
+			JLOG_WARN_LIMITED(agent->logger, "Unexpected STUN message, class=0x%X, method=0x%X",
+			                  view->msg_class, view->msg_method);
+			return false;
+		}
+		break;
+
+	case STUN_METHOD_DATA:
+		if (view->msg_class != STUN_CLASS_INDICATION) {
+			JLOG_WARN_LIMITED(agent->logger, "Unexpected STUN message, class=0x%X, method=0x%X",
+			                  view->msg_class, view->msg_method);
+			return false;
+		}
+		break;
+
+	default:
+		JLOG_WARN_LIMITED(agent->logger, "Unknown STUN method 0x%X, ignoring", view->msg_method);
+		return false;
+	}
+
+	if (STUN_IS_RESPONSE(view->msg_class) &&
+	    !agent_find_entry_from_transaction_id(agent, view->transaction_id)) {
+		JLOG_WARN_LIMITED(agent->logger, "No STUN entry matching transaction ID, ignoring");
+		return false;
+	}
+
+	return true;
+}
+
 int agent_input(juice_agent_t *agent, char *buf, size_t len, const addr_record_t *src,
                 const addr_record_t *relayed) {
 	JLOG_VERBOSE(agent->logger, "Received datagram, size=%d", len);
 
 	if (is_stun_datagram(buf, len, agent->logger)) {
 		JLOG_DEBUG(agent->logger, "Received STUN datagram%s", relayed ? " via relay" : "");
+		stun_view_t view;
+		if (stun_read_view(buf, len, &view, agent->logger) < 0) {
+			JLOG_ERROR_LIMITED(agent->logger, "STUN message reading failed");
+			return -1;
+		}
+
+		// Only decode the attributes once the message is known to be expected
+		if (!is_expected_stun(agent, &view))
+			return -1;
+
 		stun_message_t msg;
-		if (stun_read(buf, len, &msg, agent->logger) < 0) {
-			JLOG_ERROR(agent->logger, "STUN message reading failed");
+		if (stun_read_from_view(&view, &msg, agent->logger) < 0) {
+			JLOG_ERROR_LIMITED(agent->logger, "STUN message reading failed");
 			return -1;
 		}
 		return agent_dispatch_stun(agent, buf, len, &msg, src, relayed);
@@ -750,16 +1273,21 @@ int agent_input(juice_agent_t *agent, char *buf, size_t len, const addr_record_t
 	JLOG_DEBUG(agent->logger, "Received non-STUN datagram%s", relayed ? " via relay" : "");
 	agent_stun_entry_t *entry = agent_find_entry_from_record(agent, src, relayed);
 	if (!entry) {
-		JLOG_WARN(agent->logger, "Received a datagram from unknown address, ignoring");
+		JLOG_WARN_LIMITED(agent->logger, "Received a datagram from unknown address, ignoring");
+		agent_counter_add(&agent->counters.datagrams_dropped, 1);
 		return -1;
 	}
 	switch (entry->type) {
-	case AGENT_STUN_ENTRY_TYPE_CHECK:
+	case AGENT_STUN_ENTRY_TYPE_CHECK: {
 		JLOG_DEBUG(agent->logger, "Received application datagram");
+		agent_path_counters_t *counters =
+		    relayed ? &agent->counters.relayed : &agent->counters.direct;
+		agent_counter_add(&counters->bytes_received, len);
+		agent_counter_add(&counters->packets_received, 1);
 		if (agent->config.cb_recv)
 			agent->config.cb_recv(agent, buf, len, agent->config.user_ptr);
 		return 0;
-
+	}
 	case AGENT_STUN_ENTRY_TYPE_RELAY:
 		if (is_channel_data(buf, len)) {
 			JLOG_DEBUG(agent->logger, "Received ChannelData datagram");
@@ -771,32 +1299,17 @@ int agent_input(juice_agent_t *agent, char *buf, size_t len, const addr_record_t
 		break;
 	}
 
-	JLOG_WARN(agent->logger, "Received unexpected non-STUN datagram, ignoring");
+	JLOG_WARN_LIMITED(agent->logger, "Received unexpected non-STUN datagram, ignoring");
 	return -1;
 }
 
 int agent_interrupt(juice_agent_t *agent) {
 	JLOG_VERBOSE(agent->logger, "Interrupting agent thread");
-	mutex_lock(&agent->mutex);
-	if (agent->sock == INVALID_SOCKET) {
-		mutex_unlock(&agent->mutex);
+	if (wakeup_trigger(&agent->wakeup) < 0) {
+		JLOG_WARN(agent->logger, "Failed to interrupt thread by triggering wakeup, errno=%d",
+		          sockerrno);
 		return -1;
 	}
-
-	addr_record_t local;
-	if (udp_get_local_addr(agent->sock, AF_INET, &local, agent->logger) < 0) {
-			mutex_unlock(&agent->mutex);
-		return -1;
-	}
-
-	if (agent_direct_send(agent, &local, NULL, 0, 0) < 0) {
-	JLOG_WARN(agent->logger, "Failed to interrupt thread by triggering socket, errno=%d",
-	          sockerrno);
-	mutex_unlock(&agent->mutex);
-	return -1;
-}
-
-	mutex_unlock(&agent->mutex);
 	return 0;
 }
 
@@ -804,26 +1317,71 @@ void agent_change_state(juice_agent_t *agent, juice_state_t state) {
 	if (state != agent->state) {
 		JLOG_INFO(agent->logger, "Changing state to %s", juice_state_to_string(state));
 		agent->state = state;
+		if (state == JUICE_STATE_CONNECTED && !agent->connected_timestamp)
+			agent->connected_timestamp = cached_timestamp();
+		else if (state == JUICE_STATE_COMPLETED && !agent->completed_timestamp)
+			agent->completed_timestamp = cached_timestamp();
+
 		if (agent->config.cb_state_changed)
 			agent->config.cb_state_changed(agent, state, agent->config.user_ptr);
 	}
 }
 
 int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
-	timestamp_t now = current_timestamp();
+	timestamp_t now = cached_timestamp();
 	*next_timestamp = now + 10000; // We need at least to rearm keepalives
 
+	if (agent->addrs_generation != udp_get_addrs_generation()) {
+		JLOG_INFO(agent->logger, "Local addresses changed, gathering host candidates again");
+		agent_gather_host_candidates(agent);
+	}
+
 	if (agent->state == JUICE_STATE_DISCONNECTED)
 		return 0;
 
-	for (int i = 0; i < agent->entries_count; ++i) {
-		agent_stun_entry_t *entry = agent->entries + i;
+	// Sending data on the selected entry clears its armed flag, so its keepalive is postponed,
+	// except with failover as data does not prove consent
+#ifdef NO_ATOMICS
+	agent_stun_entry_t *selected_entry = agent->selected_entry;
+#else
+	agent_stun_entry_t *selected_entry = atomic_load(&agent->selected_entry);
+#endif
+	if (selected_entry && selected_entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE &&
+	    !agent->config.timing.failover_timeout) {
+#ifdef NO_ATOMICS
+		bool must_arm = !selected_entry->armed;
+#else
+		bool must_arm = !atomic_flag_test_and_set(&selected_entry->armed);
+#endif
+		if (must_arm) {
+			JLOG_VERBOSE(agent->logger, "STUN selected entry: Must be rearmed");
+			agent_arm_transmission(agent, selected_entry, agent->config.timing.keepalive_period);
+		}
+	}
+
+	// Process due entries from the schedule, earliest first
+	while (agent->schedule_count > 0) {
+		agent_stun_entry_t *entry = agent->schedule[0];
+		if (entry->next_transmission > now)
+			break;
+
+		int i = entry->index;
+
+		if (entry->state != AGENT_STUN_ENTRY_STATE_PENDING &&
+		    entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE) {
+			// Entry does not transmit anymore, unset next transmission
+			agent_cancel_transmission(agent, entry);
+			continue;
+		}
+
+		// RFC 8445: Pace transmissions so that at most one is sent every Ta
+		if (agent->pacing_timestamp > now)
+			break;
+
+		agent->pacing_timestamp = now + agent->config.timing.pacing_time;
 
 		// STUN requests transmission or retransmission
 		if (entry->state == AGENT_STUN_ENTRY_STATE_PENDING) {
-			if (entry->next_transmission > now)
-				continue;
-
 			if (entry->retransmissions >= 0) {
 				JLOG_DEBUG(agent->logger,
 				           "STUN entry %d: Sending request (%d retransmissions left)", i,
@@ -838,8 +1396,15 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 					ret = agent_send_stun_binding(agent, entry, STUN_CLASS_REQUEST, 0, NULL, NULL);
 
 				if (ret >= 0) {
+					entry->transmission_timestamp = current_timestamp_us();
+					++entry->transmissions;
 					--entry->retransmissions;
-					entry->next_transmission = now + entry->retransmission_timeout;
+					if (entry->type == AGENT_STUN_ENTRY_TYPE_CHECK) {
+						agent_counter_add(&agent->counters.checks_sent, 1);
+						if (entry->transmissions > 1)
+							agent_counter_add(&agent->counters.checks_retransmitted, 1);
+					}
+					agent_schedule_transmission(agent, entry, now + entry->retransmission_timeout);
 					entry->retransmission_timeout *= 2;
 					continue;
 				}
@@ -848,10 +1413,12 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 			// Failure sending or end of retransmissions
 			JLOG_DEBUG(agent->logger, "STUN entry %d: Failed", i);
 			entry->state = AGENT_STUN_ENTRY_STATE_FAILED;
-			entry->next_transmission = 0;
+			agent_cancel_transmission(agent, entry);
 			if (entry->pair)
 				entry->pair->state = ICE_CANDIDATE_PAIR_STATE_FAILED;
 
+			agent->pairs_changed = true;
+
 			if (entry->type == AGENT_STUN_ENTRY_TYPE_RELAY) {
 				// TURN server
 				JLOG_INFO(agent->logger, "TURN allocation failed");
@@ -865,64 +1432,79 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 		}
 		// STUN keepalives
 		// RFC 8445 11. Keepalives: All endpoints MUST send keepalives for each data session.
-		else if (entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE) {
-#ifdef NO_ATOMICS
-			bool must_arm = !entry->armed;
-#else
-			bool must_arm = !atomic_flag_test_and_set(&entry->armed);
-#endif
-			if (must_arm) {
-				JLOG_VERBOSE(agent->logger, "STUN entry %d: Must be rearmed", i);
-				agent_arm_transmission(agent, entry, STUN_KEEPALIVE_PERIOD);
-			}
-
-			if (entry->next_transmission > now)
-				continue;
-
+		else {
 			JLOG_DEBUG(agent->logger, "STUN entry %d: Sending keepalive", i);
 			int ret;
-			if (entry->type == AGENT_STUN_ENTRY_TYPE_RELAY)
+			if (entry->type == AGENT_STUN_ENTRY_TYPE_RELAY) {
 				// TURN server
 				ret = agent_send_turn_allocate_request(agent, entry, STUN_METHOD_REFRESH);
-			else
+			} else if (entry->type == AGENT_STUN_ENTRY_TYPE_CHECK &&
+			           agent->config.timing.failover_timeout) {
+				// Peer, keepalives are requests so consent loss is detected
+				agent_renew_transaction_id(agent, entry);
+				ret = agent_send_stun_binding(agent, entry, STUN_CLASS_REQUEST, 0, NULL, NULL);
+			} else {
 				// STUN server or peer
 				ret = agent_send_stun_binding(agent, entry, STUN_CLASS_INDICATION, 0, NULL, NULL);
+			}
 
 			if (ret < 0) {
+				// The entry stays due, it will be retried after pacing
 				JLOG_ERROR(agent->logger, "Sending keepalive failed");
 				continue;
 			}
 
-			agent_arm_transmission(agent, entry, STUN_KEEPALIVE_PERIOD);
+			// TURN refreshes and consent checks are requests and are answered
+			entry->transmission_timestamp = current_timestamp_us();
+			entry->transmissions = 1;
 
-		} else {
-			// Entry does not transmit, unset next transmission
-			entry->next_transmission = 0;
+			agent_arm_transmission(agent, entry, agent_get_keepalive_period(agent, entry));
 		}
 	}
 
 	if (agent->candidate_pairs_count == 0)
 		goto finally;
 
+	if (agent->config.timing.failover_timeout)
+		agent_update_failover(agent, now);
+
+	bool rtt_policy = agent->mode == AGENT_MODE_CONTROLLING &&
+	                  agent->config.nomination_policy == JUICE_NOMINATION_POLICY_LOWEST_RTT;
+
 	int pending_count = 0;
 	ice_candidate_pair_t *nominated_pair = NULL;
 	ice_candidate_pair_t *selected_pair = NULL;
+	ice_candidate_pair_t *succeeded_pair = NULL; // highest-priority succeeded pair
+	ice_candidate_pair_t *backup_pairs[MAX_FAILOVER_BACKUPS_COUNT];
+	int backup_pairs_count = 0;
 	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
-		ice_candidate_pair_t *pair = *(agent->ordered_pairs + i);
-		if (pair->nominated) {
-			if (!nominated_pair) {
-				nominated_pair = pair;
-				selected_pair = pair;
-			}
+		ice_candidate_pair_t *pair = agent->ordered_pairs[i];
+		if (pair->nominated && !nominated_pair) {
+			nominated_pair = pair;
+			selected_pair = pair;
 		} else if (pair->state == ICE_CANDIDATE_PAIR_STATE_SUCCEEDED) {
+			if (!succeeded_pair)
+				succeeded_pair = pair;
+			if (backup_pairs_count < MAX_FAILOVER_BACKUPS_COUNT)
+				backup_pairs[backup_pairs_count++] = pair;
 			if (!selected_pair)
 				selected_pair = pair;
+			else if (rtt_policy && !nominated_pair &&
+			         agent_is_pair_within_tolerance(agent, pair, succeeded_pair) && pair->rtt &&
+			         (!selected_pair->rtt || pair->rtt < selected_pair->rtt))
+				selected_pair = pair;
 		} else if (pair->state == ICE_CANDIDATE_PAIR_STATE_PENDING) {
-			if (agent->mode == AGENT_MODE_CONTROLLING && selected_pair) {
-				// A higher-priority pair will be used, we can stop checking
+			if (agent->mode == AGENT_MODE_CONTROLLING && selected_pair &&
+			    !(rtt_policy && !nominated_pair && succeeded_pair &&
+			      agent_is_pair_within_tolerance(agent, pair, succeeded_pair)) &&
+			    !(agent->config.timing.failover_timeout &&
+			      backup_pairs_count < MAX_FAILOVER_BACKUPS_COUNT)) {
+				// A higher-priority pair will be used, we can stop checking, unless backup pairs
+				// are still needed for failover
 				// Entries will be synchronized after the current loop
 				JLOG_VERBOSE(agent->logger, "Cancelling check for lower-priority pair");
 				pair->state = ICE_CANDIDATE_PAIR_STATE_FROZEN;
+				agent->pairs_changed = true;
 			} else {
 				++pending_count;
 			}
@@ -930,14 +1512,16 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 	}
 
 	// Cancel entries of frozen pairs
-	for (int i = 0; i < agent->entries_count; ++i) {
-		agent_stun_entry_t *entry = agent->entries + i;
-		if (entry->pair && entry->pair->state == ICE_CANDIDATE_PAIR_STATE_FROZEN &&
-		    entry->state != AGENT_STUN_ENTRY_STATE_IDLE &&
-		    entry->state != AGENT_STUN_ENTRY_STATE_CANCELLED) {
-			JLOG_DEBUG(agent->logger, "STUN entry %d: Cancelled", i);
-			entry->state = AGENT_STUN_ENTRY_STATE_CANCELLED;
-			entry->next_transmission = 0;
+	if (agent->pairs_changed) {
+		for (int i = 0; i < agent->entries_count; ++i) {
+			agent_stun_entry_t *entry = agent->entries[i];
+			if (entry->pair && entry->pair->state == ICE_CANDIDATE_PAIR_STATE_FROZEN &&
+			    entry->state != AGENT_STUN_ENTRY_STATE_IDLE &&
+			    entry->state != AGENT_STUN_ENTRY_STATE_CANCELLED) {
+				JLOG_DEBUG(agent->logger, "STUN entry %d: Cancelled", i);
+				entry->state = AGENT_STUN_ENTRY_STATE_CANCELLED;
+				agent_cancel_transmission(agent, entry);
+			}
 		}
 	}
 
@@ -948,10 +1532,16 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 			JLOG_DEBUG(agent->logger, selected_pair->nominated ? "New selected and nominated pair"
 			                                    : "New selected pair");
 			agent->selected_pair = selected_pair;
+			agent->pairs_changed = true;
 
 			for (int i = 0; i < agent->entries_count; ++i) {
-				agent_stun_entry_t *entry = agent->entries + i;
+				agent_stun_entry_t *entry = agent->entries[i];
 				if (entry->pair == selected_pair) {
+					entry->response_timestamp = now; // consent starts with the selection
+					if (agent->config.timing.failover_timeout &&
+					    entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE)
+						agent_arm_transmission(agent, entry,
+						                       agent_get_keepalive_period(agent, entry));
 #ifdef NO_ATOMICS
 					agent->selected_entry = entry;
 #else
@@ -960,12 +1550,16 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 					break;
 				}
 			}
+
+			if (shortcut_link(&agent->shortcut))
+				JLOG_DEBUG(agent->logger, "Remote agent is co-located, bypassing the network");
 		}
 
-		if (selected_pair->nominated || agent->mode == AGENT_MODE_CONTROLLING) {
+		if (agent->pairs_changed &&
+		    (selected_pair->nominated || agent->mode == AGENT_MODE_CONTROLLING)) {
 			// Limit retransmissions of still pending entries
 			for (int i = 0; i < agent->entries_count; ++i) {
-				agent_stun_entry_t *entry = agent->entries + i;
+				agent_stun_entry_t *entry = agent->entries[i];
 				if (entry->state == AGENT_STUN_ENTRY_STATE_PENDING && entry->retransmissions > 1)
 					entry->retransmissions = 1;
 			}
@@ -981,40 +1575,62 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 			if (agent->mode == AGENT_MODE_CONTROLLED || pending_count == 0)
 				agent_change_state(agent, JUICE_STATE_COMPLETED);
 
-			// Enable keepalive only for the entry of the nominated pair
-			agent_stun_entry_t *relay_entry = NULL;
-			for (int i = 0; i < agent->entries_count; ++i) {
-				agent_stun_entry_t *entry = agent->entries + i;
-				if (entry->pair && entry->pair == nominated_pair) {
-					relay_entry = entry->relay_entry;
-					if (entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE) {
-						entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE;
-						agent_arm_transmission(agent, entry, STUN_KEEPALIVE_PERIOD);
+			// Enable keepalive only for the entry of the nominated pair, and for the entries of
+			// backup pairs with failover
+			if (!agent->config.timing.failover_timeout)
+				backup_pairs_count = 0;
+
+			if (agent->pairs_changed) {
+				agent_stun_entry_t *relay_entry = NULL;
+				for (int i = 0; i < agent->entries_count; ++i) {
+					agent_stun_entry_t *entry = agent->entries[i];
+					bool is_backup = false;
+					for (int j = 0; j < backup_pairs_count; ++j)
+						if (entry->pair && entry->pair == backup_pairs[j])
+							is_backup = true;
+
+					if (entry->pair && (entry->pair == nominated_pair || is_backup)) {
+						if (entry->pair == nominated_pair)
+							relay_entry = entry->relay_entry;
+						if (entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE) {
+							entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE;
+							agent_arm_transmission(agent, entry,
+							                       agent_get_keepalive_period(agent, entry));
+						}
+					} else {
+						if (entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE)
+							entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED;
 					}
-				} else {
-					if (entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE)
-						entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED;
 				}
-			}
 
-			// If the entry of the nominated candidate is relayed locally, we need also to refresh
-			// the corresponding TURN session regularly
-			if (relay_entry) {
-				relay_entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE;
-				agent_arm_transmission(agent, relay_entry, TURN_REFRESH_PERIOD);
+				// If the entry of the nominated candidate is relayed locally, we need also to
+				// refresh the corresponding TURN session regularly
+				if (relay_entry) {
+					relay_entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE;
+					agent_arm_transmission(agent, relay_entry, TURN_REFRESH_PERIOD);
+				}
 			}
 
 		} else {
 			// Connected
 			agent_change_state(agent, JUICE_STATE_CONNECTED);
 
-			if (agent->mode == AGENT_MODE_CONTROLLING && selected_pair &&
-			    !selected_pair->nomination_requested) {
+			if (rtt_policy && !agent->nomination_timestamp)
+				agent->nomination_timestamp = now + MAX_RTT_NOMINATION_DELAY;
+
+			if (rtt_policy && pending_count > 0 && now < agent->nomination_timestamp) {
+				// Wait for checks of pairs which might have a lower RTT
+				JLOG_VERBOSE(agent->logger, "Delaying nomination, %d pairs pending", pending_count);
+				if (*next_timestamp > agent->nomination_timestamp)
+					*next_timestamp = agent->nomination_timestamp;
+
+			} else if (agent->mode == AGENT_MODE_CONTROLLING && selected_pair &&
+			           !selected_pair->nomination_requested) {
 				// Nominate selected
 				JLOG_DEBUG(agent->logger, "Requesting pair nomination (controlling)");
 				selected_pair->nomination_requested = true;
 				for (int i = 0; i < agent->entries_count; ++i) {
-					agent_stun_entry_t *entry = agent->entries + i;
+					agent_stun_entry_t *entry = agent->entries[i];
 					if (entry->pair && entry->pair == selected_pair) {
 						entry->state = AGENT_STUN_ENTRY_STATE_PENDING; // we don't want keepalives
 						agent_arm_transmission(agent, entry, 0);       // transmit now
@@ -1023,10 +1639,36 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 				}
 			}
 		}
+
+		// Keep TURN channels bound ahead of expiry for the selected pair and, with failover, for
+		// backup pairs, so sending never waits for a binding
+		if (agent->pairs_changed) {
+			agent->channel_entries_count = 0;
+			for (int i = 0; i < agent->entries_count; ++i) {
+				agent_stun_entry_t *entry = agent->entries[i];
+				if (!entry->relay_entry || !entry->pair)
+					continue;
+
+				bool is_backup = false;
+				if (agent->config.timing.failover_timeout)
+					for (int j = 0; j < backup_pairs_count; ++j)
+						if (entry->pair == backup_pairs[j])
+							is_backup = true;
+
+				if ((entry->pair == selected_pair || is_backup) &&
+				    agent->channel_entries_count < 1 + MAX_FAILOVER_BACKUPS_COUNT)
+					agent->channel_entries[agent->channel_entries_count++] = entry;
+			}
+		}
+
+		for (int i = 0; i < agent->channel_entries_count; ++i)
+			agent_refresh_turn_binding(agent, agent->channel_entries[i], now, next_timestamp);
+
 	} else if (pending_count == 0) {
 		// Failed
 		if (!agent->fail_timestamp)
-			agent->fail_timestamp = now + (agent->remote.finished ? 0 : ICE_FAIL_TIMEOUT);
+			agent->fail_timestamp =
+			    now + (agent->remote.finished ? 0 : agent->config.timing.fail_timeout);
 
 		if (agent->fail_timestamp && now >= agent->fail_timestamp)
 			agent_change_state(agent, JUICE_STATE_FAILED);
@@ -1035,10 +1677,14 @@ int agent_bookkeeping(juice_agent_t *agent, timestamp_t *next_timestamp) {
 	}
 
 finally:
-	for (int i = 0; i < agent->entries_count; ++i) {
-		agent_stun_entry_t *entry = agent->entries + i;
-		if (entry->next_transmission && *next_timestamp > entry->next_transmission)
-			*next_timestamp = entry->next_transmission;
+	agent->pairs_changed = false;
+
+	if (agent->schedule_count > 0) {
+		timestamp_t next_transmission = agent->schedule[0]->next_transmission;
+		if (next_transmission < agent->pacing_timestamp)
+			next_transmission = agent->pacing_timestamp;
+		if (*next_timestamp > next_transmission)
+			*next_timestamp = next_transmission;
 	}
 	return 0;
 }
@@ -1052,7 +1698,7 @@ int agent_verify_stun_binding(juice_agent_t *agent, void *buf, size_t size,
 		return 0;
 
 	if (!msg->has_integrity) {
-		JLOG_WARN(agent->logger, "Missing integrity in STUN message");
+		JLOG_WARN_LIMITED(agent->logger, "Missing integrity in STUN message");
 		return -1;
 	}
 
@@ -1062,7 +1708,7 @@ int agent_verify_stun_binding(juice_agent_t *agent, void *buf, size_t size,
 		strcpy(username, msg->credentials.username);
 		char *separator = strchr(username, ':');
 		if (!separator) {
-			JLOG_WARN(agent->logger, "STUN username invalid, username=\"%s\"", username);
+			JLOG_WARN_LIMITED(agent->logger, "STUN username invalid, username=\"%s\"", username);
 			return -1;
 		}
 		*separator = '\0';
@@ -1077,9 +1723,9 @@ int agent_verify_stun_binding(juice_agent_t *agent, void *buf, size_t size,
 			remote_ufrag = second_ufrag;
 		}
 		if (strcmp(local_ufrag, agent->local.ice_ufrag) != 0) {
-			JLOG_WARN(agent->logger,
-			          "STUN local ufrag check failed, expected=\"%s\", actual=\"%s\"",
-			          agent->local.ice_ufrag, local_ufrag);
+			JLOG_WARN_LIMITED(agent->logger,
+			                  "STUN local ufrag check failed, expected=\"%s\", actual=\"%s\"",
+			                  agent->local.ice_ufrag, local_ufrag);
 			return -1;
 		}
 		// RFC 8445 7.3. STUN Server Procedures:
@@ -1088,21 +1734,24 @@ int agent_verify_stun_binding(juice_agent_t *agent, void *buf, size_t size,
 		// immediately generate a response.
 		if (*agent->remote.ice_ufrag != '\0' &&
 		    strcmp(remote_ufrag, agent->remote.ice_ufrag) != 0) {
-			JLOG_WARN(agent->logger,
-			          "STUN remote ufrag check failed, expected=\"%s\", actual=\"%s\"",
-			          agent->remote.ice_ufrag, remote_ufrag);
+			JLOG_WARN_LIMITED(agent->logger,
+			                  "STUN remote ufrag check failed, expected=\"%s\", actual=\"%s\"",
+			                  agent->remote.ice_ufrag, remote_ufrag);
 			return -1;
 		}
 	}
 	// Check password
 	const char *password =
 	    msg->msg_class == STUN_CLASS_REQUEST ? agent->local.ice_pwd : agent->remote.ice_pwd;
+	const hmac_key_t *hkey =
+	    msg->msg_class == STUN_CLASS_REQUEST ? agent->local_hmac_key : agent->remote_hmac_key;
 	if (*password == '\0') {
-		JLOG_WARN(agent->logger, "STUN integrity check failed, unknown password");
+		JLOG_WARN_LIMITED(agent->logger, "STUN integrity check failed, unknown password");
 		return -1;
 	}
-	if (!stun_check_integrity(buf, size, msg, password, agent->logger)) {
-		JLOG_WARN(agent->logger, "STUN integrity check failed, password=\"%s\"", password);
+	if (hkey ? !stun_check_integrity_hmac(buf, size, msg, hkey, agent->logger)
+	         : !stun_check_integrity(buf, size, msg, password, agent->logger)) {
+		JLOG_WARN_LIMITED(agent->logger, "STUN integrity check failed, password=\"%s\"", password);
 		return -1;
 	}
 	return 0;
@@ -1116,11 +1765,11 @@ int agent_verify_credentials(juice_agent_t *agent, const agent_stun_entry_t *ent
 		return 0;
 
 	if (!msg->has_integrity) {
-		JLOG_WARN(agent->logger, "Missing integrity in STUN message");
+		JLOG_WARN_LIMITED(agent->logger, "Missing integrity in STUN message");
 		return -1;
 	}
 	if (!entry->turn) {
-		JLOG_WARN(agent->logger, "No credentials for entry");
+		JLOG_WARN_LIMITED(agent->logger, "No credentials for entry");
 		return -1;
 	}
 	stun_credentials_t *credentials = &entry->turn->credentials;
@@ -1133,7 +1782,7 @@ int agent_verify_credentials(juice_agent_t *agent, const agent_stun_entry_t *ent
 
 	// Check credentials
 	if (!stun_check_integrity(buf, size, msg, password, agent->logger)) {
-		JLOG_WARN(agent->logger, "STUN integrity check failed");
+		JLOG_WARN_LIMITED(agent->logger, "STUN integrity check failed");
 		return -1;
 	}
 	return 0;
@@ -1145,14 +1794,15 @@ int agent_dispatch_stun(juice_agent_t *agent, void *buf, size_t size, stun_messa
 		JLOG_VERBOSE(agent->logger, "STUN message is from the remote peer");
 		// Verify the message now
 		if (agent_verify_stun_binding(agent, buf, size, msg)) {
-			JLOG_WARN(agent->logger, "STUN message verification failed");
+			JLOG_WARN_LIMITED(agent->logger, "STUN message verification failed");
 			return -1;
 		}
 		if (!relayed) {
 			if (agent_add_remote_reflexive_candidate(agent, ICE_CANDIDATE_TYPE_PEER_REFLEXIVE,
 			                                         msg->priority, src)) {
-				JLOG_WARN(agent->logger,
-				          "Failed to add remote peer reflexive candidate from STUN message");
+				JLOG_WARN_LIMITED(
+				    agent->logger,
+				    "Failed to add remote peer reflexive candidate from STUN message");
 			}
 		}
 	}
@@ -1160,25 +1810,20 @@ int agent_dispatch_stun(juice_agent_t *agent, void *buf, size_t size, stun_messa
 	agent_stun_entry_t *entry = NULL;
 	if (STUN_IS_RESPONSE(msg->msg_class)) {
 		JLOG_VERBOSE(agent->logger, "STUN message is a response, looking for transaction ID");
-		for (int i = 0; i < agent->entries_count; ++i) {
-			if (memcmp(msg->transaction_id, agent->entries[i].transaction_id,
-			           STUN_TRANSACTION_ID_SIZE) == 0) {
-				JLOG_VERBOSE(agent->logger, "STUN entry %d matching incoming transaction ID", i);
-				entry = &agent->entries[i];
-				break;
-			}
-			if (agent->entries[i].turn) {
-				if (turn_find_transaction_id(&agent->entries[i].turn->map, msg->transaction_id,
-				                             NULL)) {
-					entry = &agent->entries[i];
-					break;
-				}
-			}
-		}
+		entry = agent_find_entry_from_transaction_id(agent, msg->transaction_id);
 		if (!entry) {
-			JLOG_WARN(agent->logger, "No STUN entry matching transaction ID, ignoring");
+			JLOG_WARN_LIMITED(agent->logger, "No STUN entry matching transaction ID, ignoring");
 			return -1;
 		}
+
+		if (memcmp(msg->transaction_id, entry->transaction_id, STUN_TRANSACTION_ID_SIZE) == 0) {
+			// Karn's algorithm: only sample the RTT if the request was not retransmitted
+			if (entry->transmissions == 1)
+				agent_update_rtt(agent, entry,
+				                 current_timestamp_us() - entry->transmission_timestamp);
+
+			entry->transmissions = 0;
+		}
 	} else {
 		JLOG_VERBOSE(agent->logger,
 		             "STUN message is a request or indication, looking for remote address");
@@ -1198,8 +1843,9 @@ int agent_dispatch_stun(juice_agent_t *agent, void *buf, size_t size, stun_messa
 		// Message was verified earlier, no need to re-verify
 		if (entry->type == AGENT_STUN_ENTRY_TYPE_CHECK && !msg->has_integrity &&
 		    (msg->msg_class == STUN_CLASS_REQUEST || msg->msg_class == STUN_CLASS_RESP_SUCCESS)) {
-			JLOG_WARN(agent->logger,
-			          "Missing integrity in STUN Binding message from remote peer, ignoring");
+			JLOG_WARN_LIMITED(
+			    agent->logger,
+			    "Missing integrity in STUN Binding message from remote peer, ignoring");
 			return -1;
 		}
 		return agent_process_stun_binding(agent, msg, entry, src, relayed);
@@ -1207,21 +1853,21 @@ int agent_dispatch_stun(juice_agent_t *agent, void *buf, size_t size, stun_messa
 	case STUN_METHOD_ALLOCATE:
 	case STUN_METHOD_REFRESH:
 		if (agent_verify_credentials(agent, entry, buf, size, msg)) {
-			JLOG_WARN(agent->logger, "Ignoring invalid TURN Allocate message");
+			JLOG_WARN_LIMITED(agent->logger, "Ignoring invalid TURN Allocate message");
 			return -1;
 		}
 		return agent_process_turn_allocate(agent, msg, entry);
 
 	case STUN_METHOD_CREATE_PERMISSION:
 		if (agent_verify_credentials(agent, entry, buf, size, msg)) {
-			JLOG_WARN(agent->logger, "Ignoring invalid TURN CreatePermission message");
+			JLOG_WARN_LIMITED(agent->logger, "Ignoring invalid TURN CreatePermission message");
 			return -1;
 		}
 		return agent_process_turn_create_permission(agent, msg, entry);
 
 	case STUN_METHOD_CHANNEL_BIND:
 		if (agent_verify_credentials(agent, entry, buf, size, msg)) {
-			JLOG_WARN(agent->logger, "Ignoring invalid TURN ChannelBind message");
+			JLOG_WARN_LIMITED(agent->logger, "Ignoring invalid TURN ChannelBind message");
 			return -1;
 		}
 		return agent_process_turn_channel_bind(agent, msg, entry);
@@ -1230,7 +1876,7 @@ int agent_dispatch_stun(juice_agent_t *agent, void *buf, size_t size, stun_messa
 		return agent_process_turn_data(agent, msg, entry);
 
 	default:
-		JLOG_WARN(agent->logger, "Unknown STUN method 0x%X, ignoring", msg->msg_method);
+		JLOG_WARN_LIMITED(agent->logger, "Unknown STUN method 0x%X, ignoring", msg->msg_method);
 		return -1;
 	}
 }
@@ -1238,6 +1884,9 @@ int agent_dispatch_stun(juice_agent_t *agent, void *buf, size_t size, stun_messa
 int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
                                agent_stun_entry_t *entry, const addr_record_t *src,
                                const addr_record_t *relayed) {
+	if (msg->msg_class != STUN_CLASS_INDICATION)
+		agent->pairs_changed = true; // pair and entry states may change
+
 	switch (msg->msg_class) {
 	case STUN_CLASS_REQUEST: {
 		JLOG_DEBUG(agent->logger, "Received STUN Binding request");
@@ -1258,7 +1907,7 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 		//  * If the agent's tiebreaker value is less than the contents of the ICE-CONTROLLING
 		//  attribute, the agent switches to the controlled role.
 		if (agent->mode == AGENT_MODE_CONTROLLING && msg->ice_controlling) {
-			JLOG_WARN(agent->logger, "ICE role conflict (both controlling)");
+			JLOG_WARN_LIMITED(agent->logger, "ICE role conflict (both controlling)");
 			if (agent->ice_tiebreaker >= msg->ice_controlling) {
 				JLOG_DEBUG(agent->logger, "Asking remote peer to switch roles");
 				agent_send_stun_binding(agent, entry, STUN_CLASS_RESP_ERROR, 487,
@@ -1278,7 +1927,7 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 		//  attribute, the agent generates a Binding error response and includes an ERROR-CODE
 		//  attribute with a value of 487 (Role Conflict) but retains its role.
 		if (msg->ice_controlled && agent->mode == AGENT_MODE_CONTROLLED) {
-			JLOG_WARN(agent->logger, "ICE role conflict (both controlled)");
+			JLOG_WARN_LIMITED(agent->logger, "ICE role conflict (both controlled)");
 			if (agent->ice_tiebreaker >= msg->ice_controlling) {
 				JLOG_DEBUG(agent->logger, "Switching to controlling role");
 				agent->mode = AGENT_MODE_CONTROLLING;
@@ -1292,8 +1941,8 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 		}
 		if (msg->use_candidate) {
 			if (!msg->ice_controlling) {
-				JLOG_WARN(agent->logger,
-				          "STUN message use_candidate missing ice_controlling attribute");
+				JLOG_WARN_LIMITED(agent->logger,
+				                  "STUN message use_candidate missing ice_controlling attribute");
 				agent_send_stun_binding(agent, entry, STUN_CLASS_RESP_ERROR, 400,
 				                        msg->transaction_id, NULL);
 				return -1;
@@ -1304,17 +1953,25 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 			// the nominated flag value of the valid pair to true.
 			if (pair->state == ICE_CANDIDATE_PAIR_STATE_SUCCEEDED) {
 				JLOG_DEBUG(agent->logger, "Got a nominated pair (controlled)");
+				ice_candidate_pair_t *selected_pair = agent->selected_pair;
+				if (agent->config.timing.failover_timeout && selected_pair &&
+				    selected_pair != pair && selected_pair->nominated) {
+					// The controlling agent failed over to another pair
+					JLOG_INFO(agent->logger, "Remote peer failed over to another pair");
+					selected_pair->nominated = false;
+				}
 				pair->nominated = true;
 			} else if (!pair->nomination_requested) {
 				pair->nomination_requested = true;
 				pair->state = ICE_CANDIDATE_PAIR_STATE_PENDING;
 				entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
-				agent_arm_transmission(agent, entry, STUN_PACING_TIME); // transmit after response
+				// Transmit after response
+				agent_arm_transmission(agent, entry, agent->config.timing.pacing_time);
 			}
 		}
 		if (agent_send_stun_binding(agent, entry, STUN_CLASS_RESP_SUCCESS, 0, msg->transaction_id,
 		                            src)) {
-			JLOG_ERROR(agent->logger, "Failed to send STUN Binding response");
+			JLOG_ERROR_LIMITED(agent->logger, "Failed to send STUN Binding response");
 			return -1;
 		}
 		break;
@@ -1326,15 +1983,17 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 		if (entry->type == AGENT_STUN_ENTRY_TYPE_SERVER)
 			JLOG_INFO(agent->logger, "STUN server binding successful");
 
+		entry->response_timestamp = cached_timestamp();
+
 		if (entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE) {
 			entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED;
-			entry->next_transmission = 0;
+			agent_cancel_transmission(agent, entry);
 		}
 
 		if (!agent->selected_pair || !agent->selected_pair->nominated) {
 			// We want to send keepalives now
 			entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE;
-			agent_arm_transmission(agent, entry, STUN_KEEPALIVE_PERIOD);
+			agent_arm_transmission(agent, entry, agent_get_keepalive_period(agent, entry));
 		}
 
 		if (msg->mapped.len && !relayed) {
@@ -1362,7 +2021,7 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 			// RFC 8445 7.3.1.5. Updating the Nominated Flag:
 			// [...] once the check is sent and if it generates a successful response, and
 			// generates a valid pair, the agent sets the nominated flag of the pair to true.
-			if (pair->nomination_requested) {
+			if (pair->nomination_requested && !pair->nominated) {
 				JLOG_DEBUG(agent->logger, "Got a nominated pair (%s)",
 				           agent->mode == AGENT_MODE_CONTROLLING ? "controlling" : "controlled");
 				pair->nominated = true;
@@ -1374,8 +2033,8 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 	}
 	case STUN_CLASS_RESP_ERROR: {
 		if (msg->error_code != STUN_ERROR_INTERNAL_VALIDATION_FAILED)
-		JLOG_WARN(agent->logger, "Got STUN Binding error response, code=%u",
-		          (unsigned int)msg->error_code);
+		JLOG_WARN_LIMITED(agent->logger, "Got STUN Binding error response, code=%u",
+		                  (unsigned int)msg->error_code);
 
 		if (entry->type == AGENT_STUN_ENTRY_TYPE_CHECK && msg->error_code == 487) {
 			// RFC 8445 7.2.5.1. Role Conflict:
@@ -1387,7 +2046,7 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 			// the tiebreaker value.
 			if ((agent->mode == AGENT_MODE_CONTROLLING && msg->ice_controlling) ||
 			    (agent->mode == AGENT_MODE_CONTROLLED && msg->ice_controlled)) {
-				JLOG_WARN(agent->logger, "ICE role conflit");
+				JLOG_WARN_LIMITED(agent->logger, "ICE role conflict");
 				JLOG_DEBUG(agent->logger, "Switching roles to %s as requested",
 				           msg->ice_controlling ? "controlled" : "controlling");
 				agent->mode = msg->ice_controlling ? AGENT_MODE_CONTROLLED : AGENT_MODE_CONTROLLING;
@@ -1395,6 +2054,7 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 			}
 
 			juice_random(&agent->ice_tiebreaker, sizeof(agent->ice_tiebreaker), agent->logger);
+			agent_invalidate_cached_requests(agent);
 
 			entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
 			agent_arm_transmission(agent, entry, 0);
@@ -1411,15 +2071,15 @@ int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
 		break;
 	}
 	default: {
-		JLOG_WARN(agent->logger, "Got STUN unexpected binding message, class=%u",
-		          (unsigned int)msg->msg_class);
+		JLOG_WARN_LIMITED(agent->logger, "Got STUN unexpected binding message, class=%u",
+		                  (unsigned int)msg->msg_class);
 		return -1;
 	}
 	}
 	return 0;
 }
 
-int agent_send_stun_binding(juice_agent_t *agent, const agent_stun_entry_t *entry,
+int agent_send_stun_binding(juice_agent_t *agent, agent_stun_entry_t *entry,
                             stun_class_t msg_class, unsigned int error_code,
                             const uint8_t *transaction_id, const addr_record_t *mapped) {
 	// Send STUN Binding
@@ -1428,6 +2088,19 @@ int agent_send_stun_binding(juice_agent_t *agent, const agent_stun_entry_t *entr
 	               ? "request"
 	               : (msg_class == STUN_CLASS_INDICATION ? "indication" : "response"));
 
+	bool use_candidate = entry->type == AGENT_STUN_ENTRY_TYPE_CHECK &&
+	                     agent->mode == AGENT_MODE_CONTROLLING && entry->pair &&
+	                     entry->pair->nomination_requested;
+
+	// Retransmissions of a request are identical, there is no need to write it again
+	if (msg_class == STUN_CLASS_REQUEST && !transaction_id && entry->request_size > 0 &&
+	    entry->request_mode == agent->mode && entry->request_use_candidate == use_candidate &&
+	    memcmp(entry->request + offsetof(struct stun_header, transaction_id),
+	           entry->transaction_id, STUN_TRANSACTION_ID_SIZE) == 0) {
+		JLOG_VERBOSE(agent->logger, "Resending cached STUN Binding request");
+		return agent_send_stun_datagram(agent, entry, entry->request, entry->request_size);
+	}
+
 	stun_message_t msg;
 	memset(&msg, 0, sizeof(msg));
 	msg.msg_class = msg_class;
@@ -1441,6 +2114,7 @@ int agent_send_stun_binding(juice_agent_t *agent, const agent_stun_entry_t *entr
 		memcpy(msg.transaction_id, entry->transaction_id, STUN_TRANSACTION_ID_SIZE);
 
 	const char *password = NULL;
+	const hmac_key_t *hkey = NULL;
 	if (entry->type == AGENT_STUN_ENTRY_TYPE_CHECK) {
 		// RFC 8445 7.2.2. Forming Credentials:
 		// A connectivity-check Binding request MUST utilize the STUN short-term credential
@@ -1458,6 +2132,7 @@ int agent_send_stun_binding(juice_agent_t *agent, const agent_stun_entry_t *entr
 			snprintf(msg.credentials.username, STUN_MAX_USERNAME_LEN, "%s:%s",
 			         agent->remote.ice_ufrag, agent->local.ice_ufrag);
 			password = agent->remote.ice_pwd;
+			hkey = agent->remote_hmac_key;
 			msg.ice_controlling = agent->mode == AGENT_MODE_CONTROLLING ? agent->ice_tiebreaker : 0;
 			msg.ice_controlled = agent->mode == AGENT_MODE_CONTROLLED ? agent->ice_tiebreaker : 0;
 
@@ -1472,13 +2147,13 @@ int agent_send_stun_binding(juice_agent_t *agent, const agent_stun_entry_t *entr
 			// Once the controlling agent has picked a valid pair for nomination, it repeats the
 			// connectivity check that produced this valid pair [...], this time with the
 			// USE-CANDIDATE attribute.
-			msg.use_candidate = agent->mode == AGENT_MODE_CONTROLLING && entry->pair &&
-			                    entry->pair->nomination_requested;
+			msg.use_candidate = use_candidate;
 			break;
 		}
 		case STUN_CLASS_RESP_SUCCESS:
 		case STUN_CLASS_RESP_ERROR: {
 			password = agent->local.ice_pwd;
+			hkey = agent->local_hmac_key;
 			msg.error_code = error_code;
 			if (mapped)
 				msg.mapped = *mapped;
@@ -1495,21 +2170,38 @@ int agent_send_stun_binding(juice_agent_t *agent, const agent_stun_entry_t *entr
 	}
 
 	char buffer[BUFFER_SIZE];
-	int size = stun_write(buffer, BUFFER_SIZE, &msg, password, agent->logger);
+	int size = hkey ? stun_write_hmac(buffer, BUFFER_SIZE, &msg, hkey, agent->logger)
+	                : stun_write(buffer, BUFFER_SIZE, &msg, password, agent->logger);
 	if (size <= 0) {
-		JLOG_ERROR(agent->logger, "STUN message write failed");
+		JLOG_ERROR_LIMITED(agent->logger, "STUN message write failed");
 		return -1;
 	}
 
+	if (msg_class == STUN_CLASS_REQUEST && !transaction_id) {
+		if (size <= AGENT_REQUEST_CACHE_SIZE) {
+			memcpy(entry->request, buffer, size);
+			entry->request_size = size;
+			entry->request_mode = agent->mode;
+			entry->request_use_candidate = use_candidate;
+		} else {
+			entry->request_size = 0;
+		}
+	}
+
+	return agent_send_stun_datagram(agent, entry, buffer, size);
+}
+
+int agent_send_stun_datagram(juice_agent_t *agent, const agent_stun_entry_t *entry,
+                             const char *data, size_t size) {
 	if (entry->relay_entry) {
 		// The datagram must be sent through the relay
 		JLOG_DEBUG(agent->logger, "Sending STUN message via relay");
-		return agent_relay_send(agent, entry->relay_entry, &entry->record, buffer, size, 0);
+		return agent_relay_send(agent, entry->relay_entry, &entry->record, data, size, 0);
 	}
 
 	// Direct send
-	if (agent_direct_send(agent, &entry->record, buffer, size, 0) < 0) {
-		JLOG_WARN(agent->logger, "STUN message send failed, errno=%d", sockerrno);
+	if (agent_direct_send(agent, &entry->record, data, size, 0) < 0) {
+		JLOG_WARN_LIMITED(agent->logger, "STUN message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 	return 0;
@@ -1521,8 +2213,8 @@ int agent_process_turn_allocate(juice_agent_t *agent, const stun_message_t *msg,
 		return -1;
 
 	if (entry->type != AGENT_STUN_ENTRY_TYPE_RELAY) {
-		JLOG_WARN(agent->logger, "Received TURN %s message for a non-relay entry, ignoring",
-		          msg->msg_method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh");
+		JLOG_WARN_LIMITED(agent->logger, "Received TURN %s message for a non-relay entry, ignoring",
+		                  msg->msg_method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh");
 		return -1;
 	}
 	if (!entry->turn) {
@@ -1530,6 +2222,8 @@ int agent_process_turn_allocate(juice_agent_t *agent, const stun_message_t *msg,
 		return -1;
 	}
 
+	agent->pairs_changed = true; // the relay entry state may change
+
 	switch (msg->msg_class) {
 	case STUN_CLASS_RESP_SUCCESS: {
 		JLOG_DEBUG(agent->logger, "Received TURN %s success response",
@@ -1539,7 +2233,7 @@ int agent_process_turn_allocate(juice_agent_t *agent, const stun_message_t *msg,
 			JLOG_DEBUG(agent->logger, "TURN refresh successful");
 			// There is nothing to do other than rearm
 			if (entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE) {
-				juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
+				agent_renew_transaction_id(agent, entry);
 				agent_arm_transmission(agent, entry, TURN_REFRESH_PERIOD);
 			}
 			break;
@@ -1548,13 +2242,13 @@ int agent_process_turn_allocate(juice_agent_t *agent, const stun_message_t *msg,
 		JLOG_INFO(agent->logger, "TURN allocation successful");
 		if (entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE) {
 			entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED;
-			entry->next_transmission = 0;
+			agent_cancel_transmission(agent, entry);
 		}
 
 		if (!agent->selected_pair || !agent->selected_pair->nominated) {
 			// We want to send refresh requests now
 			entry->state = AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE;
-			juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
+			agent_renew_transaction_id(agent, entry);
 			agent_arm_transmission(agent, entry, TURN_REFRESH_PERIOD);
 		}
 
@@ -1620,9 +2314,9 @@ int agent_process_turn_allocate(juice_agent_t *agent, const stun_message_t *msg,
 
 		} else {
 			if (msg->error_code != STUN_ERROR_INTERNAL_VALIDATION_FAILED)
-			JLOG_WARN(agent->logger, "Got TURN %s error response, code=%u",
-			          msg->msg_method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh",
-			          (unsigned int)msg->error_code);
+			JLOG_WARN_LIMITED(agent->logger, "Got TURN %s error response, code=%u",
+			                  msg->msg_method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh",
+			                  (unsigned int)msg->error_code);
 
 			JLOG_INFO(agent->logger, "TURN allocation failed");
 			entry->state = AGENT_STUN_ENTRY_STATE_FAILED;
@@ -1631,9 +2325,9 @@ int agent_process_turn_allocate(juice_agent_t *agent, const stun_message_t *msg,
 		break;
 	}
 	default: {
-		JLOG_WARN(agent->logger, "Got unexpected TURN %s message, class=%u",
-		          msg->msg_method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh",
-		          (unsigned int)msg->msg_class);
+		JLOG_WARN_LIMITED(agent->logger, "Got unexpected TURN %s message, class=%u",
+		                  msg->msg_method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh",
+		                  (unsigned int)msg->msg_class);
 		return -1;
 	}
 	}
@@ -1674,11 +2368,11 @@ int agent_send_turn_allocate_request(juice_agent_t *agent, const agent_stun_entr
 	char buffer[BUFFER_SIZE];
 	int size = stun_write(buffer, BUFFER_SIZE, &msg, password, agent->logger);
 	if (size <= 0) {
-		JLOG_ERROR(agent->logger, "STUN message write failed");
+		JLOG_ERROR_LIMITED(agent->logger, "STUN message write failed");
 		return -1;
 	}
 	if (agent_direct_send(agent, &entry->record, buffer, size, 0) < 0) {
-		JLOG_WARN(agent->logger, "STUN message send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(agent->logger, "STUN message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 	return 0;
@@ -1688,8 +2382,8 @@ int agent_process_turn_create_permission(juice_agent_t *agent, const stun_messag
                                          agent_stun_entry_t *entry) {
 	(void)(agent);
 	if (entry->type != AGENT_STUN_ENTRY_TYPE_RELAY) {
-		JLOG_WARN(agent->logger,
-		          "Received TURN CreatePermission message for a non-relay entry, ignoring");
+		JLOG_WARN_LIMITED(agent->logger,
+		                  "Received TURN CreatePermission message for a non-relay entry, ignoring");
 		return -1;
 	}
 	if (!entry->turn) {
@@ -1708,13 +2402,13 @@ int agent_process_turn_create_permission(juice_agent_t *agent, const stun_messag
 	}
 	case STUN_CLASS_RESP_ERROR: {
 		if (msg->error_code != STUN_ERROR_INTERNAL_VALIDATION_FAILED)
-		JLOG_WARN(agent->logger, "Got TURN CreatePermission error response, code=%u",
-		          (unsigned int)msg->error_code);
+		JLOG_WARN_LIMITED(agent->logger, "Got TURN CreatePermission error response, code=%u",
+		                  (unsigned int)msg->error_code);
 		break;
 	}
 	default: {
-		JLOG_WARN(agent->logger, "Got unexpected TURN CreatePermission message, class=%u",
-		          (unsigned int)msg->msg_class);
+		JLOG_WARN_LIMITED(agent->logger, "Got unexpected TURN CreatePermission message, class=%u",
+		                  (unsigned int)msg->msg_class);
 		return -1;
 	}
 	}
@@ -1753,11 +2447,11 @@ int agent_send_turn_create_permission_request(juice_agent_t *agent, agent_stun_e
 	char buffer[BUFFER_SIZE];
 	int size = stun_write(buffer, BUFFER_SIZE, &msg, entry->turn->password, agent->logger);
 	if (size <= 0) {
-		JLOG_ERROR(agent->logger, "STUN message write failed");
+		JLOG_ERROR_LIMITED(agent->logger, "STUN message write failed");
 		return -1;
 	}
 	if (agent_direct_send(agent, &entry->record, buffer, size, ds) < 0) {
-		JLOG_WARN(agent->logger, "STUN message send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(agent->logger, "STUN message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 	return 0;
@@ -1767,8 +2461,8 @@ int agent_process_turn_channel_bind(juice_agent_t *agent, const stun_message_t *
                                     agent_stun_entry_t *entry) {
 	(void)agent;
 	if (entry->type != AGENT_STUN_ENTRY_TYPE_RELAY) {
-		JLOG_WARN(agent->logger,
-		          "Received TURN ChannelBind message for a non-relay entry, ignoring");
+		JLOG_WARN_LIMITED(agent->logger,
+		                  "Received TURN ChannelBind message for a non-relay entry, ignoring");
 		return -1;
 	}
 	if (!entry->turn) {
@@ -1779,21 +2473,53 @@ int agent_process_turn_channel_bind(juice_agent_t *agent, const stun_message_t *
 	switch (msg->msg_class) {
 	case STUN_CLASS_RESP_SUCCESS: {
 		JLOG_DEBUG(agent->logger, "Received TURN ChannelBind success response");
-		if (!turn_bind_current_channel(&entry->turn->map, msg->transaction_id, NULL,
-		                               BIND_LIFETIME / 2, agent->logger))
+		addr_record_t record;
+		uint16_t channel;
+		if (!turn_find_transaction_id(&entry->turn->map, msg->transaction_id, &record) ||
+		    !turn_bind_current_channel(&entry->turn->map, msg->transaction_id, NULL,
+		                               BIND_LIFETIME / 2, agent->logger) ||
+		    !turn_get_bound_channel(&entry->turn->map, &record, &channel, agent->logger)) {
 			JLOG_WARN(agent->logger,
 			          "Transaction ID from TURN ChannelBind response does not match");
+			break;
+		}
+
+		// Publish the channel to the entries sending through it
+		timestamp_t now = cached_timestamp();
+		for (int i = 0; i < agent->entries_count; ++i) {
+			agent_stun_entry_t *check_entry = agent->entries[i];
+			if (check_entry->relay_entry == entry &&
+			    addr_record_is_equal(&check_entry->record, &record, true)) {
+				check_entry->binding_refresh_timestamp = now + BINDING_REFRESH_PERIOD;
+				check_entry->channel_expiry = now + BIND_LIFETIME;
+				check_entry->binding_attempts = 0;
+				agent_set_channel(check_entry, channel);
+			}
+		}
 		break;
 	}
 	case STUN_CLASS_RESP_ERROR: {
+		if (msg->error_code == 438 && *msg->credentials.realm != '\0' &&
+		    *msg->credentials.nonce != '\0') { // Stale Nonce
+			JLOG_DEBUG(agent->logger, "Got TURN ChannelBind Stale Nonce response");
+			stun_process_credentials(&msg->credentials, &entry->turn->credentials);
+
+			// Retry pending bindings now with the new nonce
+			for (int i = 0; i < agent->entries_count; ++i) {
+				agent_stun_entry_t *check_entry = agent->entries[i];
+				if (check_entry->relay_entry == entry && check_entry->binding_attempts > 0)
+					check_entry->binding_refresh_timestamp = 0;
+			}
+			break;
+		}
 		if (msg->error_code != STUN_ERROR_INTERNAL_VALIDATION_FAILED)
-		JLOG_WARN(agent->logger, "Got TURN ChannelBind error response, code=%u",
-		          (unsigned int)msg->error_code);
+		JLOG_WARN_LIMITED(agent->logger, "Got TURN ChannelBind error response, code=%u",
+		                  (unsigned int)msg->error_code);
 		break;
 	}
 	default: {
-		JLOG_WARN(agent->logger, "Got STUN unexpected ChannelBind message, class=%u",
-		          (unsigned int)msg->msg_class);
+		JLOG_WARN_LIMITED(agent->logger, "Got STUN unexpected ChannelBind message, class=%u",
+		                  (unsigned int)msg->msg_class);
 		return -1;
 	}
 	}
@@ -1844,11 +2570,11 @@ int agent_send_turn_channel_bind_request(juice_agent_t *agent, agent_stun_entry_
 	char buffer[BUFFER_SIZE];
 	int size = stun_write(buffer, BUFFER_SIZE, &msg, password, agent->logger);
 	if (size <= 0) {
-		JLOG_ERROR(agent->logger, "STUN message write failed");
+		JLOG_ERROR_LIMITED(agent->logger, "STUN message write failed");
 		return -1;
 	}
 	if (agent_direct_send(agent, &entry->record, buffer, size, ds) < 0) {
-		JLOG_WARN(agent->logger, "STUN message send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(agent->logger, "STUN message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 	return 0;
@@ -1857,21 +2583,22 @@ int agent_send_turn_channel_bind_request(juice_agent_t *agent, agent_stun_entry_
 int agent_process_turn_data(juice_agent_t *agent, const stun_message_t *msg,
                             agent_stun_entry_t *entry) {
 	if (entry->type != AGENT_STUN_ENTRY_TYPE_RELAY) {
-		JLOG_WARN(agent->logger, "Received TURN Data message for a non-relay entry, ignoring");
+		JLOG_WARN_LIMITED(
+		    agent->logger, "Received TURN Data message for a non-relay entry, ignoring");
 		return -1;
 	}
 	if (msg->msg_class != STUN_CLASS_INDICATION) {
-		JLOG_WARN(agent->logger, "Received non-indication TURN Data message, ignoring");
+		JLOG_WARN_LIMITED(agent->logger, "Received non-indication TURN Data message, ignoring");
 		return -1;
 	}
 
 	JLOG_DEBUG(agent->logger, "Received TURN Data indication");
 	if (!msg->data) {
-		JLOG_WARN(agent->logger, "Missing data in TURN Data indication");
+		JLOG_WARN_LIMITED(agent->logger, "Missing data in TURN Data indication");
 		return -1;
 	}
 	if (!msg->peer.len) {
-		JLOG_WARN(agent->logger, "Missing peer address in TURN Data indication");
+		JLOG_WARN_LIMITED(agent->logger, "Missing peer address in TURN Data indication");
 		return -1;
 	}
 	return agent_input(agent, (char *)msg->data, msg->data_size, &msg->peer, &entry->relayed);
@@ -1880,7 +2607,7 @@ int agent_process_turn_data(juice_agent_t *agent, const stun_message_t *msg,
 int agent_process_channel_data(juice_agent_t *agent, agent_stun_entry_t *entry, char *buf,
                                size_t len) {
 	if (len < sizeof(struct channel_data_header)) {
-		JLOG_WARN(agent->logger, "ChannelData is too short");
+		JLOG_WARN_LIMITED(agent->logger, "ChannelData is too short");
 		return -1;
 	}
 
@@ -1891,13 +2618,13 @@ int agent_process_channel_data(juice_agent_t *agent, agent_stun_entry_t *entry,
 	uint16_t length = ntohs(header->length);
 	JLOG_VERBOSE(agent->logger, "Received ChannelData, channel=0x%hX, length=%hu", channel, length);
 	if (length > len) {
-		JLOG_WARN(agent->logger, "ChannelData has invalid length");
+		JLOG_WARN_LIMITED(agent->logger, "ChannelData has invalid length");
 		return -1;
 	}
 
 	addr_record_t src;
 	if (!turn_find_channel(&entry->turn->map, channel, &src, agent->logger)) {
-		JLOG_WARN(agent->logger, "Channel not found");
+		JLOG_WARN_LIMITED(agent->logger, "Channel not found");
 		return -1;
 	}
 
@@ -1928,9 +2655,9 @@ int agent_add_local_relayed_candidate(juice_agent_t *agent, const addr_record_t
 	JLOG_DEBUG(agent->logger, "Gathered relayed candidate: %s", buffer);
 
 	// Relayed candidates must be differenciated, so match them with already known remote candidates
-	ice_candidate_t *local = agent->local.candidates + agent->local.candidates_count - 1;
+	ice_candidate_t *local = agent->local.candidates[agent->local.candidates_count - 1];
 	for (int i = 0; i < agent->remote.candidates_count; ++i) {
-		ice_candidate_t *remote = agent->remote.candidates + i;
+		ice_candidate_t *remote = agent->remote.candidates[i];
 		if (local->resolved.addr.ss_family == remote->resolved.addr.ss_family)
 			agent_add_candidate_pair(agent, local, remote);
 	}
@@ -2016,7 +2743,7 @@ int agent_add_remote_reflexive_candidate(juice_agent_t *agent, ice_candidate_typ
 	JLOG_DEBUG(agent->logger, "Obtained a new remote reflexive candidate, priority=%lu",
 	           (unsigned long)priority);
 
-	ice_candidate_t *remote = agent->remote.candidates + agent->remote.candidates_count - 1;
+	ice_candidate_t *remote = agent->remote.candidates[agent->remote.candidates_count - 1];
 	remote->priority = priority;
 
 	return agent_add_candidate_pairs_for_remote(agent, remote);
@@ -2024,6 +2751,11 @@ int agent_add_remote_reflexive_candidate(juice_agent_t *agent, ice_candidate_typ
 
 int agent_add_candidate_pair(juice_agent_t *agent, ice_candidate_t *local, // local may be NULL
                              ice_candidate_t *remote) {
+	if (agent->candidate_pairs_count >= MAX_CANDIDATE_PAIRS_COUNT) {
+		JLOG_WARN(agent->logger, "Maximum number of candidate pairs reached");
+		return -1;
+	}
+
 	ice_candidate_pair_t pair;
 	bool is_controlling = agent->mode == AGENT_MODE_CONTROLLING;
 	if (ice_create_candidate_pair(local, remote, is_controlling, &pair, agent->logger)) {
@@ -2031,29 +2763,43 @@ int agent_add_candidate_pair(juice_agent_t *agent, ice_candidate_t *local, // lo
 		return -1;
 	}
 
-	if (agent->candidate_pairs_count >= MAX_CANDIDATE_PAIRS_COUNT) {
-		JLOG_WARN(agent->logger, "Session already has the maximum number of candidate pairs");
+	if (agent->candidate_pairs_count == agent->candidate_pairs_capacity) {
+		int capacity = agent->candidate_pairs_capacity ? agent->candidate_pairs_capacity * 2
+		                                               : AGENT_INITIAL_CAPACITY;
+		ice_candidate_pair_t **candidate_pairs =
+		    realloc(agent->candidate_pairs, capacity * sizeof(ice_candidate_pair_t *));
+		if (candidate_pairs)
+			agent->candidate_pairs = candidate_pairs;
+		ice_candidate_pair_t **ordered_pairs =
+		    realloc(agent->ordered_pairs, capacity * sizeof(ice_candidate_pair_t *));
+		if (ordered_pairs)
+			agent->ordered_pairs = ordered_pairs;
+		if (!candidate_pairs || !ordered_pairs) {
+			JLOG_ERROR(agent->logger, "realloc for candidate pairs failed");
+			return -1;
+		}
+		agent->candidate_pairs_capacity = capacity;
+	}
+
+	ice_candidate_pair_t *pos = arena_alloc(&agent->arena, sizeof(ice_candidate_pair_t));
+	if (!pos) {
+		JLOG_ERROR(agent->logger, "alloc for candidate pair failed");
 		return -1;
 	}
 
 	JLOG_VERBOSE(agent->logger, "Adding new candidate pair, priority=%" PRIu64, pair.priority);
 
 	// Add pair
-	ice_candidate_pair_t *pos = agent->candidate_pairs + agent->candidate_pairs_count;
 	*pos = pair;
+	agent->candidate_pairs[agent->candidate_pairs_count] = pos;
 	++agent->candidate_pairs_count;
 
 	agent_update_ordered_pairs(agent);
 
-	if (agent->entries_count == MAX_STUN_ENTRIES_COUNT) {
-		JLOG_WARN(agent->logger, "No free STUN entry left for candidate pair checking");
-		return -1;
-	}
-
 	agent_stun_entry_t *relay_entry = NULL;
 	if (local && local->type == ICE_CANDIDATE_TYPE_RELAYED) {
 		for (int i = 0; i < agent->entries_count; ++i) {
-			agent_stun_entry_t *other_entry = agent->entries + i;
+			agent_stun_entry_t *other_entry = agent->entries[i];
 			if (other_entry->type == AGENT_STUN_ENTRY_TYPE_RELAY &&
 			    addr_record_is_equal(&other_entry->relayed, &local->resolved, true)) {
 				relay_entry = other_entry;
@@ -2068,18 +2814,24 @@ int agent_add_candidate_pair(juice_agent_t *agent, ice_candidate_t *local, // lo
 
 	JLOG_VERBOSE(agent->logger, "Registering STUN entry %d for candidate pair checking",
 	             agent->entries_count);
-	agent_stun_entry_t *entry = agent->entries + agent->entries_count;
+	agent_stun_entry_t *entry = arena_alloc(&agent->arena, sizeof(agent_stun_entry_t));
+	if (!entry) {
+		JLOG_ERROR(agent->logger, "alloc for STUN entry failed");
+		return -1;
+	}
 	entry->type = AGENT_STUN_ENTRY_TYPE_CHECK;
 	entry->state = AGENT_STUN_ENTRY_STATE_IDLE;
 	entry->pair = pos;
 	entry->record = pos->remote->resolved;
 	entry->relay_entry = relay_entry;
 	juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
-	++agent->entries_count;
 
 	if (remote->type == ICE_CANDIDATE_TYPE_HOST)
 		agent_translate_host_candidate_entry(agent, entry);
 
+	if (agent_add_entry(agent, entry) < 0)
+		return -1;
+
 	if (agent->mode == AGENT_MODE_CONTROLLING) {
 		for (int i = 0; i < agent->candidate_pairs_count; ++i) {
 			ice_candidate_pair_t *ordered_pair = agent->ordered_pairs[i];
@@ -2106,6 +2858,10 @@ int agent_add_candidate_pair(juice_agent_t *agent, ice_candidate_t *local, // lo
 }
 
 int agent_add_candidate_pairs_for_remote(juice_agent_t *agent, ice_candidate_t *remote) {
+	// Pairs left from before an ICE restart are reused
+	if (agent_rebind_candidate_pairs(agent, remote) > 0)
+		return 0;
+
 	// Here is the trick: local non-relayed candidates are undifferentiated for sending.
 	// Therefore, we don't need to match remote candidates with local ones.
 	if (agent_add_candidate_pair(agent, NULL, remote))
@@ -2113,7 +2869,7 @@ int agent_add_candidate_pairs_for_remote(juice_agent_t *agent, ice_candidate_t *
 
 	// However, we need still to differenciate local relayed candidates
 	for (int i = 0; i < agent->local.candidates_count; ++i) {
-		ice_candidate_t *local = agent->local.candidates + i;
+		ice_candidate_t *local = agent->local.candidates[i];
 		if (local->type == ICE_CANDIDATE_TYPE_RELAYED &&
 		    local->resolved.addr.ss_family == remote->resolved.addr.ss_family)
 			if (agent_add_candidate_pair(agent, local, remote))
@@ -2123,16 +2879,86 @@ int agent_add_candidate_pairs_for_remote(juice_agent_t *agent, ice_candidate_t *
 	return 0;
 }
 
+int agent_rebind_candidate_pairs(juice_agent_t *agent, ice_candidate_t *remote) {
+	bool is_controlling = agent->mode == AGENT_MODE_CONTROLLING;
+	int count = 0;
+	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
+		ice_candidate_pair_t *pair = agent->candidate_pairs[i];
+		if (!pair->remote || pair->remote == remote ||
+		    !addr_record_is_equal(&pair->remote->resolved, &remote->resolved, true))
+			continue;
+
+		JLOG_VERBOSE(agent->logger, "Rebinding existing candidate pair to remote candidate");
+		pair->remote = remote;
+		ice_update_candidate_pair(pair, is_controlling);
+		++count;
+	}
+	if (count == 0)
+		return 0;
+
+	agent_update_ordered_pairs(agent);
+
+	if (*agent->remote.ice_ufrag != '\0')
+		for (int i = 0; i < agent->candidate_pairs_count; ++i)
+			if (agent->candidate_pairs[i]->remote == remote)
+				agent_unfreeze_candidate_pair(agent, agent->candidate_pairs[i]);
+
+	return count;
+}
+
+void agent_restart_checks(juice_agent_t *agent) {
+	// The selected entry keeps carrying data until a new pair is selected
+	agent->selected_pair = NULL;
+	agent->nomination_timestamp = 0;
+	agent->fail_timestamp = 0;
+	agent->pairs_changed = true;
+
+	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
+		ice_candidate_pair_t *pair = agent->candidate_pairs[i];
+		pair->state = ICE_CANDIDATE_PAIR_STATE_FROZEN;
+		pair->nominated = false;
+		pair->nomination_requested = false;
+	}
+	for (int i = 0; i < agent->entries_count; ++i) {
+		agent_stun_entry_t *entry = agent->entries[i];
+		if (entry->type == AGENT_STUN_ENTRY_TYPE_CHECK &&
+		    entry->state != AGENT_STUN_ENTRY_STATE_IDLE) {
+			entry->state = AGENT_STUN_ENTRY_STATE_CANCELLED;
+			agent_cancel_transmission(agent, entry);
+		}
+	}
+
+#ifdef NO_ATOMICS
+	agent_stun_entry_t *selected_entry = agent->selected_entry;
+#else
+	agent_stun_entry_t *selected_entry = atomic_load(&agent->selected_entry);
+#endif
+	if (agent->state == JUICE_STATE_COMPLETED)
+		agent_change_state(agent, JUICE_STATE_CONNECTED);
+	else if (agent->state == JUICE_STATE_FAILED)
+		agent_change_state(agent,
+		                   selected_entry ? JUICE_STATE_CONNECTED : JUICE_STATE_CONNECTING);
+}
+
+void agent_update_hmac_keys(juice_agent_t *agent) {
+	hmac_key_destroy(agent->local_hmac_key);
+	agent->local_hmac_key = create_short_term_hmac_key(agent->local.ice_pwd, agent->logger);
+
+	hmac_key_destroy(agent->remote_hmac_key);
+	agent->remote_hmac_key = create_short_term_hmac_key(agent->remote.ice_pwd, agent->logger);
+}
+
 int agent_unfreeze_candidate_pair(juice_agent_t *agent, ice_candidate_pair_t *pair) {
 	if (pair->state != ICE_CANDIDATE_PAIR_STATE_FROZEN)
 		return 0;
 
 	for (int i = 0; i < agent->entries_count; ++i) {
-		agent_stun_entry_t *entry = agent->entries + i;
+		agent_stun_entry_t *entry = agent->entries[i];
 		if (entry->pair == pair) {
 			pair->state = ICE_CANDIDATE_PAIR_STATE_PENDING;
 			entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
 			agent_arm_transmission(agent, entry, 0); // transmit now
+			agent->pairs_changed = true;
 			return 0;
 		}
 	}
@@ -2151,37 +2977,273 @@ void agent_arm_transmission(juice_agent_t *agent, agent_stun_entry_t *entry, tim
 	if (entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE)
 		entry->state = AGENT_STUN_ENTRY_STATE_PENDING;
 
-	// Arm transmission
-	entry->next_transmission = current_timestamp() + delay;
-
 	if (entry->state == AGENT_STUN_ENTRY_STATE_PENDING) {
 		bool limit = agent->selected_pair &&
 		             (agent->selected_pair->nominated || (agent->selected_pair != entry->pair &&
 		                                                  agent->mode == AGENT_MODE_CONTROLLING));
-		entry->retransmissions = limit ? 1 : MAX_STUN_RETRANSMISSION_COUNT;
-		entry->retransmission_timeout = MIN_STUN_RETRANSMISSION_TIMEOUT;
-	}
-
-	// Find a time slot
-	agent_stun_entry_t *other = agent->entries;
-	while (other != agent->entries + agent->entries_count) {
-		if (other != entry) {
-			timestamp_t other_transmission = other->next_transmission;
-			timediff_t timediff = entry->next_transmission - other_transmission;
-			if (other_transmission && abs((int)timediff) < STUN_PACING_TIME) {
-				entry->next_transmission = other_transmission + STUN_PACING_TIME;
-				other = agent->entries;
-				continue;
-			}
-		}
-		++other;
+		entry->retransmissions = limit ? 1 : agent->config.timing.max_retransmissions;
+		entry->retransmission_timeout = agent_get_retransmission_timeout(agent);
+		entry->transmissions = 0;
+	}
+
+	// Arm transmission, pacing is enforced when the schedule is processed
+	agent_schedule_transmission(agent, entry, cached_timestamp() + delay);
+}
+
+bool agent_is_pair_within_tolerance(juice_agent_t *agent, const ice_candidate_pair_t *pair,
+                                    const ice_candidate_pair_t *best) {
+	// The type preference of the lowest-priority candidate is in the 8 most significant bits of
+	// the pair priority
+	unsigned int preference = (unsigned int)(pair->priority >> 56);
+	unsigned int best_preference = (unsigned int)(best->priority >> 56);
+	return preference + agent->config.nomination_rtt_tolerance >= best_preference;
+}
+
+void agent_update_rtt(juice_agent_t *agent, agent_stun_entry_t *entry, timediff_t rtt) {
+	if (rtt < 0)
+		return;
+	if (rtt == 0)
+		rtt = 1; // 0 means not measured
+
+	ice_candidate_pair_t *pair = entry->pair;
+	if (pair) {
+		pair->rtt = pair->rtt ? (7 * pair->rtt + rtt + 4) / 8 : rtt;
+		if (!pair->min_rtt || rtt < pair->min_rtt)
+			pair->min_rtt = rtt;
+		pair->rtt_sum += rtt;
+		++pair->rtt_count;
+	}
+
+	// RFC 6298 2.2. When the first RTT measurement R is made, the host MUST set
+	// SRTT <- R, RTTVAR <- R/2
+	// 2.3. When a subsequent RTT measurement R' is made, a host MUST set
+	// RTTVAR <- (1 - beta) * RTTVAR + beta * |SRTT - R'|
+	// SRTT <- (1 - alpha) * SRTT + alpha * R'
+	// with alpha=1/8 and beta=1/4
+	if (!agent->has_rtt) {
+		agent->srtt = rtt;
+		agent->rttvar = rtt / 2;
+		agent->has_rtt = true;
+	} else {
+		timediff_t delta = agent->srtt > rtt ? agent->srtt - rtt : rtt - agent->srtt;
+		agent->rttvar = (3 * agent->rttvar + delta + 2) / 4;
+		agent->srtt = (7 * agent->srtt + rtt + 4) / 8;
+	}
+
+	JLOG_VERBOSE(agent->logger, "STUN entry %d: RTT sample %ld us, SRTT=%ld us, RTTVAR=%ld us",
+	             entry->index, (long)rtt, (long)agent->srtt, (long)agent->rttvar);
+}
+
+void agent_update_failover(juice_agent_t *agent, timestamp_t now) {
+	ice_candidate_pair_t *selected_pair = agent->selected_pair;
+	if (!selected_pair || !selected_pair->nominated)
+		return;
+
+#ifdef NO_ATOMICS
+	agent_stun_entry_t *selected_entry = agent->selected_entry;
+#else
+	agent_stun_entry_t *selected_entry = atomic_load(&agent->selected_entry);
+#endif
+	if (!selected_entry || selected_entry->pair != selected_pair ||
+	    now - selected_entry->response_timestamp <= agent->config.timing.failover_timeout)
+		return;
+
+	// Consent on the selected pair is lost, look for the highest-priority backup still alive
+	agent_stun_entry_t *backup_entry = NULL;
+	for (int i = 0; i < agent->entries_count; ++i) {
+		agent_stun_entry_t *entry = agent->entries[i];
+		if (entry->type == AGENT_STUN_ENTRY_TYPE_CHECK && entry->pair &&
+		    entry->pair != selected_pair &&
+		    entry->pair->state == ICE_CANDIDATE_PAIR_STATE_SUCCEEDED &&
+		    entry->state == AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE &&
+		    now - entry->response_timestamp <= FAILOVER_BACKUP_TIMEOUT &&
+		    (!backup_entry || entry->pair->priority > backup_entry->pair->priority))
+			backup_entry = entry;
+	}
+	if (!backup_entry) {
+		JLOG_VERBOSE(agent->logger, "Selected pair lost consent, no backup pair available");
+		return;
+	}
+
+	JLOG_INFO(agent->logger, "Selected pair lost consent, failing over to backup pair");
+	selected_pair->nominated = false;
+	selected_pair->nomination_requested = false;
+	selected_pair->state = ICE_CANDIDATE_PAIR_STATE_FAILED;
+	selected_entry->state = AGENT_STUN_ENTRY_STATE_FAILED;
+	agent_cancel_transmission(agent, selected_entry);
+
+	// The backup pair is nominated locally, the controlling agent also nominates it on the peer
+	// with the next check
+	ice_candidate_pair_t *backup_pair = backup_entry->pair;
+	backup_pair->nominated = true;
+	if (agent->mode == AGENT_MODE_CONTROLLING)
+		backup_pair->nomination_requested = true;
+
+	agent->selected_pair = backup_pair;
+	backup_entry->response_timestamp = now; // consent starts with the selection
+#ifdef NO_ATOMICS
+	agent->selected_entry = backup_entry;
+#else
+	atomic_store(&agent->selected_entry, backup_entry);
+#endif
+	agent_arm_transmission(agent, backup_entry, 0); // check now
+	agent->pairs_changed = true;
+}
+
+void agent_refresh_turn_binding(juice_agent_t *agent, agent_stun_entry_t *entry, timestamp_t now,
+                                timestamp_t *next_timestamp) {
+	agent_stun_entry_t *relay_entry = entry->relay_entry;
+	if (!relay_entry->turn || (relay_entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED &&
+	                           relay_entry->state != AGENT_STUN_ENTRY_STATE_SUCCEEDED_KEEPALIVE))
+		return;
+
+	if (entry->channel_expiry && now >= entry->channel_expiry) {
+		JLOG_DEBUG(agent->logger, "TURN channel binding expired");
+		entry->channel_expiry = 0;
+		agent_set_channel(entry, 0);
+	}
+
+	if (now >= entry->binding_refresh_timestamp) {
+		JLOG_DEBUG(agent->logger, "Refreshing TURN channel binding");
+		// The server refreshes the permission on ChannelBind, but it is tracked separately for
+		// Send indications, which carry checks
+		turn_map_t *map = &relay_entry->turn->map;
+		if (!turn_has_permission(map, &entry->record, agent->logger))
+			agent_send_turn_create_permission_request(agent, relay_entry, &entry->record, 0);
+
+		agent_send_turn_channel_bind_request(agent, relay_entry, &entry->record, 0, NULL);
+
+		// Retry with exponential backoff until a response is received
+		timediff_t timeout = agent_get_retransmission_timeout(agent) << entry->binding_attempts;
+		if (timeout > MAX_STUN_RETRANSMISSION_TIMEOUT)
+			timeout = MAX_STUN_RETRANSMISSION_TIMEOUT;
+		if (entry->binding_attempts < MAX_BINDING_ATTEMPTS_SHIFT)
+			++entry->binding_attempts;
+
+		entry->binding_refresh_timestamp = now + timeout;
+	}
+
+	if (*next_timestamp > entry->binding_refresh_timestamp)
+		*next_timestamp = entry->binding_refresh_timestamp;
+}
+
+void agent_set_channel(agent_stun_entry_t *entry, uint16_t channel) {
+#ifdef NO_ATOMICS
+	entry->channel = channel;
+#else
+	atomic_store(&entry->channel, channel);
+#endif
+}
+
+timediff_t agent_get_keepalive_period(juice_agent_t *agent, const agent_stun_entry_t *entry) {
+	timediff_t failover_timeout = agent->config.timing.failover_timeout;
+	if (!failover_timeout || entry->type != AGENT_STUN_ENTRY_TYPE_CHECK)
+		return agent->config.timing.keepalive_period;
+
+	if (entry->pair != agent->selected_pair)
+		return FAILOVER_BACKUP_CHECK_PERIOD;
+
+	// Check consent on the selected pair several times per failover timeout
+	timediff_t period = failover_timeout / 4;
+	return period > agent->config.timing.pacing_time ? period : agent->config.timing.pacing_time;
+}
+
+timediff_t agent_get_retransmission_timeout(juice_agent_t *agent) {
+	if (!agent->has_rtt)
+		return agent->config.timing.retransmission_timeout;
+
+	// RFC 6298 2.3. RTO <- SRTT + max (G, K*RTTVAR) with K=4 and G=1ms
+	timediff_t var = 4 * agent->rttvar > 1000 ? 4 * agent->rttvar : 1000;
+	timediff_t rto = (agent->srtt + var + 999) / 1000;
+	if (rto < (timediff_t)agent->config.timing.min_retransmission_timeout)
+		rto = agent->config.timing.min_retransmission_timeout;
+	if (rto > MAX_STUN_RETRANSMISSION_TIMEOUT)
+		rto = MAX_STUN_RETRANSMISSION_TIMEOUT;
+
+	return rto;
+}
+
+static bool schedule_is_before(const agent_stun_entry_t *a, const agent_stun_entry_t *b) {
+	return a->next_transmission < b->next_transmission;
+}
+
+static void schedule_set(juice_agent_t *agent, int pos, agent_stun_entry_t *entry) {
+	agent->schedule[pos] = entry;
+	entry->schedule_index = pos + 1;
+}
+
+static void schedule_sift_up(juice_agent_t *agent, int pos) {
+	agent_stun_entry_t *entry = agent->schedule[pos];
+	while (pos > 0) {
+		int parent = (pos - 1) / 2;
+		if (!schedule_is_before(entry, agent->schedule[parent]))
+			break;
+		schedule_set(agent, pos, agent->schedule[parent]);
+		pos = parent;
+	}
+	schedule_set(agent, pos, entry);
+}
+
+static void schedule_sift_down(juice_agent_t *agent, int pos) {
+	agent_stun_entry_t *entry = agent->schedule[pos];
+	int count = agent->schedule_count;
+	while (2 * pos + 1 < count) {
+		int child = 2 * pos + 1;
+		if (child + 1 < count &&
+		    schedule_is_before(agent->schedule[child + 1], agent->schedule[child]))
+			++child;
+		if (!schedule_is_before(agent->schedule[child], entry))
+			break;
+		schedule_set(agent, pos, agent->schedule[child]);
+		pos = child;
+	}
+	schedule_set(agent, pos, entry);
+}
+
+void agent_schedule_transmission(juice_agent_t *agent, agent_stun_entry_t *entry,
+                                 timestamp_t timestamp) {
+	entry->next_transmission = timestamp;
+
+	int pos;
+	if (entry->schedule_index > 0) {
+		pos = entry->schedule_index - 1;
+	} else {
+		pos = agent->schedule_count++;
+		schedule_set(agent, pos, entry);
 	}
+
+	schedule_sift_up(agent, pos);
+	schedule_sift_down(agent, entry->schedule_index - 1);
+}
+
+void agent_cancel_transmission(juice_agent_t *agent, agent_stun_entry_t *entry) {
+	entry->next_transmission = 0;
+
+	if (entry->schedule_index <= 0)
+		return;
+
+	int pos = entry->schedule_index - 1;
+	entry->schedule_index = 0;
+
+	agent_stun_entry_t *last = agent->schedule[--agent->schedule_count];
+	if (last == entry)
+		return;
+
+	schedule_set(agent, pos, last);
+	schedule_sift_up(agent, pos);
+	schedule_sift_down(agent, last->schedule_index - 1);
 }
 
 void agent_update_gathering_done(juice_agent_t *agent) {
 	JLOG_VERBOSE(agent->logger, "Updating gathering status");
+	for (int i = 0; i < agent->resolutions_count; ++i) {
+		if (agent->resolutions[i].request) {
+			JLOG_VERBOSE(agent->logger, "Server address resolution %d is still pending", i);
+			return;
+		}
+	}
 	for (int i = 0; i < agent->entries_count; ++i) {
-		agent_stun_entry_t *entry = agent->entries + i;
+		agent_stun_entry_t *entry = agent->entries[i];
 		if (entry->type != AGENT_STUN_ENTRY_TYPE_CHECK &&
 		    entry->state == AGENT_STUN_ENTRY_STATE_PENDING) {
 			JLOG_VERBOSE(agent->logger, "STUN server or relay entry %d is still pending", i);
@@ -2201,7 +3263,7 @@ void agent_update_gathering_done(juice_agent_t *agent) {
 void agent_update_candidate_pairs(juice_agent_t *agent) {
 	bool is_controlling = agent->mode == AGENT_MODE_CONTROLLING;
 	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
-		ice_candidate_pair_t *pair = agent->candidate_pairs + i;
+		ice_candidate_pair_t *pair = agent->candidate_pairs[i];
 		ice_update_candidate_pair(pair, is_controlling);
 	}
 	agent_update_ordered_pairs(agent);
@@ -2209,14 +3271,15 @@ void agent_update_candidate_pairs(juice_agent_t *agent) {
 
 void agent_update_ordered_pairs(juice_agent_t *agent) {
 	JLOG_VERBOSE(agent->logger, "Updating ordered candidate pairs");
+	agent->pairs_changed = true;
 	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
 		ice_candidate_pair_t **begin = agent->ordered_pairs;
 		ice_candidate_pair_t **end = begin + i;
 		ice_candidate_pair_t **prev = end;
-		uint64_t priority = agent->candidate_pairs[i].priority;
+		uint64_t priority = agent->candidate_pairs[i]->priority;
 		while (--prev >= begin && (*prev)->priority < priority)
 			*(prev + 1) = *prev;
-		*(prev + 1) = agent->candidate_pairs + i;
+		*(prev + 1) = agent->candidate_pairs[i];
 	}
 }
 
@@ -2243,9 +3306,11 @@ agent_stun_entry_t *agent_find_entry_from_record(juice_agent_t *agent, const add
 		}
 	}
 
+	unsigned long key = addr_record_hash(record, true) % AGENT_INDEX_SIZE;
+
 	if (relayed) {
-		for (int i = 0; i < agent->entries_count; ++i) {
-			agent_stun_entry_t *entry = agent->entries + i;
+		for (agent_stun_entry_t *entry = agent->record_index[key]; entry;
+		     entry = entry->record_next) {
 			if (entry->pair && entry->pair->local &&
 			    entry->pair->local->type == ICE_CANDIDATE_TYPE_RELAYED &&
 			    addr_record_is_equal(&entry->pair->local->resolved, relayed, true) &&
@@ -2258,51 +3323,168 @@ agent_stun_entry_t *agent_find_entry_from_record(juice_agent_t *agent, const add
 	}
 
 	// Try to match pairs by priority first
-	ice_candidate_pair_t *matching_pair = NULL;
-	for (int i = 0; i < agent->candidate_pairs_count; ++i) {
-		ice_candidate_pair_t *pair = agent->ordered_pairs[i];
-		if (addr_record_is_equal(&pair->remote->resolved, record, true)) {
-			matching_pair = pair;
-			break;
-		}
+	agent_stun_entry_t *matching_entry = NULL;
+	for (agent_stun_entry_t *entry = agent->remote_index[key]; entry;
+	     entry = entry->remote_next) {
+		if (addr_record_is_equal(&entry->pair->remote->resolved, record, true) &&
+		    (!matching_entry || entry->pair->priority > matching_entry->pair->priority))
+			matching_entry = entry;
 	}
 
-	if (matching_pair) {
-		// Just find the corresponding entry
-		for (int i = 0; i < agent->entries_count; ++i) {
-			agent_stun_entry_t *entry = agent->entries + i;
-			if (entry->pair == matching_pair) {
-				JLOG_DEBUG(agent->logger, "STUN entry %d matching incoming address", i);
-				return entry;
-			}
-		}
+	if (matching_entry) {
+		JLOG_DEBUG(agent->logger, "STUN entry %d matching incoming address",
+		           matching_entry->index);
+		return matching_entry;
 	}
 
-	// Try to match entries directly
-	for (int i = 0; i < agent->entries_count; ++i) {
-		agent_stun_entry_t *entry = agent->entries + i;
-		if (addr_record_is_equal(&entry->record, record, true)) {
-			JLOG_DEBUG(agent->logger, "STUN entry %d matching incoming address", i);
+	// Try to match entries directly, relay entries take precedence as server addresses might
+	// resolve in any order
+	for (agent_stun_entry_t *entry = agent->record_index[key]; entry; entry = entry->record_next) {
+		if (addr_record_is_equal(&entry->record, record, true) &&
+		    (!matching_entry || (entry->type == AGENT_STUN_ENTRY_TYPE_RELAY &&
+		                         matching_entry->type != AGENT_STUN_ENTRY_TYPE_RELAY)))
+			matching_entry = entry;
+	}
+
+	if (matching_entry) {
+		JLOG_DEBUG(agent->logger, "STUN entry %d matching incoming address",
+		           matching_entry->index);
+		return matching_entry;
+	}
+
+	return NULL;
+}
+
+agent_stun_entry_t *agent_find_entry_from_transaction_id(juice_agent_t *agent,
+                                                         const uint8_t *transaction_id) {
+	unsigned long key = transaction_id_hash(transaction_id) % AGENT_INDEX_SIZE;
+	for (agent_stun_entry_t *entry = agent->transaction_index[key]; entry;
+	     entry = entry->transaction_next) {
+		if (memcmp(transaction_id, entry->transaction_id, STUN_TRANSACTION_ID_SIZE) == 0) {
+			JLOG_VERBOSE(agent->logger, "STUN entry %d matching incoming transaction ID",
+			             entry->index);
 			return entry;
 		}
 	}
 
+	// TURN CreatePermission and ChannelBind transactions are registered in the relay maps
+	for (int i = 0; i < agent->relay_entries_count; ++i) {
+		agent_stun_entry_t *entry = agent->relay_entries[i];
+		if (entry->turn && turn_find_transaction_id(&entry->turn->map, transaction_id, NULL))
+			return entry;
+	}
+
 	return NULL;
 }
 
+int agent_add_entry(juice_agent_t *agent, agent_stun_entry_t *entry) {
+	if (agent->entries_count == agent->entries_capacity) {
+		int capacity =
+		    agent->entries_capacity ? agent->entries_capacity * 2 : AGENT_INITIAL_CAPACITY;
+		agent_stun_entry_t **entries =
+		    realloc(agent->entries, capacity * sizeof(agent_stun_entry_t *));
+		if (entries)
+			agent->entries = entries;
+		agent_stun_entry_t **schedule =
+		    realloc(agent->schedule, capacity * sizeof(agent_stun_entry_t *));
+		if (schedule)
+			agent->schedule = schedule;
+		if (!entries || !schedule) {
+			JLOG_ERROR(agent->logger, "realloc for STUN entries failed");
+			return -1;
+		}
+		agent->entries_capacity = capacity;
+	}
+
+	entry->index = agent->entries_count;
+	agent->entries[agent->entries_count] = entry;
+	++agent->entries_count;
+	agent->pairs_changed = true;
+
+	agent_index_entry(agent, entry);
+	return 0;
+}
+
+static void index_record(juice_agent_t *agent, agent_stun_entry_t *entry) {
+	// Keep chains sorted by index so lookups preserve the entry order
+	unsigned long key = addr_record_hash(&entry->record, true) % AGENT_INDEX_SIZE;
+	agent_stun_entry_t **pos = agent->record_index + key;
+	while (*pos && (*pos)->index < entry->index)
+		pos = &(*pos)->record_next;
+	entry->record_next = *pos;
+	*pos = entry;
+}
+
+#if JUICE_ENABLE_LOCAL_ADDRESS_TRANSLATION
+// Returns true if the entry was indexed
+static bool unindex_record(juice_agent_t *agent, agent_stun_entry_t *entry) {
+	unsigned long key = addr_record_hash(&entry->record, true) % AGENT_INDEX_SIZE;
+	agent_stun_entry_t **pos = agent->record_index + key;
+	while (*pos && *pos != entry)
+		pos = &(*pos)->record_next;
+	if (!*pos)
+		return false;
+
+	*pos = entry->record_next;
+	entry->record_next = NULL;
+	return true;
+}
+#endif
+
+void agent_index_entry(juice_agent_t *agent, agent_stun_entry_t *entry) {
+	index_record(agent, entry);
+
+	unsigned long key;
+	agent_stun_entry_t **pos;
+	if (entry->pair) {
+		key = addr_record_hash(&entry->pair->remote->resolved, true) % AGENT_INDEX_SIZE;
+		pos = agent->remote_index + key;
+		while (*pos)
+			pos = &(*pos)->remote_next;
+		entry->remote_next = NULL;
+		*pos = entry;
+	}
+
+	key = transaction_id_hash(entry->transaction_id) % AGENT_INDEX_SIZE;
+	entry->transaction_next = agent->transaction_index[key];
+	agent->transaction_index[key] = entry;
+}
+
+void agent_renew_transaction_id(juice_agent_t *agent, agent_stun_entry_t *entry) {
+	unsigned long key = transaction_id_hash(entry->transaction_id) % AGENT_INDEX_SIZE;
+	agent_stun_entry_t **pos = agent->transaction_index + key;
+	while (*pos && *pos != entry)
+		pos = &(*pos)->transaction_next;
+	if (*pos)
+		*pos = entry->transaction_next;
+
+	juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, agent->logger);
+
+	key = transaction_id_hash(entry->transaction_id) % AGENT_INDEX_SIZE;
+	entry->transaction_next = agent->transaction_index[key];
+	agent->transaction_index[key] = entry;
+}
+
+void agent_invalidate_cached_requests(juice_agent_t *agent) {
+	for (int i = 0; i < agent->entries_count; ++i)
+		agent->entries[i]->request_size = 0;
+}
+
 void agent_translate_host_candidate_entry(juice_agent_t *agent, agent_stun_entry_t *entry) {
 	if (!entry->pair || entry->pair->remote->type != ICE_CANDIDATE_TYPE_HOST)
 		return;
 
 #if JUICE_ENABLE_LOCAL_ADDRESS_TRANSLATION
 	for (int i = 0; i < agent->local.candidates_count; ++i) {
-		ice_candidate_t *candidate = agent->local.candidates + i;
+		ice_candidate_t *candidate = agent->local.candidates[i];
 		if (candidate->type != ICE_CANDIDATE_TYPE_HOST)
 			continue;
 
 		if (addr_record_is_equal(&candidate->resolved, &entry->record, false)) {
 			JLOG_DEBUG(agent->logger,
 			           "Entry remote address matches local candidate, translating to localhost");
+			// The record index is keyed by address
+			bool indexed = unindex_record(agent, entry);
 			struct sockaddr_storage *addr = &entry->record.addr;
 			switch (addr->ss_family) {
 			case AF_INET6: {
@@ -2321,6 +3503,8 @@ void agent_translate_host_candidate_entry(juice_agent_t *agent, agent_stun_entry
 				// Ignore
 				break;
 			}
+			if (indexed)
+				index_record(agent, entry);
 			break;
 		}
 	}
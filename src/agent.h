@@ -24,13 +24,19 @@
 #endif
 
 #include "addr.h"
+#include "arena.h"
 #include "ice.h"
 #include "juice.h"
+#include "resolver.h"
+#include "shortcut.h"
 #include "socket.h"
 #include "stun.h"
 #include "thread.h"
 #include "timestamp.h"
 #include "turn.h"
+#include "turn_pool.h"
+#include "udp.h"
+#include "wakeup.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -39,13 +45,20 @@
 #include <stdatomic.h>
 #endif
 
+// Default timing values, which may be overridden per agent in juice_config_t
+
 // RFC 8445: Agents MUST NOT use an RTO value smaller than 500 ms.
+// The datacenter timing preset overrides it for controlled networks.
 #define MIN_STUN_RETRANSMISSION_TIMEOUT 500 // msecs
 #define MAX_STUN_RETRANSMISSION_COUNT 5     // count (exponential backoff, will give ~30s)
 
+// Upper bound of the RTO derived from RTT measurements
+#define MAX_STUN_RETRANSMISSION_TIMEOUT 3000 // msecs
+
 // RFC 8445: ICE agents SHOULD use a default Ta value, 50 ms, but MAY use
 // another value based on the characteristics of the associated data.
-#define STUN_PACING_TIME 50 // msecs
+#define STUN_PACING_TIME 50    // msecs
+#define MIN_STUN_PACING_TIME 5 // msecs
 
 // RFC 8445: Agents SHOULD use a Tr value of 15 seconds. Agents MAY use a bigger value but MUST NOT
 // use a value smaller than 15 seconds.
@@ -58,19 +71,32 @@
 // ICE trickling timeout
 #define ICE_FAIL_TIMEOUT 30000 // msecs
 
+// Max delay to wait for checks of other pairs before nominating with the lowest RTT policy
+#define MAX_RTT_NOMINATION_DELAY 1000 // msecs
+
+// Failover to a backup pair, backup pairs are checked at a low rate
+#define MIN_FAILOVER_TIMEOUT 100                                    // msecs
+#define FAILOVER_BACKUP_CHECK_PERIOD 2000                           // msecs
+#define FAILOVER_BACKUP_TIMEOUT (3 * FAILOVER_BACKUP_CHECK_PERIOD) // msecs
+#define MAX_FAILOVER_BACKUPS_COUNT 2
+
 // Max STUN and TURN server entries
 #define MAX_SERVER_ENTRIES_COUNT 2 // max STUN server entries
 #define MAX_RELAY_ENTRIES_COUNT 2  // max TURN server entries
 
-// Compute max candidates and entries count
-// This guarantees 8 (+1 to be safe) host candidates slots
+// Limits on gathered candidates; storage for candidates, pairs and entries is allocated on demand
 #define MAX_STUN_SERVER_RECORDS_COUNT MAX_SERVER_ENTRIES_COUNT
-#define MAX_HOST_CANDIDATES_COUNT ((ICE_MAX_CANDIDATES_COUNT - MAX_STUN_SERVER_RECORDS_COUNT) / 2)
+#define MAX_HOST_CANDIDATES_COUNT 9
 #define MAX_PEER_REFLEXIVE_CANDIDATES_COUNT MAX_HOST_CANDIDATES_COUNT
-#define MAX_CANDIDATE_PAIRS_COUNT (ICE_MAX_CANDIDATES_COUNT * (1 + MAX_RELAY_ENTRIES_COUNT))
-#define MAX_STUN_ENTRIES_COUNT (MAX_CANDIDATE_PAIRS_COUNT + MAX_STUN_SERVER_RECORDS_COUNT)
+#define MAX_CANDIDATE_PAIRS_COUNT 128 // including pairs kept across ICE restarts
+
+#define AGENT_TURN_MAP_SIZE 20
+
+// Buckets count of entry hash indexes
+#define AGENT_INDEX_SIZE 32
 
-#define AGENT_TURN_MAP_SIZE ICE_MAX_CANDIDATES_COUNT
+// Max size of a cached Binding request, larger requests are rebuilt on each transmission
+#define AGENT_REQUEST_CACHE_SIZE 192
 
 typedef enum agent_mode {
 	AGENT_MODE_UNKNOWN,
@@ -101,6 +127,7 @@ typedef struct agent_turn_state {
 } agent_turn_state_t;
 
 typedef struct agent_stun_entry {
+	int index; // position in agent entries
 	agent_stun_entry_type_t type;
 	agent_stun_entry_state_t state;
 	ice_candidate_pair_t *pair;
@@ -110,11 +137,37 @@ typedef struct agent_stun_entry {
 	timestamp_t next_transmission;
 	timediff_t retransmission_timeout;
 	int retransmissions;
+	timestamp_t transmission_timestamp; // last request transmission in usecs
+	int transmissions;                  // of the current request, for RTT sampling
+	timestamp_t response_timestamp;     // last success response, for failover
+	int schedule_index; // 1-based position in the agent transmission schedule, 0 if unscheduled
+
+	// Binding request as last written, resent verbatim while its transaction ID, the role and the
+	// nomination are unchanged
+	char request[AGENT_REQUEST_CACHE_SIZE];
+	size_t request_size; // 0 if none
+	agent_mode_t request_mode;
+	bool request_use_candidate;
 
 	// TURN
 	agent_turn_state_t *turn;
 	struct agent_stun_entry *relay_entry;
 
+	// Channel on relay_entry to the remote address, kept bound for selected and backup pairs
+	timestamp_t binding_refresh_timestamp; // next ChannelBind, 0 to refresh now
+	timestamp_t channel_expiry;            // 0 if no channel is bound
+	int binding_attempts;                  // unanswered ChannelBind requests, capped
+#ifdef NO_ATOMICS
+	volatile uint16_t channel;
+#else
+	_Atomic(uint16_t) channel; // 0 if none, read without locking on send
+#endif
+
+	// Hash index chaining
+	struct agent_stun_entry *record_next;      // in record index
+	struct agent_stun_entry *remote_next;      // in pair remote index
+	struct agent_stun_entry *transaction_next; // in transaction ID index
+
 #ifdef NO_ATOMICS
 	volatile bool armed;
 #else
@@ -122,32 +175,115 @@ typedef struct agent_stun_entry {
 #endif
 } agent_stun_entry_t;
 
+// Statistics counters, updated without locking
+#ifdef NO_ATOMICS
+typedef volatile uint64_t agent_counter_t;
+#define agent_counter_add(counter, value) (*(counter) += (value))
+#define agent_counter_load(counter) (*(counter))
+#else
+typedef _Atomic(uint64_t) agent_counter_t;
+#define agent_counter_add(counter, value)                                                          \
+	atomic_fetch_add_explicit((counter), (value), memory_order_relaxed)
+#define agent_counter_load(counter) atomic_load_explicit((counter), memory_order_relaxed)
+#endif
+
+typedef struct agent_path_counters {
+	agent_counter_t bytes_sent;
+	agent_counter_t packets_sent;
+	agent_counter_t bytes_received;
+	agent_counter_t packets_received;
+} agent_path_counters_t;
+
+typedef struct agent_counters {
+	agent_path_counters_t direct;
+	agent_path_counters_t relayed;
+	agent_path_counters_t shortcut;
+	agent_counter_t checks_sent;
+	agent_counter_t checks_retransmitted;
+	agent_counter_t datagrams_dropped;
+} agent_counters_t;
+
+typedef struct agent_resolution {
+	resolver_request_t *request;      // NULL once processed
+	juice_turn_server_t *turn_server; // NULL for the STUN server
+} agent_resolution_t;
+
 struct juice_agent {
 	juice_config_t config;
 	juice_state_t state;
 	agent_mode_t mode;
 	socket_t sock;
+	wakeup_t wakeup;
 	thread_t thread;
 	mutex_t mutex;
 
+	// Direct delivery to a co-located agent, bypassing the socket
+	shortcut_t shortcut;
+
 	ice_description_t local;
 	ice_description_t remote;
 
-	ice_candidate_pair_t candidate_pairs[MAX_CANDIDATE_PAIRS_COUNT];
-	ice_candidate_pair_t *ordered_pairs[MAX_CANDIDATE_PAIRS_COUNT];
+	// Short-term HMAC keys precomputed from the ICE passwords, NULL if not available
+	hmac_key_t *local_hmac_key;
+	hmac_key_t *remote_hmac_key;
+
+	// Pairs and entries are allocated in the arena and never move
+	arena_t arena;
+
+	ice_candidate_pair_t **candidate_pairs;
+	ice_candidate_pair_t **ordered_pairs;
 	ice_candidate_pair_t *selected_pair;
 	int candidate_pairs_count;
+	int candidate_pairs_capacity;
 
-	agent_stun_entry_t entries[MAX_STUN_ENTRIES_COUNT];
+	agent_stun_entry_t **entries;
 	int entries_count;
+	int entries_capacity;
+
+	// Hash indexes on entries, chains are kept in entry order
+	agent_stun_entry_t *record_index[AGENT_INDEX_SIZE];
+	agent_stun_entry_t *remote_index[AGENT_INDEX_SIZE];
+	agent_stun_entry_t *transaction_index[AGENT_INDEX_SIZE];
+	agent_stun_entry_t *relay_entries[MAX_RELAY_ENTRIES_COUNT];
+	int relay_entries_count;
+
+	// Min-heap of scheduled entries ordered by next transmission
+	agent_stun_entry_t **schedule; // same capacity as entries
+	int schedule_count;
+	timestamp_t pacing_timestamp;
+
+	// RFC 6298 round-trip time estimator, in usecs
+	timediff_t srtt;
+	timediff_t rttvar;
+	bool has_rtt;
+	timestamp_t nomination_timestamp; // deadline to nominate with the lowest RTT policy
+
+	agent_counters_t counters;
+	timestamp_t gathering_timestamp;
+	timestamp_t connected_timestamp; // 0 if not reached
+	timestamp_t completed_timestamp; // 0 if not reached
+
+	// STUN and TURN server address resolutions, running concurrently with checks
+	agent_resolution_t *resolutions;
+	int resolutions_count;
+	juice_turn_server_t *pooled_turn_server; // allocation taken from the pool, not resolved
+
 #ifdef NO_ATOMICS
 	agent_stun_entry_t *volatile selected_entry;
 #else
 	_Atomic(agent_stun_entry_t *) selected_entry;
 #endif
 
+	udp_addrs_watcher_t addrs_watcher;
+	unsigned int addrs_generation; // local addresses generation at last host gathering
 	uint64_t ice_tiebreaker;
 	timestamp_t fail_timestamp;
+
+	// Set when pair or entry states change, so bookkeeping only goes through entries then
+	bool pairs_changed;
+	// Relayed entries of the selected and backup pairs, whose TURN channels are kept bound
+	agent_stun_entry_t *channel_entries[1 + MAX_FAILOVER_BACKUPS_COUNT];
+	int channel_entries_count;
 	bool gathering_done;
 	bool thread_started;
 	bool thread_stopped;
@@ -163,23 +299,35 @@ void agent_do_destroy(juice_agent_t *agent);
 void agent_destroy(juice_agent_t *agent);
 
 int agent_gather_candidates(juice_agent_t *agent);
+int agent_gather_host_candidates(juice_agent_t *agent);
 int agent_get_local_description(juice_agent_t *agent, char *buffer, size_t size);
 int agent_set_remote_description(juice_agent_t *agent, const char *sdp);
 int agent_add_remote_candidate(juice_agent_t *agent, const char *sdp);
 int agent_set_remote_gathering_done(juice_agent_t *agent);
+int agent_restart_ice(juice_agent_t *agent);
 int agent_send(juice_agent_t *agent, const char *data, size_t size, int ds);
 int agent_direct_send(juice_agent_t *agent, const addr_record_t *dst, const char *data, size_t size,
                       int ds);
 int agent_relay_send(juice_agent_t *agent, agent_stun_entry_t *entry, const addr_record_t *dst,
                      const char *data, size_t size, int ds);
-int agent_channel_send(juice_agent_t *agent, agent_stun_entry_t *entry, const addr_record_t *dst,
+int agent_channel_send(juice_agent_t *agent, agent_stun_entry_t *entry, uint16_t channel,
                        const char *data, size_t size, int ds);
 juice_state_t agent_get_state(juice_agent_t *agent);
 int agent_get_selected_candidate_pair(juice_agent_t *agent, ice_candidate_t *local,
                                       ice_candidate_t *remote);
+int agent_get_selected_rtt(juice_agent_t *agent, int64_t *rtt, int64_t *min_rtt);
+void agent_get_stats(juice_agent_t *agent, juice_agent_stats_t *stats);
 
 void agent_run(juice_agent_t *agent);
+int agent_resolve_servers(juice_agent_t *agent);
+void agent_update_resolutions(juice_agent_t *agent);
+int agent_add_server_entries(juice_agent_t *agent, const addr_record_t *records, int count);
+int agent_add_relay_entry(juice_agent_t *agent, const juice_turn_server_t *turn_server,
+                          const addr_record_t *records, int count);
+int agent_add_pooled_relay_entry(juice_agent_t *agent, const juice_turn_server_t *turn_server,
+                                 const turn_pool_allocation_t *allocation);
 int agent_recv(juice_agent_t *agent);
+int agent_recv_shortcut(juice_agent_t *agent);
 int agent_input(juice_agent_t *agent, char *buf, size_t len, const addr_record_t *src,
                 const addr_record_t *relayed); // relayed may be NULL
 int agent_interrupt(juice_agent_t *agent);
@@ -195,9 +343,11 @@ int agent_dispatch_stun(juice_agent_t *agent, void *buf, size_t size, stun_messa
 int agent_process_stun_binding(juice_agent_t *agent, const stun_message_t *msg,
                                agent_stun_entry_t *entry, const addr_record_t *src,
                                const addr_record_t *relayed); // relayed may be NULL
-int agent_send_stun_binding(juice_agent_t *agent, const agent_stun_entry_t *entry,
+int agent_send_stun_binding(juice_agent_t *agent, agent_stun_entry_t *entry,
                             stun_class_t msg_class, unsigned int error_code,
                             const uint8_t *transaction_id, const addr_record_t *mapped);
+int agent_send_stun_datagram(juice_agent_t *agent, const agent_stun_entry_t *entry,
+                             const char *data, size_t size);
 int agent_process_turn_allocate(juice_agent_t *agent, const stun_message_t *msg,
                                 agent_stun_entry_t *entry);
 int agent_send_turn_allocate_request(juice_agent_t *agent, const agent_stun_entry_t *entry,
@@ -224,13 +374,35 @@ int agent_add_remote_reflexive_candidate(juice_agent_t *agent, ice_candidate_typ
 int agent_add_candidate_pair(juice_agent_t *agent, ice_candidate_t *local,
                              ice_candidate_t *remote); // local may be NULL
 int agent_add_candidate_pairs_for_remote(juice_agent_t *agent, ice_candidate_t *remote);
+int agent_rebind_candidate_pairs(juice_agent_t *agent, ice_candidate_t *remote);
+int agent_replace_remote_description(juice_agent_t *agent, ice_description_t *remote);
+void agent_restart_checks(juice_agent_t *agent);
+void agent_update_hmac_keys(juice_agent_t *agent);
 int agent_unfreeze_candidate_pair(juice_agent_t *agent, ice_candidate_pair_t *pair);
 
 void agent_arm_transmission(juice_agent_t *agent, agent_stun_entry_t *entry, timediff_t delay);
+bool agent_is_pair_within_tolerance(juice_agent_t *agent, const ice_candidate_pair_t *pair,
+                                    const ice_candidate_pair_t *best);
+void agent_update_rtt(juice_agent_t *agent, agent_stun_entry_t *entry, timediff_t rtt);
+void agent_refresh_turn_binding(juice_agent_t *agent, agent_stun_entry_t *entry, timestamp_t now,
+                                timestamp_t *next_timestamp);
+void agent_set_channel(agent_stun_entry_t *entry, uint16_t channel);
+void agent_update_failover(juice_agent_t *agent, timestamp_t now);
+timediff_t agent_get_keepalive_period(juice_agent_t *agent, const agent_stun_entry_t *entry);
+timediff_t agent_get_retransmission_timeout(juice_agent_t *agent);
+void agent_schedule_transmission(juice_agent_t *agent, agent_stun_entry_t *entry,
+                                 timestamp_t timestamp);
+void agent_cancel_transmission(juice_agent_t *agent, agent_stun_entry_t *entry);
 void agent_update_gathering_done(juice_agent_t *agent);
 void agent_update_candidate_pairs(juice_agent_t *agent);
 void agent_update_ordered_pairs(juice_agent_t *agent);
 
+int agent_add_entry(juice_agent_t *agent, agent_stun_entry_t *entry);
+void agent_index_entry(juice_agent_t *agent, agent_stun_entry_t *entry);
+void agent_renew_transaction_id(juice_agent_t *agent, agent_stun_entry_t *entry);
+void agent_invalidate_cached_requests(juice_agent_t *agent);
+agent_stun_entry_t *agent_find_entry_from_transaction_id(juice_agent_t *agent,
+                                                         const uint8_t *transaction_id);
 agent_stun_entry_t *
 agent_find_entry_from_record(juice_agent_t *agent, const addr_record_t *record,
                              const addr_record_t *relayed); // relayed may be NULL
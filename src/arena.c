@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT sizeof(max_align_t)
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	max_align_t data[];
+};
+
+void arena_init(arena_t *arena, size_t block_size) {
+	arena->head = NULL;
+	arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void arena_destroy(arena_t *arena) {
+	arena_block_t *block = arena->head;
+	while (block) {
+		arena_block_t *next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->head = NULL;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+	size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+	arena_block_t *block = arena->head;
+	if (size > arena->block_size) {
+		// Oversized allocations get a dedicated block behind the current one
+		block = malloc(sizeof(arena_block_t) + size);
+		if (!block)
+			return NULL;
+
+		block->size = size;
+		block->used = 0;
+		if (arena->head) {
+			block->next = arena->head->next;
+			arena->head->next = block;
+		} else {
+			block->next = NULL;
+			arena->head = block;
+		}
+
+	} else if (!block || block->size - block->used < size) {
+		block = malloc(sizeof(arena_block_t) + arena->block_size);
+		if (!block)
+			return NULL;
+
+		block->size = arena->block_size;
+		block->used = 0;
+		block->next = arena->head;
+		arena->head = block;
+	}
+
+	void *ptr = (char *)block->data + block->used;
+	block->used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef JUICE_ARENA_H
+#define JUICE_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE 4096
+
+typedef struct arena_block arena_block_t;
+
+// Bump allocator for objects sharing the lifetime of their owner
+// Allocated memory is zeroed, never moves, and is only released by arena_destroy().
+typedef struct arena {
+	arena_block_t *head;
+	size_t block_size;
+} arena_t;
+
+void arena_init(arena_t *arena, size_t block_size); // block_size may be 0 for default
+void arena_destroy(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size);
+
+#endif // JUICE_ARENA_H
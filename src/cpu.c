@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "cpu.h"
+
+#include <stddef.h>
+
+#ifdef __STDC_NO_ATOMICS__
+#define NO_ATOMICS
+#endif
+
+#ifndef NO_ATOMICS
+#include <stdatomic.h>
+#endif
+
+#if CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#define CPU_FEATURES_DETECTED 0x80000000
+
+#ifdef NO_ATOMICS
+static volatile unsigned int cached_features = 0;
+#else
+static _Atomic(unsigned int) cached_features = 0;
+#endif
+
+static unsigned int detect_features(void) {
+	unsigned int features = 0;
+#if CPU_X86
+	unsigned int regs[4]; // eax, ebx, ecx, edx
+#ifdef _MSC_VER
+	__cpuid((int *)regs, 0);
+	unsigned int max_leaf = regs[0];
+	__cpuid((int *)regs, 1);
+#else
+	unsigned int max_leaf = __get_cpuid_max(0, NULL);
+	if (max_leaf < 1)
+		return 0;
+	__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	if (regs[2] & (1 << 9))
+		features |= CPU_FEATURE_SSSE3;
+	if (regs[2] & (1 << 19))
+		features |= CPU_FEATURE_SSE41;
+	if (regs[2] & (1 << 1))
+		features |= CPU_FEATURE_PCLMUL;
+
+	if (max_leaf >= 7) {
+#ifdef _MSC_VER
+		__cpuidex((int *)regs, 7, 0);
+#else
+		__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		if (regs[1] & (1 << 29))
+			features |= CPU_FEATURE_SHA;
+	}
+#endif
+	return features;
+}
+
+bool cpu_has_features(unsigned int features) {
+#ifdef NO_ATOMICS
+	unsigned int detected = cached_features;
+#else
+	unsigned int detected = atomic_load(&cached_features);
+#endif
+	if (!(detected & CPU_FEATURES_DETECTED)) {
+		// Detection has no side effects, so concurrent callers may safely race here
+		detected = detect_features() | CPU_FEATURES_DETECTED;
+#ifdef NO_ATOMICS
+		cached_features = detected;
+#else
+		atomic_store(&cached_features, detected);
+#endif
+	}
+	return (detected & features) == features;
+}
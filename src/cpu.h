@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef JUICE_CPU_H
+#define JUICE_CPU_H
+
+#include <stdbool.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86 1
+#define CPU_X86_TARGET(features) __attribute__((target(features)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CPU_X86 1
+#define CPU_X86_TARGET(features)
+#else
+#define CPU_X86 0
+#endif
+
+#define CPU_FEATURE_SSSE3 0x01
+#define CPU_FEATURE_SSE41 0x02
+#define CPU_FEATURE_PCLMUL 0x04
+#define CPU_FEATURE_SHA 0x08
+
+// Returns true if the CPU supports all the features, detection is done once and cached
+bool cpu_has_features(unsigned int features);
+
+#endif
@@ -22,8 +22,11 @@
 #include <nettle/md5.h>
 #include <nettle/sha1.h>
 #include <nettle/sha2.h>
+#elif USE_OPENSSL
+#include <openssl/evp.h>
 #else
 #include "picohash.h"
+#include "sha.h"
 #endif
 
 void hash_md5(const void *message, size_t size, void *digest) {
@@ -32,6 +35,8 @@ void hash_md5(const void *message, size_t size, void *digest) {
 	md5_init(&ctx);
 	md5_update(&ctx, size, message);
 	md5_digest(&ctx, HASH_MD5_SIZE, digest);
+#elif USE_OPENSSL
+	EVP_Digest(message, size, digest, NULL, EVP_md5(), NULL);
 #else
 	picohash_ctx_t ctx;
 	picohash_init_md5(&ctx);
@@ -46,11 +51,13 @@ void hash_sha1(const void *message, size_t size, void *digest) {
 	sha1_init(&ctx);
 	sha1_update(&ctx, size, message);
 	sha1_digest(&ctx, HASH_SHA1_SIZE, digest);
+#elif USE_OPENSSL
+	EVP_Digest(message, size, digest, NULL, EVP_sha1(), NULL);
 #else
-	picohash_ctx_t ctx;
-	picohash_init_sha1(&ctx);
-	picohash_update(&ctx, message, size);
-	picohash_final(&ctx, digest);
+	sha_ctx_t ctx;
+	sha_init_sha1(&ctx);
+	sha_update(&ctx, message, size);
+	sha_final(&ctx, digest);
 #endif
 }
 
@@ -60,10 +67,12 @@ void hash_sha256(const void *message, size_t size, void *digest) {
 	sha256_init(&ctx);
 	sha256_update(&ctx, size, message);
 	sha256_digest(&ctx, HASH_SHA256_SIZE, digest);
+#elif USE_OPENSSL
+	EVP_Digest(message, size, digest, NULL, EVP_sha256(), NULL);
 #else
-	picohash_ctx_t ctx;
-	picohash_init_sha256(&ctx);
-	picohash_update(&ctx, message, size);
-	picohash_final(&ctx, digest);
+	sha_ctx_t ctx;
+	sha_init_sha256(&ctx);
+	sha_update(&ctx, message, size);
+	sha_final(&ctx, digest);
 #endif
 }
@@ -20,8 +20,116 @@
 
 #if USE_NETTLE
 #include <nettle/hmac.h>
+#elif USE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
 #else
-#include "picohash.h"
+#include "sha.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+struct hmac_key {
+#if USE_NETTLE
+	struct hmac_sha1_ctx sha1;
+	struct hmac_sha256_ctx sha256;
+#elif USE_OPENSSL
+	EVP_MD_CTX *sha1_inner;
+	EVP_MD_CTX *sha1_outer;
+	EVP_MD_CTX *sha256_inner;
+	EVP_MD_CTX *sha256_outer;
+#else
+	sha_ctx_t sha1_inner;
+	sha_ctx_t sha1_outer;
+	sha_ctx_t sha256_inner;
+	sha_ctx_t sha256_outer;
+#endif
+};
+
+#if !USE_NETTLE && !USE_OPENSSL
+static void init_padded_states(sha_ctx_t *inner, sha_ctx_t *outer, void (*initf)(sha_ctx_t *),
+                               const void *key, size_t key_size) {
+	uint8_t block[SHA_BLOCK_SIZE];
+	memset(block, 0, SHA_BLOCK_SIZE);
+	initf(inner);
+	if (key_size > SHA_BLOCK_SIZE) {
+		sha_update(inner, key, key_size);
+		sha_final(inner, block);
+		initf(inner);
+	} else {
+		memcpy(block, key, key_size);
+	}
+	*outer = *inner;
+
+	for (size_t i = 0; i < SHA_BLOCK_SIZE; ++i)
+		block[i] ^= 0x36;
+	sha_update(inner, block, SHA_BLOCK_SIZE);
+
+	for (size_t i = 0; i < SHA_BLOCK_SIZE; ++i)
+		block[i] ^= 0x36 ^ 0x5c;
+	sha_update(outer, block, SHA_BLOCK_SIZE);
+
+	memset(block, 0, SHA_BLOCK_SIZE);
+}
+
+static void hmac_from_states(const sha_ctx_t *inner, const sha_ctx_t *outer, const void *message,
+                             size_t size, void *digest) {
+	uint8_t inner_digest[SHA256_DIGEST_SIZE];
+	sha_ctx_t ctx = *inner;
+	sha_update(&ctx, message, size);
+	sha_final(&ctx, inner_digest);
+
+	ctx = *outer;
+	sha_update(&ctx, inner_digest, ctx.digest_size);
+	sha_final(&ctx, digest);
+}
+#endif
+
+#if USE_OPENSSL
+#define OPENSSL_MAX_BLOCK_SIZE 128 // SHA-512 block size
+
+static EVP_MD_CTX *create_padded_state(const EVP_MD *md, const void *key, size_t key_size,
+                                       unsigned char pad) {
+	unsigned char block[OPENSSL_MAX_BLOCK_SIZE];
+	size_t block_size = (size_t)EVP_MD_block_size(md);
+	memset(block, 0, block_size);
+	if (key_size > block_size) {
+		unsigned int len;
+		EVP_Digest(key, key_size, block, &len, md, NULL);
+	} else {
+		memcpy(block, key, key_size);
+	}
+
+	for (size_t i = 0; i < block_size; ++i)
+		block[i] ^= pad;
+
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	if (ctx && (!EVP_DigestInit_ex(ctx, md, NULL) || !EVP_DigestUpdate(ctx, block, block_size))) {
+		EVP_MD_CTX_free(ctx);
+		ctx = NULL;
+	}
+	memset(block, 0, sizeof(block));
+	return ctx;
+}
+
+static void hmac_from_states(const EVP_MD_CTX *inner, const EVP_MD_CTX *outer, const void *message,
+                             size_t size, void *digest) {
+	unsigned char inner_digest[EVP_MAX_MD_SIZE];
+	unsigned int len = 0;
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	if (!ctx)
+		return;
+
+	EVP_MD_CTX_copy_ex(ctx, inner);
+	EVP_DigestUpdate(ctx, message, size);
+	EVP_DigestFinal_ex(ctx, inner_digest, &len);
+
+	EVP_MD_CTX_copy_ex(ctx, outer);
+	EVP_DigestUpdate(ctx, inner_digest, len);
+	EVP_DigestFinal_ex(ctx, digest, NULL);
+	EVP_MD_CTX_free(ctx);
+}
 #endif
 
 void hmac_sha1(const void *message, size_t size, const void *key, size_t key_size, void *digest) {
@@ -30,11 +138,12 @@ void hmac_sha1(const void *message, size_t size, const void *key, size_t key_siz
 	hmac_sha1_set_key(&ctx, key_size, key);
 	hmac_sha1_update(&ctx, size, message);
 	hmac_sha1_digest(&ctx, HMAC_SHA1_SIZE, digest);
+#elif USE_OPENSSL
+	HMAC(EVP_sha1(), key, (int)key_size, message, size, digest, NULL);
 #else
-	picohash_ctx_t ctx;
-	picohash_init_hmac(&ctx, picohash_init_sha1, key, key_size);
-	picohash_update(&ctx, message, size);
-	picohash_final(&ctx, digest);
+	sha_ctx_t inner, outer;
+	init_padded_states(&inner, &outer, sha_init_sha1, key, key_size);
+	hmac_from_states(&inner, &outer, message, size, digest);
 #endif
 }
 
@@ -44,10 +153,73 @@ void hmac_sha256(const void *message, size_t size, const void *key, size_t key_s
 	hmac_sha256_set_key(&ctx, key_size, key);
 	hmac_sha256_update(&ctx, size, message);
 	hmac_sha256_digest(&ctx, HMAC_SHA256_SIZE, digest);
+#elif USE_OPENSSL
+	HMAC(EVP_sha256(), key, (int)key_size, message, size, digest, NULL);
+#else
+	sha_ctx_t inner, outer;
+	init_padded_states(&inner, &outer, sha_init_sha256, key, key_size);
+	hmac_from_states(&inner, &outer, message, size, digest);
+#endif
+}
+
+hmac_key_t *hmac_key_create(const void *key, size_t key_size) {
+	hmac_key_t *hkey = malloc(sizeof(hmac_key_t));
+	if (!hkey)
+		return NULL;
+
+#if USE_NETTLE
+	hmac_sha1_set_key(&hkey->sha1, key_size, key);
+	hmac_sha256_set_key(&hkey->sha256, key_size, key);
+#elif USE_OPENSSL
+	hkey->sha1_inner = create_padded_state(EVP_sha1(), key, key_size, 0x36);
+	hkey->sha1_outer = create_padded_state(EVP_sha1(), key, key_size, 0x5c);
+	hkey->sha256_inner = create_padded_state(EVP_sha256(), key, key_size, 0x36);
+	hkey->sha256_outer = create_padded_state(EVP_sha256(), key, key_size, 0x5c);
+	if (!hkey->sha1_inner || !hkey->sha1_outer || !hkey->sha256_inner || !hkey->sha256_outer) {
+		hmac_key_destroy(hkey);
+		return NULL;
+	}
+#else
+	init_padded_states(&hkey->sha1_inner, &hkey->sha1_outer, sha_init_sha1, key, key_size);
+	init_padded_states(&hkey->sha256_inner, &hkey->sha256_outer, sha_init_sha256, key, key_size);
+#endif
+	return hkey;
+}
+
+void hmac_key_destroy(hmac_key_t *hkey) {
+	if (!hkey)
+		return;
+
+#if USE_OPENSSL
+	EVP_MD_CTX_free(hkey->sha1_inner);
+	EVP_MD_CTX_free(hkey->sha1_outer);
+	EVP_MD_CTX_free(hkey->sha256_inner);
+	EVP_MD_CTX_free(hkey->sha256_outer);
+#endif
+	memset(hkey, 0, sizeof(hmac_key_t));
+	free(hkey);
+}
+
+void hmac_key_sha1(const hmac_key_t *hkey, const void *message, size_t size, void *digest) {
+#if USE_NETTLE
+	struct hmac_sha1_ctx ctx = hkey->sha1;
+	hmac_sha1_update(&ctx, size, message);
+	hmac_sha1_digest(&ctx, HMAC_SHA1_SIZE, digest);
+#elif USE_OPENSSL
+	hmac_from_states(hkey->sha1_inner, hkey->sha1_outer, message, size, digest);
+#else
+	hmac_from_states(&hkey->sha1_inner, &hkey->sha1_outer, message, size, digest);
+#endif
+}
+
+void hmac_key_sha256(const hmac_key_t *hkey, const void *message, size_t size, void *digest) {
+#if USE_NETTLE
+	struct hmac_sha256_ctx ctx = hkey->sha256;
+	hmac_sha256_update(&ctx, size, message);
+	hmac_sha256_digest(&ctx, HMAC_SHA256_SIZE, digest);
+#elif USE_OPENSSL
+	hmac_from_states(hkey->sha256_inner, hkey->sha256_outer, message, size, digest);
 #else
-	picohash_ctx_t ctx;
-	picohash_init_hmac(&ctx, picohash_init_sha256, key, key_size);
-	picohash_update(&ctx, message, size);
-	picohash_final(&ctx, digest);
+	hmac_from_states(&hkey->sha256_inner, &hkey->sha256_outer, message, size, digest);
 #endif
 }
@@ -28,4 +28,14 @@
 void hmac_sha1(const void *message, size_t size, const void *key, size_t key_size, void *digest);
 void hmac_sha256(const void *message, size_t size, const void *key, size_t key_size, void *digest);
 
+// Key with the inner and outer hash states precomputed for SHA-1 and SHA-256, each message then
+// only costs hashing its content from cloned states
+typedef struct hmac_key hmac_key_t;
+
+hmac_key_t *hmac_key_create(const void *key, size_t key_size);
+void hmac_key_destroy(hmac_key_t *hkey); // hkey may be NULL
+
+void hmac_key_sha1(const hmac_key_t *hkey, const void *message, size_t size, void *digest);
+void hmac_key_sha256(const hmac_key_t *hkey, const void *message, size_t size, void *digest);
+
 #endif
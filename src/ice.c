@@ -18,6 +18,7 @@
 
 #include "ice.h"
 #include "random.h"
+#include "resolver.h"
 
 #include <assert.h>
 #include <ctype.h>
@@ -27,6 +28,9 @@
 
 #define BUFFER_SIZE 1024
 
+#define ICE_INITIAL_CANDIDATES_CAPACITY 4
+#define ICE_CANDIDATES_BLOCK_SIZE (4 * sizeof(ice_candidate_t))
+
 #define CLAMP(x, low, high) (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
 
 // See RFC4566 for SDP format: https://tools.ietf.org/html/rfc4566
@@ -105,8 +109,27 @@ static int parse_sdp_candidate(const char *line, ice_candidate_t *candidate,
 	return 0;
 }
 
-int ice_parse_sdp(const char *sdp, ice_description_t *description, juice_logger_t *logger) {
+void ice_init_description(ice_description_t *description) {
 	memset(description, 0, sizeof(*description));
+	description->candidates = NULL;
+	description->candidates_count = 0;
+	description->candidates_capacity = 0;
+	description->finished = false;
+	arena_init(&description->arena, ICE_CANDIDATES_BLOCK_SIZE);
+}
+
+void ice_destroy_description(ice_description_t *description) {
+	free(description->candidates);
+	description->candidates = NULL;
+	description->candidates_count = 0;
+	description->candidates_capacity = 0;
+	arena_destroy(&description->arena);
+}
+
+int ice_parse_sdp(const char *sdp, ice_description_t *description, juice_logger_t *logger) {
+	// Previous candidates stay allocated in the arena until the description is destroyed
+	memset(description->ice_ufrag, 0, sizeof(description->ice_ufrag));
+	memset(description->ice_pwd, 0, sizeof(description->ice_pwd));
 	description->candidates_count = 0;
 	description->finished = false;
 
@@ -145,11 +168,9 @@ int ice_parse_candidate_sdp(const char *line, ice_candidate_t *candidate, juice_
 }
 
 int ice_create_local_description(ice_description_t *description, juice_logger_t *logger) {
-	memset(description, 0, sizeof(*description));
+	ice_init_description(description);
 	juice_random_str64(description->ice_ufrag, 4 + 1, logger);
 	juice_random_str64(description->ice_pwd, 22 + 1, logger);
-	description->candidates_count = 0;
-	description->finished = false;
 	JLOG_DEBUG(logger, "Created local description: ufrag=\"%s\", pwd=\"%s\"",
 	           description->ice_ufrag, description->ice_pwd);
 	return 0;
@@ -177,14 +198,25 @@ int ice_create_local_candidate(ice_candidate_type_t type, int component,
 
 int ice_resolve_candidate(ice_candidate_t *candidate, ice_resolve_mode_t mode,
                           juice_logger_t *logger) {
+	if (mode == ICE_RESOLVE_MODE_LOOKUP) {
+		// Go through the process-wide cache
+		addr_record_t record;
+		if (resolver_resolve(candidate->hostname, candidate->service, &record, 1, logger) <= 0) {
+			JLOG_INFO(logger, "Failed to resolve address: %s:%s", candidate->hostname,
+			          candidate->service);
+			candidate->resolved.len = 0;
+			return -1;
+		}
+		candidate->resolved = record;
+		return 0;
+	}
+
 	struct addrinfo hints;
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_DGRAM;
 	hints.ai_protocol = IPPROTO_UDP;
-	hints.ai_flags = AI_ADDRCONFIG;
-	if (mode != ICE_RESOLVE_MODE_LOOKUP)
-		hints.ai_flags |= AI_NUMERICHOST | AI_NUMERICSERV;
+	hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICHOST | AI_NUMERICSERV;
 	struct addrinfo *ai_list = NULL;
 	if (getaddrinfo(candidate->hostname, candidate->service, &hints, &ai_list)) {
 		JLOG_INFO(logger, "Failed to resolve address: %s:%s", candidate->hostname,
@@ -213,44 +245,59 @@ int ice_add_candidate(ice_candidate_t *candidate, ice_description_t *description
 		return -1;
 	}
 
+	if (description->candidates_count == description->candidates_capacity) {
+		int capacity = description->candidates_capacity ? description->candidates_capacity * 2
+		                                                : ICE_INITIAL_CANDIDATES_CAPACITY;
+		ice_candidate_t **candidates =
+		    realloc(description->candidates, capacity * sizeof(ice_candidate_t *));
+		if (!candidates) {
+			JLOG_ERROR(logger, "realloc for candidates failed");
+			return -1;
+		}
+		description->candidates = candidates;
+		description->candidates_capacity = capacity;
+	}
+
+	ice_candidate_t *pos = arena_alloc(&description->arena, sizeof(ice_candidate_t));
+	if (!pos) {
+		JLOG_ERROR(logger, "alloc for candidate failed");
+		return -1;
+	}
+
 	if (strcmp(candidate->foundation, "-") == 0)
 		snprintf(candidate->foundation, 32, "%u",
 		         (unsigned int)(description->candidates_count + 1));
 
-	ice_candidate_t *pos = description->candidates + description->candidates_count;
 	*pos = *candidate;
+	description->candidates[description->candidates_count] = pos;
 	++description->candidates_count;
 	return 0;
 }
 
 void ice_sort_candidates(ice_description_t *description) {
 	// In-place insertion sort
-	ice_candidate_t *begin = description->candidates;
-	ice_candidate_t *end = begin + description->candidates_count;
-	ice_candidate_t *cur = begin;
+	ice_candidate_t **begin = description->candidates;
+	ice_candidate_t **end = begin + description->candidates_count;
+	ice_candidate_t **cur = begin;
 	while (++cur < end) {
-		uint32_t priority = cur->priority;
-		ice_candidate_t *prev = cur;
-		ice_candidate_t tmp = *prev;
-		while (--prev >= begin && prev->priority < priority) {
+		ice_candidate_t *tmp = *cur;
+		ice_candidate_t **prev = cur;
+		while (--prev >= begin && (*prev)->priority < tmp->priority) {
 			*(prev + 1) = *prev;
 		}
-		if (prev + 1 != cur)
-			*(prev + 1) = tmp;
+		*(prev + 1) = tmp;
 	}
 }
 
 ice_candidate_t *ice_find_candidate_from_addr(ice_description_t *description,
                                               const addr_record_t *record,
                                               ice_candidate_type_t type) {
-	ice_candidate_t *cur = description->candidates;
-	ice_candidate_t *end = cur + description->candidates_count;
-	while (cur != end) {
+	for (int i = 0; i < description->candidates_count; ++i) {
+		ice_candidate_t *cur = description->candidates[i];
 		if ((type == ICE_CANDIDATE_TYPE_UNKNOWN || cur->type == type) &&
 		    addr_is_equal((struct sockaddr *)&record->addr, (struct sockaddr *)&cur->resolved.addr,
 		                  true))
 			return cur;
-		++cur;
 	}
 	return NULL;
 }
@@ -273,7 +320,7 @@ int ice_generate_sdp(const ice_description_t *description, char *buffer, size_t
 			ret = snprintf(begin, end - begin, "a=ice-ufrag:%s\r\na=ice-pwd:%s\r\n",
 			               description->ice_ufrag, description->ice_pwd);
 		} else if (i < description->candidates_count + 1) {
-			const ice_candidate_t *candidate = description->candidates + i - 1;
+			const ice_candidate_t *candidate = description->candidates[i - 1];
 			if (candidate->type == ICE_CANDIDATE_TYPE_UNKNOWN ||
 			    candidate->type == ICE_CANDIDATE_TYPE_PEER_REFLEXIVE)
 				continue;
@@ -365,7 +412,7 @@ int ice_update_candidate_pair(ice_candidate_pair_t *pair, bool is_controlling) {
 int ice_candidates_count(const ice_description_t *description, ice_candidate_type_t type) {
 	int count = 0;
 	for (int i = 0; i < description->candidates_count; ++i) {
-		const ice_candidate_t *candidate = description->candidates + i;
+		const ice_candidate_t *candidate = description->candidates[i];
 		if (candidate->type == type)
 			++count;
 	}
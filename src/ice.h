@@ -20,14 +20,14 @@
 #define JUICE_ICE_H
 
 #include "addr.h"
+#include "arena.h"
 #include "juice.h"
 #include "log.h"
+#include "timestamp.h"
 
 #include <stdbool.h>
 #include <stdint.h>
 
-#define ICE_MAX_CANDIDATES_COUNT 20 // ~ 500B * 20 = 10KB
-
 typedef enum ice_candidate_type {
 	ICE_CANDIDATE_TYPE_UNKNOWN,
 	ICE_CANDIDATE_TYPE_HOST,
@@ -48,18 +48,22 @@ typedef struct ice_candidate {
 	uint32_t priority;
 	int component;
 	char foundation[32 + 1]; // 1 to 32 characters
-	char transport[32 + 1];
 	char hostname[256 + 1];
 	char service[32 + 1];
 	addr_record_t resolved;
 } ice_candidate_t;
 
+// Max candidates in a description, bounds the memory a remote peer may use
+#define ICE_MAX_CANDIDATES_COUNT 32
+
 typedef struct ice_description {
 	char ice_ufrag[256 + 1]; // 4 to 256 characters
 	char ice_pwd[256 + 1];   // 22 to 256 characters
-	ice_candidate_t candidates[ICE_MAX_CANDIDATES_COUNT];
+	ice_candidate_t **candidates; // candidates are allocated in the arena and never move
 	int candidates_count;
+	int candidates_capacity;
 	bool finished;
+	arena_t arena;
 } ice_description_t;
 
 typedef enum ice_candidate_pair_state {
@@ -76,6 +80,10 @@ typedef struct ice_candidate_pair {
 	ice_candidate_pair_state_t state;
 	bool nominated;
 	bool nomination_requested;
+	timediff_t rtt;     // smoothed RTT in usecs, 0 if not measured
+	timediff_t min_rtt; // usecs, 0 if not measured
+	timediff_t rtt_sum; // usecs, sum of samples
+	int rtt_count;      // count of samples
 } ice_candidate_pair_t;
 
 typedef enum ice_resolve_mode {
@@ -86,6 +94,8 @@ typedef enum ice_resolve_mode {
 #define ICE_PARSE_ERROR -1
 #define ICE_PARSE_IGNORED -2
 
+void ice_init_description(ice_description_t *description);
+void ice_destroy_description(ice_description_t *description);
 int ice_parse_sdp(const char *sdp, ice_description_t *description, juice_logger_t *logger);
 int ice_parse_candidate_sdp(const char *line, ice_candidate_t *candidate, juice_logger_t *logger);
 int ice_create_local_description(ice_description_t *description, juice_logger_t *logger);
@@ -19,12 +19,15 @@
 #include "juice.h"
 #include "agent.h"
 #include "ice.h"
+#include "resolver.h"
+#include "turn_pool.h"
 
 #ifndef NO_SERVER
 #include "server.h"
 #endif
 
 #include <stdio.h>
+#include <string.h>
 
 JUICE_EXPORT juice_agent_t *juice_create(const juice_config_t *config) {
 	if (!config)
@@ -88,6 +91,16 @@ JUICE_EXPORT int juice_set_remote_gathering_done(juice_agent_t *agent) {
 	return JUICE_ERR_SUCCESS;
 }
 
+JUICE_EXPORT int juice_restart_ice(juice_agent_t *agent) {
+	if (!agent)
+		return JUICE_ERR_INVALID;
+
+	if (agent_restart_ice(agent) < 0)
+		return JUICE_ERR_FAILED;
+
+	return JUICE_ERR_SUCCESS;
+}
+
 JUICE_EXPORT int juice_send(juice_agent_t *agent, const char *data, size_t size) {
 	if (!agent || (!data && size))
 		return JUICE_ERR_INVALID;
@@ -149,6 +162,25 @@ JUICE_EXPORT int juice_get_selected_addresses(juice_agent_t *agent, char *local,
 	return JUICE_ERR_SUCCESS;
 }
 
+JUICE_EXPORT int juice_get_selected_rtt(juice_agent_t *agent, int64_t *rtt_us,
+                                        int64_t *min_rtt_us) {
+	if (!agent)
+		return JUICE_ERR_INVALID;
+
+	if (agent_get_selected_rtt(agent, rtt_us, min_rtt_us))
+		return JUICE_ERR_NOT_AVAIL;
+
+	return JUICE_ERR_SUCCESS;
+}
+
+JUICE_EXPORT int juice_get_stats(juice_agent_t *agent, juice_agent_stats_t *stats) {
+	if (!agent || !stats)
+		return JUICE_ERR_INVALID;
+
+	agent_get_stats(agent, stats);
+	return JUICE_ERR_SUCCESS;
+}
+
 JUICE_EXPORT const char *juice_state_to_string(juice_state_t state) {
 	switch (state) {
 	case JUICE_STATE_DISCONNECTED:
@@ -168,6 +200,54 @@ JUICE_EXPORT const char *juice_state_to_string(juice_state_t state) {
 	}
 }
 
+JUICE_EXPORT void juice_set_timing_preset(juice_timing_config_t *timing,
+                                          juice_timing_preset_t preset) {
+	if (!timing)
+		return;
+
+	memset(timing, 0, sizeof(*timing)); // defaults
+	switch (preset) {
+	case JUICE_TIMING_PRESET_DATACENTER:
+		timing->pacing_time = MIN_STUN_PACING_TIME;
+		timing->retransmission_timeout = 100;
+		timing->min_retransmission_timeout = 20;
+		timing->fail_timeout = 5000;
+		timing->failover_timeout = 500;
+		break;
+	case JUICE_TIMING_PRESET_MOBILE:
+		timing->retransmission_timeout = 1000;
+		timing->max_retransmissions = 6;
+		timing->fail_timeout = 45000;
+		timing->failover_timeout = 3000;
+		break;
+	default:
+		break;
+	}
+}
+
+JUICE_EXPORT int juice_prefetch_address(const char *hostname, uint16_t port) {
+	if (!hostname)
+		return JUICE_ERR_INVALID;
+
+	char service[8];
+	snprintf(service, 8, "%hu", port ? port : 3478);
+	if (resolver_prefetch(hostname, service) < 0)
+		return JUICE_ERR_FAILED;
+
+	return JUICE_ERR_SUCCESS;
+}
+
+JUICE_EXPORT int juice_prewarm_turn_allocations(const juice_turn_server_t *turn_server, int count) {
+	if (!turn_server || !turn_server->host || !turn_server->username || !turn_server->password ||
+	    count < 0)
+		return JUICE_ERR_INVALID;
+
+	if (turn_pool_prewarm(turn_server, count) < 0)
+		return JUICE_ERR_FAILED;
+
+	return JUICE_ERR_SUCCESS;
+}
+
 JUICE_EXPORT juice_server_t *juice_server_create(const juice_server_config_t *config) {
 #ifndef NO_SERVER
 	if (!config)
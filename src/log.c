@@ -19,32 +19,32 @@
 #include "log.h"
 #include "agent.h"
 #include "thread.h" // for mutexes
+#include "timestamp.h"
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-#ifndef NO_ATOMICS
-#include <stdatomic.h>
-#endif
-
 #ifndef _WIN32
+#include <sched.h>
 #include <unistd.h>
 #endif
 
 #define BUFFER_SIZE 4096
 
-struct juice_logger {
-	mutex_t log_mutex;
-	volatile juice_log_cb_t log_cb;
-	void *user_ptr;
+// Lines written to stdout are passed to a background writer thread when possible
+#if !defined(NO_ATOMICS) && !defined(_WIN32)
+#define USE_ASYNC_WRITER
+#endif
+
+#define ASYNC_RING_SIZE 128    // must be a power of 2
+#define ASYNC_MESSAGE_SIZE 512 // longer messages are written synchronously
+
 #ifdef NO_ATOMICS
-	volatile juice_log_level_t log_level;
-#else
-	_Atomic(juice_log_level_t) log_level;
+static mutex_t limit_mutex = MUTEX_INITIALIZER;
 #endif
-};
 
 static const char *log_level_names[] = {"VERBOSE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
 
@@ -65,6 +65,183 @@ static bool use_color(void) {
 #endif
 }
 
+static const char *get_filename(const char *file) {
+	const char *filename = file + strlen(file);
+	while (filename != file && *filename != '/' && *filename != '\\')
+		--filename;
+	if (filename != file)
+		++filename;
+
+	return filename;
+}
+
+static void write_line(juice_log_level_t level, time_t t, const char *file, int line,
+                       const char *message) {
+	struct tm lt;
+#ifdef _WIN32
+	localtime_s(&lt, &t);
+#else
+	localtime_r(&t, &lt);
+#endif
+	char buffer[16];
+	if (strftime(buffer, 16, "%H:%M:%S", &lt) == 0)
+		buffer[0] = '\0';
+
+	bool color = use_color();
+	fprintf(stdout, "%s%s %-7s %s:%d: %s%s\n", color ? log_level_colors[level] : "", buffer,
+	        log_level_names[level], get_filename(file), line, message,
+	        color ? "\x1B[0m\x1B[0K" : "");
+}
+
+#ifdef USE_ASYNC_WRITER
+
+// Bounded multi-producer single-consumer ring, each slot carries a sequence number which tells
+// whether it is free for the producer at this position or ready for the consumer
+typedef struct async_entry {
+	_Atomic(unsigned int) sequence;
+	juice_log_level_t level;
+	time_t time;
+	const char *file; // __FILE__ literal
+	int line;
+	char message[ASYNC_MESSAGE_SIZE];
+} async_entry_t;
+
+static async_entry_t async_ring[ASYNC_RING_SIZE];
+static _Atomic(unsigned int) async_enqueue_pos;
+static unsigned int async_dequeue_pos; // guarded by async_mutex
+static _Atomic(bool) async_waiting;
+static mutex_t async_mutex = MUTEX_INITIALIZER;
+static pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t async_once = PTHREAD_ONCE_INIT;
+static bool async_running = false;
+
+static bool async_pending(void) {
+	const async_entry_t *entry = async_ring + (async_dequeue_pos & (ASYNC_RING_SIZE - 1));
+	return atomic_load(&entry->sequence) == async_dequeue_pos + 1;
+}
+
+// Must be called with async_mutex locked
+static void async_drain(void) {
+	bool written = false;
+	while (async_pending()) {
+		async_entry_t *entry = async_ring + (async_dequeue_pos & (ASYNC_RING_SIZE - 1));
+		write_line(entry->level, entry->time, entry->file, entry->line, entry->message);
+		atomic_store(&entry->sequence, async_dequeue_pos + ASYNC_RING_SIZE);
+		++async_dequeue_pos;
+		written = true;
+	}
+	if (written)
+		fflush(stdout);
+}
+
+// Must be called with async_mutex locked, waits for entries being written by producers
+static void async_drain_until(unsigned int end) {
+	while ((int)(end - async_dequeue_pos) > 0) {
+		async_drain();
+		if (!async_pending())
+			sched_yield();
+	}
+}
+
+static thread_return_t THREAD_CALL async_thread_entry(void *arg) {
+	(void)arg;
+	mutex_lock(&async_mutex);
+	while (true) {
+		async_drain();
+
+		// Producers only signal when the flag is set, so check again before sleeping
+		atomic_store(&async_waiting, true);
+		if (async_pending()) {
+			atomic_store(&async_waiting, false);
+			continue;
+		}
+		pthread_cond_wait(&async_cond, &async_mutex);
+	}
+	mutex_unlock(&async_mutex);
+	return (thread_return_t)0;
+}
+
+static void async_flush(void) {
+	mutex_lock(&async_mutex);
+	async_drain();
+	mutex_unlock(&async_mutex);
+}
+
+static void async_start(void) {
+	for (unsigned int i = 0; i < ASYNC_RING_SIZE; ++i)
+		atomic_init(&async_ring[i].sequence, i);
+
+	thread_t thread;
+	if (thread_init(&thread, async_thread_entry, NULL) != 0)
+		return; // messages will be written synchronously
+
+	thread_detach(thread);
+	atexit(async_flush);
+	async_running = true;
+}
+
+static bool async_push(juice_log_level_t level, const char *file, int line, const char *message,
+                       size_t len) {
+	if (len >= ASYNC_MESSAGE_SIZE)
+		return false;
+
+	unsigned int pos = atomic_load(&async_enqueue_pos);
+	async_entry_t *entry;
+	while (true) {
+		entry = async_ring + (pos & (ASYNC_RING_SIZE - 1));
+		int diff = (int)(atomic_load(&entry->sequence) - pos);
+		if (diff == 0) {
+			// On failure, pos is updated to the current value
+			if (atomic_compare_exchange_weak(&async_enqueue_pos, &pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			return false; // full
+		} else {
+			pos = atomic_load(&async_enqueue_pos);
+		}
+	}
+
+	entry->level = level;
+	entry->time = time(NULL);
+	entry->file = file;
+	entry->line = line;
+	memcpy(entry->message, message, len + 1);
+	atomic_store(&entry->sequence, pos + 1);
+
+	if (atomic_exchange(&async_waiting, false)) {
+		mutex_lock(&async_mutex);
+		pthread_cond_signal(&async_cond);
+		mutex_unlock(&async_mutex);
+	}
+	return true;
+}
+
+#endif // USE_ASYNC_WRITER
+
+static void write_stdout(juice_log_level_t level, const char *file, int line, const char *message,
+                         size_t len) {
+#ifdef USE_ASYNC_WRITER
+	pthread_once(&async_once, async_start);
+	if (async_running) {
+		// Errors are written synchronously so they are not lost on abort
+		if (level < JUICE_LOG_LEVEL_ERROR && async_push(level, file, line, message, len))
+			return;
+
+		// Keep ordering with queued lines
+		mutex_lock(&async_mutex);
+		async_drain_until(atomic_load(&async_enqueue_pos));
+		write_line(level, time(NULL), file, line, message);
+		fflush(stdout);
+		mutex_unlock(&async_mutex);
+		return;
+	}
+#else
+	(void)len;
+#endif
+	write_line(level, time(NULL), file, line, message);
+	fflush(stdout);
+}
+
 JUICE_EXPORT juice_logger_t *juice_logger_create(const juice_log_config_t *config) {
 	juice_logger_t *logger = calloc(1, sizeof(juice_logger_t));
 
@@ -99,61 +276,118 @@ void juice_logger_set_log_level(juice_logger_t *logger, juice_log_level_t level)
 #endif
 }
 
-void juice_log_write(juice_logger_t *logger, juice_log_level_t level, const char *file, int line,
-                     const char *fmt, ...) {
-#ifdef NO_ATOMICS
+static void log_vwrite(juice_logger_t *logger, juice_log_level_t level, const char *file, int line,
+                       unsigned int suppressed, const char *fmt, va_list args) {
+	// Format on the calling thread as the arguments might not outlive the call
+	char message[BUFFER_SIZE];
+	int len = vsnprintf(message, BUFFER_SIZE, fmt, args);
+	if (len < 0)
+		return;
+	if (len >= BUFFER_SIZE)
+		len = BUFFER_SIZE - 1;
+
+	if (suppressed > 0) {
+		int ret = snprintf(message + len, BUFFER_SIZE - len,
+		                   " (%u similar messages suppressed)", suppressed);
+		if (ret > 0)
+			len = len + ret < BUFFER_SIZE ? len + ret : BUFFER_SIZE - 1;
+	}
+
 	mutex_lock(&logger->log_mutex);
-	if (level < logger->log_level) {
+	if (logger->log_cb) {
+		char buffer[BUFFER_SIZE];
+		if (snprintf(buffer, BUFFER_SIZE, "%s:%d: %s", get_filename(file), line, message) >= 0)
+			logger->log_cb(level, buffer, logger->user_ptr);
+
 		mutex_unlock(&logger->log_mutex);
 		return;
 	}
-#else
-	if (level < atomic_load(&logger->log_level) || level == JUICE_LOG_LEVEL_NONE)
+	mutex_unlock(&logger->log_mutex);
+
+	write_stdout(level, file, line, message, (size_t)len);
+}
+
+void juice_log_write(juice_logger_t *logger, juice_log_level_t level, const char *file, int line,
+                     const char *fmt, ...) {
+	if (!juice_log_is_enabled(logger, level))
 		return;
 
-	mutex_lock(&logger->log_mutex);
-#endif
+	va_list args;
+	va_start(args, fmt);
+	log_vwrite(logger, level, file, line, 0, fmt, args);
+	va_end(args);
+}
 
-	const char *filename = file + strlen(file);
-	while (filename != file && *filename != '/' && *filename != '\\')
-		--filename;
-	if (filename != file)
-		++filename;
+// Returns the number of tokens earned since the refill timestamp and sets the next one
+static unsigned int get_limit_refill(timestamp_t now, timestamp_t refill_timestamp,
+                                     timestamp_t *next_timestamp) {
+	timediff_t count = refill_timestamp ? (now - refill_timestamp) / JUICE_LOG_LIMIT_PERIOD
+	                                    : JUICE_LOG_LIMIT_BURST;
+	if (count <= 0)
+		return 0;
 
-	if (logger->log_cb) {
-		char message[BUFFER_SIZE];
-		int len = snprintf(message, BUFFER_SIZE, "%s:%d: ", filename, line);
-		len = len >= 0 ? len : 0;
-
-		va_list args;
-		va_start(args, fmt);
-		len = vsnprintf(message + len, BUFFER_SIZE - len, fmt, args);
-		va_end(args);
-
-		if (len >= 0)
-			logger->log_cb(level, message, logger->user_ptr);
-	} else {
-		time_t t = time(NULL);
-		struct tm *lt = localtime(&t);
-		char buffer[16];
-		if (strftime(buffer, 16, "%H:%M:%S", lt) == 0)
-			buffer[0] = '\0';
-
-		if (use_color())
-			fprintf(stdout, "%s", log_level_colors[level]);
-
-		fprintf(stdout, "%s %-7s %s:%d: ", buffer, log_level_names[level], filename, line);
-
-		va_list args;
-		va_start(args, fmt);
-		vfprintf(stdout, fmt, args);
-		va_end(args);
-
-		if (use_color())
-			fprintf(stdout, "%s", "\x1B[0m\x1B[0K");
-
-		fprintf(stdout, "\n");
-		fflush(stdout);
+	if (count >= JUICE_LOG_LIMIT_BURST) {
+		*next_timestamp = now;
+		return JUICE_LOG_LIMIT_BURST;
 	}
-	mutex_unlock(&logger->log_mutex);
+
+	*next_timestamp = refill_timestamp + count * JUICE_LOG_LIMIT_PERIOD;
+	return (unsigned int)count;
+}
+
+void juice_log_write_limited(juice_logger_t *logger, juice_log_limit_t *limit,
+                             juice_log_level_t level, const char *file, int line, const char *fmt,
+                             ...) {
+	if (!juice_log_is_enabled(logger, level))
+		return;
+
+	timestamp_t now = cached_timestamp();
+	timestamp_t next_timestamp;
+#ifdef NO_ATOMICS
+	mutex_lock(&limit_mutex);
+	unsigned int count = get_limit_refill(now, limit->refill_timestamp, &next_timestamp);
+	if (count > 0) {
+		limit->refill_timestamp = next_timestamp;
+		limit->tokens = limit->tokens + count < JUICE_LOG_LIMIT_BURST ? limit->tokens + count
+		                                                              : JUICE_LOG_LIMIT_BURST;
+	}
+	if (limit->tokens == 0) {
+		++limit->suppressed;
+		mutex_unlock(&limit_mutex);
+		return;
+	}
+	--limit->tokens;
+	unsigned int suppressed = limit->suppressed;
+	limit->suppressed = 0;
+	mutex_unlock(&limit_mutex);
+#else
+	// Only the thread advancing the refill timestamp adds the earned tokens
+	timestamp_t refill_timestamp = atomic_load(&limit->refill_timestamp);
+	unsigned int count = get_limit_refill(now, refill_timestamp, &next_timestamp);
+	if (count > 0 && atomic_compare_exchange_strong(&limit->refill_timestamp, &refill_timestamp,
+	                                                next_timestamp)) {
+		unsigned int tokens = atomic_load(&limit->tokens);
+		unsigned int refilled;
+		do {
+			refilled = tokens + count < JUICE_LOG_LIMIT_BURST ? tokens + count
+			                                                  : JUICE_LOG_LIMIT_BURST;
+		} while (!atomic_compare_exchange_weak(&limit->tokens, &tokens, refilled));
+	}
+
+	// Suppressed messages cost a single atomic increment
+	unsigned int tokens = atomic_load(&limit->tokens);
+	do {
+		if (tokens == 0) {
+			atomic_fetch_add(&limit->suppressed, 1);
+			return;
+		}
+	} while (!atomic_compare_exchange_weak(&limit->tokens, &tokens, tokens - 1));
+
+	unsigned int suppressed = atomic_exchange(&limit->suppressed, 0);
+#endif
+
+	va_list args;
+	va_start(args, fmt);
+	log_vwrite(logger, level, file, line, suppressed, fmt, args);
+	va_end(args);
 }
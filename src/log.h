@@ -21,31 +21,136 @@
 
 #include "juice.h"
 #include "thread.h"
+#include "timestamp.h"
 
 #include <stdarg.h>
+#include <stdbool.h>
+
+#ifdef __STDC_NO_ATOMICS__
+#define NO_ATOMICS
+#endif
+
+#ifndef NO_ATOMICS
+#include <stdatomic.h>
+#endif
+
+// Messages below this level are removed at compile time, from 0 (VERBOSE) to 6 (NONE)
+#ifndef JUICE_MIN_LOG_LEVEL
+#define JUICE_MIN_LOG_LEVEL 0
+#endif
+
+#define JUICE_LOG_LIMIT_BURST 10     // messages logged before rate limiting
+#define JUICE_LOG_LIMIT_PERIOD 1000  // msecs to earn one more message
 
 typedef struct juice_logger juice_logger_t;
 
+// Token bucket for a rate-limited call site, updated without locking if atomics are available
+typedef struct juice_log_limit {
+#ifdef NO_ATOMICS
+	unsigned int tokens;
+	unsigned int suppressed;
+	timestamp_t refill_timestamp; // 0 if not started
+#else
+	atomic_uint tokens;
+	atomic_uint suppressed;
+	_Atomic(timestamp_t) refill_timestamp; // 0 if not started
+#endif
+} juice_log_limit_t;
+
+// Defined here so the level check is inlined at call sites
+struct juice_logger {
+	mutex_t log_mutex;
+	volatile juice_log_cb_t log_cb;
+	void *user_ptr;
+#ifdef NO_ATOMICS
+	volatile juice_log_level_t log_level;
+#else
+	_Atomic(juice_log_level_t) log_level;
+#endif
+};
+
 // Export for tests
 JUICE_EXPORT juice_logger_t *juice_logger_create(const juice_log_config_t *config);
 JUICE_EXPORT void juice_logger_destroy(juice_logger_t *logger);
 
 void juice_logger_set_log_level(juice_logger_t *logger, juice_log_level_t level);
 
+static inline bool juice_log_is_enabled(juice_logger_t *logger, juice_log_level_t level) {
+#ifdef NO_ATOMICS
+	juice_log_level_t log_level = logger->log_level;
+#else
+	juice_log_level_t log_level =
+	    atomic_load_explicit(&logger->log_level, memory_order_relaxed);
+#endif
+	return level >= log_level && level != JUICE_LOG_LEVEL_NONE;
+}
+
 void juice_log_write(juice_logger_t *logger, juice_log_level_t level, const char *file, int line,
                      const char *fmt, ...);
+void juice_log_write_limited(juice_logger_t *logger, juice_log_limit_t *limit,
+                             juice_log_level_t level, const char *file, int line, const char *fmt,
+                             ...);
+
+// Arguments are only evaluated if the level is enabled
+#define JLOG_WRITE(logger, level, ...)                                                             \
+	(juice_log_is_enabled(logger, level)                                                           \
+	     ? juice_log_write(logger, level, __FILE__, __LINE__, __VA_ARGS__)                         \
+	     : (void)0)
+
+// For messages which may be triggered by every datagram, the bucket is shared by all loggers and
+// the number of suppressed messages is reported with the next message logged
+#define JLOG_LIMITED(logger, level, ...)                                                           \
+	do {                                                                                           \
+		static juice_log_limit_t juice_log_limit;                                                  \
+		if (juice_log_is_enabled(logger, level))                                                   \
+			juice_log_write_limited(logger, &juice_log_limit, level, __FILE__, __LINE__,           \
+			                        __VA_ARGS__);                                                  \
+	} while (0)
+
+// Stripped messages still reference their arguments to avoid unused variable warnings
+#define JLOG_STRIPPED(logger, level, ...)                                                          \
+	((void)(0 ? juice_log_write(logger, level, __FILE__, __LINE__, __VA_ARGS__) : (void)0))
+
+#if JUICE_MIN_LOG_LEVEL <= 0
+#define JLOG_VERBOSE(logger, ...) JLOG_WRITE(logger, JUICE_LOG_LEVEL_VERBOSE, __VA_ARGS__)
+#else
+#define JLOG_VERBOSE(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_VERBOSE, __VA_ARGS__)
+#endif
+
+#if JUICE_MIN_LOG_LEVEL <= 1
+#define JLOG_DEBUG(logger, ...) JLOG_WRITE(logger, JUICE_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define JLOG_DEBUG(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+
+#if JUICE_MIN_LOG_LEVEL <= 2
+#define JLOG_INFO(logger, ...) JLOG_WRITE(logger, JUICE_LOG_LEVEL_INFO, __VA_ARGS__)
+#define JLOG_INFO_LIMITED(logger, ...) JLOG_LIMITED(logger, JUICE_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define JLOG_INFO(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_INFO, __VA_ARGS__)
+#define JLOG_INFO_LIMITED(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_INFO, __VA_ARGS__)
+#endif
+
+#if JUICE_MIN_LOG_LEVEL <= 3
+#define JLOG_WARN(logger, ...) JLOG_WRITE(logger, JUICE_LOG_LEVEL_WARN, __VA_ARGS__)
+#define JLOG_WARN_LIMITED(logger, ...) JLOG_LIMITED(logger, JUICE_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define JLOG_WARN(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_WARN, __VA_ARGS__)
+#define JLOG_WARN_LIMITED(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_WARN, __VA_ARGS__)
+#endif
+
+#if JUICE_MIN_LOG_LEVEL <= 4
+#define JLOG_ERROR(logger, ...) JLOG_WRITE(logger, JUICE_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define JLOG_ERROR_LIMITED(logger, ...) JLOG_LIMITED(logger, JUICE_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define JLOG_ERROR(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define JLOG_ERROR_LIMITED(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_ERROR, __VA_ARGS__)
+#endif
 
-#define JLOG_VERBOSE(logger, ...)                                                                  \
-	juice_log_write(logger, JUICE_LOG_LEVEL_VERBOSE, __FILE__, __LINE__, __VA_ARGS__)
-#define JLOG_DEBUG(logger, ...)                                                                    \
-	juice_log_write(logger, JUICE_LOG_LEVEL_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
-#define JLOG_INFO(logger, ...)                                                                     \
-	juice_log_write(logger, JUICE_LOG_LEVEL_INFO, __FILE__, __LINE__, __VA_ARGS__)
-#define JLOG_WARN(logger, ...)                                                                     \
-	juice_log_write(logger, JUICE_LOG_LEVEL_WARN, __FILE__, __LINE__, __VA_ARGS__)
-#define JLOG_ERROR(logger, ...)                                                                    \
-	juice_log_write(logger, JUICE_LOG_LEVEL_ERROR, __FILE__, __LINE__, __VA_ARGS__)
-#define JLOG_FATAL(logger, ...)                                                                    \
-	juice_log_write(logger, JUICE_LOG_LEVEL_FATAL, __FILE__, __LINE__, __VA_ARGS__)
+#if JUICE_MIN_LOG_LEVEL <= 5
+#define JLOG_FATAL(logger, ...) JLOG_WRITE(logger, JUICE_LOG_LEVEL_FATAL, __VA_ARGS__)
+#else
+#define JLOG_FATAL(logger, ...) JLOG_STRIPPED(logger, JUICE_LOG_LEVEL_FATAL, __VA_ARGS__)
+#endif
 
 #endif // JUICE_LOG_H
@@ -17,12 +17,19 @@
  */
 
 #include "random.h"
-#include "thread.h" // for mutexes
+#include "thread.h" // for mutexes and thread-local storage
 
 #include <math.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
 
+#define CHACHA20_BLOCK_SIZE 64
+#define RANDOM_KEY_SIZE 32
+#define RANDOM_BUFFER_BLOCKS 4
+#define RANDOM_BUFFER_SIZE (CHACHA20_BLOCK_SIZE * RANDOM_BUFFER_BLOCKS)
+#define RANDOM_RESEED_BYTES (1024 * 1024) // reseed from the OS after this amount of output
+
 // getrandom() is not available in Android NDK API < 28 and needs glibc >= 2.25
 #if defined(__linux__) && !defined(__ANDROID__) &&                                                 \
     (!defined(__GLIBC__) || __GLIBC__ > 2 || __GLIBC_MINOR__ >= 25)
@@ -82,10 +89,7 @@ static unsigned int generate_seed() {
 #endif
 }
 
-void juice_random(void *buf, size_t size, juice_logger_t *logger) {
-	if (random_bytes(buf, size, logger) == 0)
-		return;
-
+static void fallback_random_bytes(void *buf, size_t size, juice_logger_t *logger) {
 	// rand() is not thread-safe
 	static mutex_t rand_mutex = MUTEX_INITIALIZER;
 	mutex_lock(&rand_mutex);
@@ -116,14 +120,137 @@ void juice_random(void *buf, size_t size, juice_logger_t *logger) {
 	mutex_unlock(&rand_mutex);
 }
 
+// Per-thread ChaCha20 generator with fast key erasure: each refill generates a few blocks, the
+// first bytes of which immediately replace the key, so past output can't be recovered.
+typedef struct random_state {
+	uint32_t key[RANDOM_KEY_SIZE / 4];
+	uint8_t buffer[RANDOM_BUFFER_SIZE];
+	size_t available; // bytes available at the end of the buffer
+	size_t output;    // bytes output since the last seeding
+	unsigned int fork_generation;
+	bool seeded;
+} random_state_t;
+
+static THREAD_LOCAL random_state_t random_state;
+
+#ifndef _WIN32
+// Incremented in the child process after a fork, so inherited states are seeded again
+static unsigned int fork_generation = 0;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static void on_fork_child(void) { ++fork_generation; }
+static void register_atfork(void) { pthread_atfork(NULL, NULL, on_fork_child); }
+#endif
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define CHACHA20_QUARTER_ROUND(a, b, c, d)                                                         \
+	a += b;                                                                                        \
+	d = ROTL32(d ^ a, 16);                                                                         \
+	c += d;                                                                                        \
+	b = ROTL32(b ^ c, 12);                                                                         \
+	a += b;                                                                                        \
+	d = ROTL32(d ^ a, 8);                                                                          \
+	c += d;                                                                                        \
+	b = ROTL32(b ^ c, 7);
+
+static void chacha20_block(const uint32_t *key, uint64_t counter, uint8_t *out) {
+	static const uint32_t constants[4] = {0x61707865, 0x3320646E, 0x79622D32, 0x6B206574};
+	uint32_t input[16];
+	memcpy(input, constants, 4 * sizeof(uint32_t)); // "expand 32-byte k"
+	memcpy(input + 4, key, 8 * sizeof(uint32_t));
+	input[12] = (uint32_t)counter;
+	input[13] = (uint32_t)(counter >> 32);
+	input[14] = 0; // nonce
+	input[15] = 0;
+	uint32_t x[16];
+	memcpy(x, input, sizeof(x));
+	for (int i = 0; i < 10; ++i) {
+		CHACHA20_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+		CHACHA20_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+		CHACHA20_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+		CHACHA20_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+		CHACHA20_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+		CHACHA20_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+		CHACHA20_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+		CHACHA20_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+	}
+	for (int i = 0; i < 16; ++i) {
+		uint32_t v = x[i] + input[i];
+		out[4 * i] = (uint8_t)v;
+		out[4 * i + 1] = (uint8_t)(v >> 8);
+		out[4 * i + 2] = (uint8_t)(v >> 16);
+		out[4 * i + 3] = (uint8_t)(v >> 24);
+	}
+}
+
+static void random_refill(random_state_t *state) {
+	for (int i = 0; i < RANDOM_BUFFER_BLOCKS; ++i)
+		chacha20_block(state->key, (uint64_t)i, state->buffer + i * CHACHA20_BLOCK_SIZE);
+
+	// Rekey with the beginning of the output
+	memcpy(state->key, state->buffer, RANDOM_KEY_SIZE);
+	memset(state->buffer, 0, RANDOM_KEY_SIZE);
+	state->available = RANDOM_BUFFER_SIZE - RANDOM_KEY_SIZE;
+}
+
+static void random_seed(random_state_t *state, juice_logger_t *logger) {
+	uint8_t seed[RANDOM_KEY_SIZE];
+	if (random_bytes(seed, RANDOM_KEY_SIZE, logger) < 0)
+		fallback_random_bytes(seed, RANDOM_KEY_SIZE, logger);
+
+	// Mix the seed into the current key, so a failing source never makes the state worse
+	uint8_t *key = (uint8_t *)state->key;
+	for (int i = 0; i < RANDOM_KEY_SIZE; ++i)
+		key[i] ^= seed[i];
+
+	memset(seed, 0, RANDOM_KEY_SIZE);
+
+#ifndef _WIN32
+	pthread_once(&atfork_once, register_atfork);
+	state->fork_generation = fork_generation;
+#endif
+	state->output = 0;
+	state->seeded = true;
+	random_refill(state);
+}
+
+void juice_random(void *buf, size_t size, juice_logger_t *logger) {
+	random_state_t *state = &random_state;
+#ifndef _WIN32
+	bool forked = state->fork_generation != fork_generation;
+#else
+	bool forked = false;
+#endif
+	if (!state->seeded || forked || state->output >= RANDOM_RESEED_BYTES)
+		random_seed(state, logger);
+
+	uint8_t *bytes = buf;
+	state->output += size;
+	while (size > 0) {
+		if (state->available == 0)
+			random_refill(state);
+
+		size_t len = size < state->available ? size : state->available;
+		uint8_t *pos = state->buffer + RANDOM_BUFFER_SIZE - state->available;
+		memcpy(bytes, pos, len);
+		memset(pos, 0, len); // never output the same bytes twice
+		state->available -= len;
+		bytes += len;
+		size -= len;
+	}
+}
+
 void juice_random_str64(char *buf, size_t size, juice_logger_t *logger) {
 	static const char chars64[] =
 	    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 	size_t i = 0;
-	for (i = 0; i + 1 < size; ++i) {
-		uint8_t byte = 0;
-		juice_random(&byte, 1, logger);
-		buf[i] = chars64[byte & 0x3F];
+	while (i + 1 < size) {
+		uint8_t bytes[64];
+		size_t len = size - 1 - i < 64 ? size - 1 - i : 64;
+		juice_random(bytes, len, logger);
+		for (size_t j = 0; j < len; ++j)
+			buf[i++] = chars64[bytes[j] & 0x3F];
 	}
 	buf[i] = '\0';
 }
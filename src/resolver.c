@@ -0,0 +1,311 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "resolver.h"
+#include "socket.h"
+#include "thread.h"
+#include "timestamp.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct resolver_request {
+	char *hostname;
+	char *service;
+	resolver_callback_t callback;
+	void *user_ptr;
+	bool done;
+	bool released;
+	bool prefetch; // resolve even if released, only to fill the cache
+	addr_record_t records[RESOLVER_MAX_RECORDS_COUNT];
+	int records_count;
+	resolver_request_t *next; // next in queue
+};
+
+typedef struct resolver_cache_entry {
+	char hostname[RESOLVER_MAX_HOSTNAME_LEN];
+	char service[RESOLVER_MAX_SERVICE_LEN];
+	addr_record_t records[RESOLVER_MAX_RECORDS_COUNT];
+	int records_count; // negative if resolution failed
+	timestamp_t expiry; // 0 if unused
+} resolver_cache_entry_t;
+
+static mutex_t resolver_mutex = MUTEX_INITIALIZER;
+static resolver_request_t *queue_head = NULL;
+static resolver_request_t *queue_tail = NULL;
+static int threads_count = 0;
+static resolver_cache_entry_t cache[RESOLVER_CACHE_SIZE];
+
+static char *alloc_string_copy(const char *orig) {
+	char *copy = malloc(strlen(orig) + 1);
+	if (copy)
+		strcpy(copy, orig);
+	return copy;
+}
+
+static void request_free(resolver_request_t *request) {
+	free(request->hostname);
+	free(request->service);
+	free(request);
+}
+
+// Must be called with the mutex locked
+static int cache_lookup(const char *hostname, const char *service, addr_record_t *records,
+                        size_t count) {
+	timestamp_t now = current_timestamp();
+	for (int i = 0; i < RESOLVER_CACHE_SIZE; ++i) {
+		resolver_cache_entry_t *entry = cache + i;
+		if (entry->expiry > now && strcmp(entry->hostname, hostname) == 0 &&
+		    strcmp(entry->service, service) == 0) {
+			if (entry->records_count > 0) {
+				size_t n = (size_t)entry->records_count < count ? (size_t)entry->records_count
+				                                                 : count;
+				memcpy(records, entry->records, n * sizeof(addr_record_t));
+			}
+			return entry->records_count;
+		}
+	}
+	return RESOLVER_PENDING;
+}
+
+// Must be called with the mutex locked
+static void cache_store(const char *hostname, const char *service, const addr_record_t *records,
+                        int records_count) {
+	if (strlen(hostname) >= RESOLVER_MAX_HOSTNAME_LEN ||
+	    strlen(service) >= RESOLVER_MAX_SERVICE_LEN)
+		return;
+
+	// Replace the entry for the same name if any, otherwise the one expiring first
+	resolver_cache_entry_t *entry = cache;
+	for (int i = 0; i < RESOLVER_CACHE_SIZE; ++i) {
+		if (strcmp(cache[i].hostname, hostname) == 0 && strcmp(cache[i].service, service) == 0) {
+			entry = cache + i;
+			break;
+		}
+		if (cache[i].expiry < entry->expiry)
+			entry = cache + i;
+	}
+
+	strcpy(entry->hostname, hostname);
+	strcpy(entry->service, service);
+	if (records_count > RESOLVER_MAX_RECORDS_COUNT)
+		records_count = RESOLVER_MAX_RECORDS_COUNT;
+	if (records_count > 0)
+		memcpy(entry->records, records, records_count * sizeof(addr_record_t));
+	entry->records_count = records_count;
+	entry->expiry = current_timestamp() +
+	                (records_count > 0 ? RESOLVER_CACHE_TTL : RESOLVER_CACHE_NEGATIVE_TTL);
+}
+
+static thread_return_t THREAD_CALL resolver_thread_entry(void *arg) {
+	(void)arg;
+#ifdef _WIN32
+	WSADATA wsaData;
+	bool wsa_started = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#endif
+
+	mutex_lock(&resolver_mutex);
+	while (queue_head) {
+		resolver_request_t *request = queue_head;
+		queue_head = request->next;
+		if (!queue_head)
+			queue_tail = NULL;
+
+		if (request->released && !request->prefetch) {
+			request_free(request);
+			continue;
+		}
+
+		// A previous request for the same name might have completed in the meantime
+		int records_count = request->prefetch
+		                        ? RESOLVER_PENDING
+		                        : cache_lookup(request->hostname, request->service,
+		                                       request->records, RESOLVER_MAX_RECORDS_COUNT);
+		if (records_count == RESOLVER_PENDING) {
+			// The request is not accessed by other threads until done is set
+			mutex_unlock(&resolver_mutex);
+			records_count = addr_resolve(request->hostname, request->service, request->records,
+			                             RESOLVER_MAX_RECORDS_COUNT, NULL);
+			mutex_lock(&resolver_mutex);
+
+			if (records_count > RESOLVER_MAX_RECORDS_COUNT)
+				records_count = RESOLVER_MAX_RECORDS_COUNT;
+
+			cache_store(request->hostname, request->service, request->records, records_count);
+		}
+
+		request->records_count = records_count;
+		request->done = true;
+		if (request->released)
+			request_free(request);
+		else if (request->callback)
+			request->callback(request->user_ptr);
+	}
+	--threads_count;
+	mutex_unlock(&resolver_mutex);
+
+#ifdef _WIN32
+	if (wsa_started)
+		WSACleanup();
+#endif
+	return (thread_return_t)0;
+}
+
+// Must be called with the mutex locked
+static int enqueue(resolver_request_t *request) {
+	if (queue_tail)
+		queue_tail->next = request;
+	else
+		queue_head = request;
+	queue_tail = request;
+
+	if (threads_count < RESOLVER_MAX_THREADS) {
+		thread_t thread;
+		if (thread_init(&thread, resolver_thread_entry, NULL) == 0) {
+			thread_detach(thread);
+			++threads_count;
+		} else if (threads_count == 0) {
+			// Nobody would ever process the queue
+			queue_head = queue_tail = NULL;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static resolver_request_t *request_create(const char *hostname, const char *service) {
+	resolver_request_t *request = calloc(1, sizeof(resolver_request_t));
+	if (!request)
+		return NULL;
+
+	request->hostname = alloc_string_copy(hostname);
+	request->service = alloc_string_copy(service);
+	if (!request->hostname || !request->service) {
+		request_free(request);
+		return NULL;
+	}
+	return request;
+}
+
+resolver_request_t *resolver_submit(const char *hostname, const char *service,
+                                    resolver_callback_t callback, void *user_ptr,
+                                    juice_logger_t *logger) {
+	resolver_request_t *request = request_create(hostname, service);
+	if (!request) {
+		JLOG_ERROR(logger, "alloc for resolver request failed");
+		return NULL;
+	}
+	request->callback = callback;
+	request->user_ptr = user_ptr;
+
+	mutex_lock(&resolver_mutex);
+	int records_count =
+	    cache_lookup(hostname, service, request->records, RESOLVER_MAX_RECORDS_COUNT);
+	if (records_count != RESOLVER_PENDING) {
+		// The result is available immediately, the callback is not called
+		request->records_count = records_count;
+		request->done = true;
+		mutex_unlock(&resolver_mutex);
+		JLOG_VERBOSE(logger, "Resolved %s:%s from cache", hostname, service);
+		return request;
+	}
+
+	if (enqueue(request) < 0) {
+		mutex_unlock(&resolver_mutex);
+		JLOG_ERROR(logger, "Resolver thread creation failed");
+		request_free(request);
+		return NULL;
+	}
+	mutex_unlock(&resolver_mutex);
+
+	JLOG_VERBOSE(logger, "Submitted resolution for %s:%s", hostname, service);
+	return request;
+}
+
+int resolver_get_result(resolver_request_t *request, addr_record_t *records, size_t count) {
+	mutex_lock(&resolver_mutex);
+	if (!request->done) {
+		mutex_unlock(&resolver_mutex);
+		return RESOLVER_PENDING;
+	}
+	int ret = request->records_count;
+	if (ret > 0) {
+		size_t n = (size_t)ret < count ? (size_t)ret : count;
+		memcpy(records, request->records, n * sizeof(addr_record_t));
+	}
+	mutex_unlock(&resolver_mutex);
+	return ret;
+}
+
+void resolver_release(resolver_request_t *request) {
+	mutex_lock(&resolver_mutex);
+	if (request->done) {
+		request_free(request);
+	} else {
+		// Queued or in progress, the resolver thread will free it
+		request->callback = NULL;
+		request->released = true;
+	}
+	mutex_unlock(&resolver_mutex);
+}
+
+int resolver_resolve(const char *hostname, const char *service, addr_record_t *records,
+                     size_t count, juice_logger_t *logger) {
+	mutex_lock(&resolver_mutex);
+	int ret = cache_lookup(hostname, service, records, count);
+	mutex_unlock(&resolver_mutex);
+	if (ret != RESOLVER_PENDING) {
+		JLOG_VERBOSE(logger, "Resolved %s:%s from cache", hostname, service);
+		return ret;
+	}
+
+	addr_record_t resolved[RESOLVER_MAX_RECORDS_COUNT];
+	ret = addr_resolve(hostname, service, resolved, RESOLVER_MAX_RECORDS_COUNT, logger);
+	if (ret > RESOLVER_MAX_RECORDS_COUNT)
+		ret = RESOLVER_MAX_RECORDS_COUNT;
+
+	mutex_lock(&resolver_mutex);
+	cache_store(hostname, service, resolved, ret);
+	mutex_unlock(&resolver_mutex);
+
+	if (ret > 0) {
+		size_t n = (size_t)ret < count ? (size_t)ret : count;
+		memcpy(records, resolved, n * sizeof(addr_record_t));
+	}
+	return ret;
+}
+
+int resolver_prefetch(const char *hostname, const char *service) {
+	resolver_request_t *request = request_create(hostname, service);
+	if (!request)
+		return -1;
+
+	// The request is owned by the resolver thread
+	request->prefetch = true;
+	request->released = true;
+
+	mutex_lock(&resolver_mutex);
+	if (enqueue(request) < 0) {
+		mutex_unlock(&resolver_mutex);
+		request_free(request);
+		return -1;
+	}
+	mutex_unlock(&resolver_mutex);
+	return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef JUICE_RESOLVER_H
+#define JUICE_RESOLVER_H
+
+#include "addr.h"
+#include "log.h"
+
+#include <stddef.h>
+
+#define RESOLVER_MAX_THREADS 4
+#define RESOLVER_MAX_RECORDS_COUNT 8
+
+#define RESOLVER_MAX_HOSTNAME_LEN 256
+#define RESOLVER_MAX_SERVICE_LEN 8
+
+#define RESOLVER_CACHE_SIZE 32
+#define RESOLVER_CACHE_TTL 300000         // msecs, 5 min
+#define RESOLVER_CACHE_NEGATIVE_TTL 30000 // msecs
+
+#define RESOLVER_PENDING -2
+
+// Asynchronous address resolution on a small process-wide pool of resolver threads
+// Threads are spawned on demand, up to RESOLVER_MAX_THREADS, and exit once the queue is empty.
+// Results, including failures, are kept in a process-wide cache shared by all agents. As
+// getaddrinfo() does not expose record TTLs, fixed lifetimes are used.
+
+typedef struct resolver_request resolver_request_t;
+
+// The callback is called from a resolver thread when the request completes, it must not block.
+// It is not called if the result is already available from the cache on submission.
+typedef void (*resolver_callback_t)(void *user_ptr);
+
+resolver_request_t *resolver_submit(const char *hostname, const char *service,
+                                    resolver_callback_t callback, void *user_ptr,
+                                    juice_logger_t *logger);
+
+// Returns RESOLVER_PENDING if the request is still in progress, otherwise like addr_resolve()
+// except that the count is at most RESOLVER_MAX_RECORDS_COUNT
+int resolver_get_result(resolver_request_t *request, addr_record_t *records, size_t count);
+
+// Cancels the callback and frees the request, possibly later if a thread is working on it
+void resolver_release(resolver_request_t *request);
+
+// Synchronous resolution through the cache, returns like addr_resolve()
+int resolver_resolve(const char *hostname, const char *service, addr_record_t *records,
+                     size_t count, juice_logger_t *logger);
+
+// Resolves in the background to warm up the cache, refreshing any cached result
+int resolver_prefetch(const char *hostname, const char *service);
+
+#endif // JUICE_RESOLVER_H
@@ -153,6 +153,11 @@ juice_server_t *server_create(const juice_server_config_t *config) {
 
 	mutex_init(&server->mutex, MUTEX_RECURSIVE);
 
+	if (wakeup_init(&server->wakeup, logger) < 0) {
+		JLOG_FATAL(logger, "Wakeup creation for server failed");
+		goto error;
+	}
+
 	server->config = *config;
 
 	if (server->config.bind_address) {
@@ -195,7 +200,12 @@ juice_server_t *server_create(const juice_server_config_t *config) {
 		    alloc_copy(server->config.credentials,
 		               server->config.credentials_count * sizeof(stun_credentials_t));
 		server->credentials_userhash = calloc(server->config.credentials_count, sizeof(uint8_t *));
-		if (!server->config.credentials || !server->credentials_userhash) {
+		server->credentials_md5_key =
+		    calloc(server->config.credentials_count, sizeof(hmac_key_t *));
+		server->credentials_sha256_key =
+		    calloc(server->config.credentials_count, sizeof(hmac_key_t *));
+		if (!server->config.credentials || !server->credentials_userhash ||
+		    !server->credentials_md5_key || !server->credentials_sha256_key) {
 			JLOG_FATAL(logger, "Memory allocation for TURN credentials array failed");
 			goto error;
 		}
@@ -215,6 +225,22 @@ juice_server_t *server_create(const juice_server_config_t *config) {
 
 			stun_compute_userhash(credentials->username, realm, server->credentials_userhash[i]);
 
+			// Precompute the long-term keys, as the realm is fixed
+			stun_credentials_t key_credentials;
+			memset(&key_credentials, 0, sizeof(key_credentials));
+			snprintf(key_credentials.username, STUN_MAX_USERNAME_LEN, "%s", credentials->username);
+			snprintf(key_credentials.realm, STUN_MAX_REALM_LEN, "%s", realm);
+			key_credentials.password_algorithm = STUN_PASSWORD_ALGORITHM_MD5;
+			server->credentials_md5_key[i] =
+			    stun_create_hmac_key(&key_credentials, credentials->password, logger);
+			key_credentials.password_algorithm = STUN_PASSWORD_ALGORITHM_SHA256;
+			server->credentials_sha256_key[i] =
+			    stun_create_hmac_key(&key_credentials, credentials->password, logger);
+			if (!server->credentials_md5_key[i] || !server->credentials_sha256_key[i]) {
+				JLOG_FATAL(logger, "Memory allocation for TURN credentials failed");
+				goto error;
+			}
+
 			if (server->config.max_allocations < credentials->allocations_quota)
 				server->config.max_allocations = credentials->allocations_quota;
 		}
@@ -262,6 +288,7 @@ void server_do_destroy(juice_server_t *server) {
 	JLOG_DEBUG(logger, "Destroying server");
 
 	closesocket(server->sock);
+	wakeup_destroy(&server->wakeup);
 	mutex_destroy(&server->mutex);
 
 	for (int i = 0; i < server->config.credentials_count; ++i) {
@@ -269,10 +296,16 @@ void server_do_destroy(juice_server_t *server) {
 		free((void *)credentials->username);
 		free((void *)credentials->password);
 		free(server->credentials_userhash[i]);
+		if (server->credentials_md5_key)
+			hmac_key_destroy(server->credentials_md5_key[i]);
+		if (server->credentials_sha256_key)
+			hmac_key_destroy(server->credentials_sha256_key[i]);
 	}
 	free((void *)server->config.realm);
 	free(server->config.credentials);
 	free(server->credentials_userhash);
+	free(server->credentials_md5_key);
+	free(server->credentials_sha256_key);
 	free(server);
 
 #ifdef _WIN32
@@ -304,6 +337,7 @@ void server_run(juice_server_t *server) {
 
 	// Main loop
 	timestamp_t next_timestamp;
+	timestamp_update();
 	while (server_bookkeeping(server, &next_timestamp) == 0) {
 		timediff_t timediff = next_timestamp - current_timestamp();
 		if (timediff < 0)
@@ -317,7 +351,10 @@ void server_run(juice_server_t *server) {
 		fd_set readfds;
 		FD_ZERO(&readfds);
 		FD_SET(server->sock, &readfds);
+		FD_SET(server->wakeup.read_fd, &readfds);
 		int max = SOCKET_TO_INT(server->sock);
+		if (max < SOCKET_TO_INT(server->wakeup.read_fd))
+			max = SOCKET_TO_INT(server->wakeup.read_fd);
 
 		int count = 1;
 		for (int i = 0; i < server->allocs_count; ++i) {
@@ -335,6 +372,7 @@ void server_run(juice_server_t *server) {
 		int ret = select(max + 1, &readfds, NULL, NULL, &timeout);
 		mutex_lock(&server->mutex);
 		JLOG_VERBOSE(server->logger, "Leaving select");
+		timestamp_update();
 		if (ret < 0) {
 			if (sockerrno == SEINTR || sockerrno == SEAGAIN) {
 				JLOG_VERBOSE(server->logger, "select interrupted");
@@ -350,6 +388,9 @@ void server_run(juice_server_t *server) {
 			break;
 		}
 
+		if (FD_ISSET(server->wakeup.read_fd, &readfds))
+			wakeup_drain(&server->wakeup);
+
 		for (int i = 0; i < server->allocs_count; ++i) {
 			server_turn_alloc_t *alloc = server->allocs + i;
 			if (alloc->state == SERVER_TURN_ALLOC_FULL && FD_ISSET(alloc->sock, &readfds))
@@ -362,6 +403,7 @@ void server_run(juice_server_t *server) {
 		}
 	}
 	JLOG_DEBUG(server->logger, "Leaving server thread");
+	timestamp_reset();
 	mutex_unlock(&server->mutex);
 }
 
@@ -376,22 +418,27 @@ int server_send(juice_server_t *server, const addr_record_t *dst, const char *da
 	int ret = sendto(server->sock, data, size, 0, (const struct sockaddr *)&dst->addr, dst->len);
 #endif
 	if (ret < 0 && sockerrno != SEAGAIN && sockerrno != SEWOULDBLOCK)
-		JLOG_WARN(server->logger, "Send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(server->logger, "Send failed, errno=%d", sockerrno);
 
 	return ret;
 }
 
 int server_stun_send(juice_server_t *server, const addr_record_t *dst, const stun_message_t *msg,
-                     const char *password) {
+                     const juice_server_credentials_t *credentials) {
+	const hmac_key_t *hkey =
+	    credentials ? server_get_hmac_key(server, credentials, &msg->credentials) : NULL;
+
 	char buffer[BUFFER_SIZE];
-	int size = stun_write(buffer, BUFFER_SIZE, msg, password, server->logger);
+	const char *password = credentials ? credentials->password : NULL;
+	int size = hkey ? stun_write_hmac(buffer, BUFFER_SIZE, msg, hkey, server->logger)
+	                : stun_write(buffer, BUFFER_SIZE, msg, password, server->logger);
 	if (size <= 0) {
-		JLOG_ERROR(server->logger, "STUN message write failed");
+		JLOG_ERROR_LIMITED(server->logger, "STUN message write failed");
 		return -1;
 	}
 
 	if (server_send(server, dst, buffer, size) < 0) {
-		JLOG_WARN(server->logger, "STUN message send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(server->logger, "STUN message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 	return 0;
@@ -421,13 +468,9 @@ int server_recv(juice_server_t *server) {
 				JLOG_VERBOSE(server->logger, "No more datagrams to receive");
 				break;
 			}
-			JLOG_ERROR(server->logger, "recvfrom failed, errno=%d", sockerrno);
+			JLOG_ERROR_LIMITED(server->logger, "recvfrom failed, errno=%d", sockerrno);
 			return -1;
 		}
-		if (len == 0) {
-			// Empty datagram (used to interrupt)
-			continue;
-		}
 
 		addr_unmap_inet6_v4mapped((struct sockaddr *)&record.addr, &record.len);
 		server_input(server, buffer, len, &record);
@@ -459,7 +502,7 @@ int server_forward(juice_server_t *server, server_turn_alloc_t *alloc) {
 			if (sockerrno == SEAGAIN || sockerrno == SEWOULDBLOCK) {
 				break;
 			}
-			JLOG_WARN(server->logger, "recvfrom failed, errno=%d", sockerrno);
+			JLOG_WARN_LIMITED(server->logger, "recvfrom failed, errno=%d", sockerrno);
 			return -1;
 		}
 		addr_unmap_inet6_v4mapped((struct sockaddr *)&record.addr, &record.len);
@@ -469,7 +512,7 @@ int server_forward(juice_server_t *server, server_turn_alloc_t *alloc) {
 			// Use ChannelData
 			len = turn_wrap_channel_data(buffer, BUFFER_SIZE, buffer, len, channel, server->logger);
 			if (len <= 0) {
-				JLOG_ERROR(server->logger, "TURN ChannelData wrapping failed");
+				JLOG_ERROR_LIMITED(server->logger, "TURN ChannelData wrapping failed");
 				return -1;
 			}
 
@@ -485,7 +528,7 @@ int server_forward(juice_server_t *server, server_turn_alloc_t *alloc) {
 			                 (const struct sockaddr *)&alloc->record.addr, alloc->record.len);
 #endif
 			if (ret < 0 && sockerrno != SEAGAIN && sockerrno != SEWOULDBLOCK)
-				JLOG_WARN(server->logger, "Send failed, errno=%d", sockerrno);
+				JLOG_WARN_LIMITED(server->logger, "Send failed, errno=%d", sockerrno);
 
 			return ret;
 
@@ -514,9 +557,31 @@ int server_input(juice_server_t *server, char *buf, size_t len, const addr_recor
 
 	if (is_stun_datagram(buf, len, server->logger)) {
 		JLOG_DEBUG(server->logger, "Received STUN datagram");
+		stun_view_t view;
+		if (stun_read_view(buf, len, &view, server->logger) < 0) {
+			JLOG_ERROR_LIMITED(server->logger, "STUN message reading failed");
+			return -1;
+		}
+
+		// Only decode the attributes once the message is known to be expected
+		if (!(view.msg_class == STUN_CLASS_REQUEST ||
+		      (view.msg_class == STUN_CLASS_INDICATION &&
+		       (view.msg_method == STUN_METHOD_BINDING || view.msg_method == STUN_METHOD_SEND)))) {
+			JLOG_WARN_LIMITED(server->logger, "Unexpected STUN message, class=0x%X, method=0x%X",
+			                  view.msg_class, view.msg_method);
+			return -1;
+		}
+
+		if (server->allocs_count == 0 && view.msg_method != STUN_METHOD_BINDING) {
+			// TURN support is disabled
+			return server_answer_stun_error(server, view.transaction_id, src, view.msg_method,
+			                                400, // Bad request
+			                                NULL);
+		}
+
 		stun_message_t msg;
-		if (stun_read(buf, len, &msg, server->logger) < 0) {
-			JLOG_ERROR(server->logger, "STUN message reading failed");
+		if (stun_read_from_view(&view, &msg, server->logger) < 0) {
+			JLOG_ERROR_LIMITED(server->logger, "STUN message reading failed");
 			return -1;
 		}
 		return server_dispatch_stun(server, buf, len, &msg, src);
@@ -527,37 +592,22 @@ int server_input(juice_server_t *server, char *buf, size_t len, const addr_recor
 		return server_process_channel_data(server, buf, len, src);
 	}
 
-	JLOG_WARN(server->logger, "Received unexpected non-STUN datagram, ignoring");
+	JLOG_WARN_LIMITED(server->logger, "Received unexpected non-STUN datagram, ignoring");
 	return -1;
 }
 
 int server_interrupt(juice_server_t *server) {
 	JLOG_VERBOSE(server->logger, "Interrupting server thread");
-	mutex_lock(&server->mutex);
-	if (server->sock == INVALID_SOCKET) {
-		mutex_unlock(&server->mutex);
-		return -1;
-	}
-
-	addr_record_t local;
-	if (udp_get_local_addr(server->sock, AF_INET, &local, server->logger) < 0) {
-			mutex_unlock(&server->mutex);
+	if (wakeup_trigger(&server->wakeup) < 0) {
+		JLOG_WARN(server->logger, "Failed to interrupt thread by triggering wakeup, errno=%d",
+		          sockerrno);
 		return -1;
 	}
-
-	if (server_send(server, &local, NULL, 0) < 0) {
-	JLOG_WARN(server->logger, "Failed to interrupt thread by triggering socket, errno=%d",
-	          sockerrno);
-	mutex_unlock(&server->mutex);
-	return -1;
-	}
-
-	mutex_unlock(&server->mutex);
 	return 0;
 }
 
 int server_bookkeeping(juice_server_t *server, timestamp_t *next_timestamp) {
-	timestamp_t now = current_timestamp();
+	timestamp_t now = cached_timestamp();
 	*next_timestamp = now + 60000;
 
 	for (int i = 0; i < server->allocs_count; ++i) {
@@ -577,7 +627,7 @@ int server_bookkeeping(juice_server_t *server, timestamp_t *next_timestamp) {
 }
 
 void server_get_nonce(juice_server_t *server, const addr_record_t *src, char *nonce) {
-	timestamp_t now = current_timestamp();
+	timestamp_t now = cached_timestamp();
 	if (now >= server->nonce_key_timestamp) {
 		juice_random(server->nonce_key, SERVER_NONCE_KEY_SIZE, server->logger);
 		server->nonce_key_timestamp = now + SERVER_NONCE_KEY_LIFETIME;
@@ -610,32 +660,35 @@ void server_prepare_credentials(juice_server_t *server, const addr_record_t *src
 		snprintf(msg->credentials.username, STUN_MAX_USERNAME_LEN, "%s", credentials->username);
 }
 
-int server_dispatch_stun(juice_server_t *server, void *buf, size_t size, stun_message_t *msg,
-                         const addr_record_t *src) {
+const hmac_key_t *server_get_hmac_key(juice_server_t *server,
+                                      const juice_server_credentials_t *credentials,
+                                      const stun_credentials_t *msg_credentials) {
+	// The precomputed keys are only valid for the server realm and the credentials username
+	if (strcmp(msg_credentials->realm, server->config.realm) != 0 ||
+	    strncmp(msg_credentials->username, credentials->username, STUN_MAX_USERNAME_LEN - 1) != 0)
+		return NULL;
 
-	if (!(msg->msg_class == STUN_CLASS_REQUEST ||
-	      (msg->msg_class == STUN_CLASS_INDICATION &&
-	       (msg->msg_method == STUN_METHOD_BINDING || msg->msg_method == STUN_METHOD_SEND)))) {
-		JLOG_WARN(server->logger, "Unexpected STUN message, class=0x%X, method=0x%X",
-		          msg->msg_class, msg->msg_method);
-		return -1;
-	}
+	int i = (int)(credentials - server->config.credentials);
+	if (i < 0 || i >= server->config.credentials_count)
+		return NULL;
 
-	if (server->allocs_count == 0 && msg->msg_method != STUN_METHOD_BINDING) {
-		// TURN support is disabled
-		return server_answer_stun_error(server, msg->transaction_id, src, msg->msg_method,
-		                                400, // Bad request
-		                                NULL);
-	}
+	return msg_credentials->password_algorithm == STUN_PASSWORD_ALGORITHM_SHA256
+	           ? server->credentials_sha256_key[i]
+	           : server->credentials_md5_key[i];
+}
 
+int server_dispatch_stun(juice_server_t *server, void *buf, size_t size, stun_message_t *msg,
+                         const addr_record_t *src) {
+	// The class and method were checked on the view by server_input()
 	if (msg->error_code == STUN_ERROR_INTERNAL_VALIDATION_FAILED) {
 		if (msg->msg_class == STUN_CLASS_REQUEST) {
-			JLOG_WARN(server->logger, "Invalid STUN message, answering bad request error response");
+			JLOG_WARN_LIMITED(
+			    server->logger, "Invalid STUN message, answering bad request error response");
 			return server_answer_stun_error(server, msg->transaction_id, src, msg->msg_method,
 			                                400, // Bad request
 			                                NULL);
 		} else {
-			JLOG_WARN(server->logger, "Invalid STUN message, dropping");
+			JLOG_WARN_LIMITED(server->logger, "Invalid STUN message, dropping");
 			return -1;
 		}
 	}
@@ -673,7 +726,7 @@ int server_dispatch_stun(juice_server_t *server, void *buf, size_t size, stun_me
 				snprintf(msg->credentials.username, STUN_MAX_USERNAME_LEN, "%s",
 				         credentials->username);
 			else
-				JLOG_WARN(server->logger, "No credentials for userhash");
+				JLOG_WARN_LIMITED(server->logger, "No credentials for userhash");
 
 		} else {
 			for (int i = 0; i < server->config.credentials_count; ++i) {
@@ -684,8 +737,8 @@ int server_dispatch_stun(juice_server_t *server, void *buf, size_t size, stun_me
 			}
 
 			if (!credentials)
-				JLOG_WARN(server->logger, "No credentials for username \"%s\"",
-				          msg->credentials.username);
+				JLOG_WARN_LIMITED(server->logger, "No credentials for username \"%s\"",
+				                  msg->credentials.username);
 		}
 		if (!credentials) {
 			server_answer_stun_error(server, msg->transaction_id, src, msg->msg_method,
@@ -695,9 +748,11 @@ int server_dispatch_stun(juice_server_t *server, void *buf, size_t size, stun_me
 		}
 
 		// Check credentials
-		if (!stun_check_integrity(buf, size, msg, credentials->password, server->logger)) {
-			JLOG_WARN(server->logger, "STUN authentication failed for username \"%s\"",
-			          msg->credentials.username);
+		const hmac_key_t *hkey = server_get_hmac_key(server, credentials, &msg->credentials);
+		if (hkey ? !stun_check_integrity_hmac(buf, size, msg, hkey, server->logger)
+		         : !stun_check_integrity(buf, size, msg, credentials->password, server->logger)) {
+			JLOG_WARN_LIMITED(server->logger, "STUN authentication failed for username \"%s\"",
+			                  msg->credentials.username);
 			server_answer_stun_error(server, msg->transaction_id, src, msg->msg_method,
 			                         401,   // Unauthorized
 			                         NULL); // No username
@@ -723,7 +778,7 @@ int server_dispatch_stun(juice_server_t *server, void *buf, size_t size, stun_me
 		return server_process_turn_send(server, msg, src);
 
 	default:
-		JLOG_WARN(server->logger, "Unknown STUN method 0x%X, ignoring", msg->msg_method);
+		JLOG_WARN_LIMITED(server->logger, "Unknown STUN method 0x%X, ignoring", msg->msg_method);
 		return -1;
 	}
 }
@@ -742,12 +797,12 @@ int server_answer_stun_binding(juice_server_t *server, const uint8_t *transactio
 	char buffer[BUFFER_SIZE];
 	int size = stun_write(buffer, BUFFER_SIZE, &ans, NULL, server->logger);
 	if (size <= 0) {
-		JLOG_ERROR(server->logger, "STUN message write failed");
+		JLOG_ERROR_LIMITED(server->logger, "STUN message write failed");
 		return -1;
 	}
 
 	if (server_send(server, src, buffer, size) < 0) {
-		JLOG_WARN(server->logger, "STUN message send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(server->logger, "STUN message send failed, errno=%d", sockerrno);
 		return -1;
 	}
 
@@ -769,7 +824,7 @@ int server_answer_stun_error(juice_server_t *server, const uint8_t *transaction_
 	if (method != STUN_METHOD_BINDING)
 		server_prepare_credentials(server, src, credentials, &ans);
 
-	return server_stun_send(server, src, &ans, credentials ? credentials->password : NULL);
+	return server_stun_send(server, src, &ans, credentials);
 }
 
 int server_process_turn_allocate(juice_server_t *server, const stun_message_t *msg,
@@ -849,7 +904,7 @@ int server_process_turn_allocate(juice_server_t *server, const stun_message_t *m
 	if (msg->lifetime_set && msg->lifetime < lifetime)
 		lifetime = msg->lifetime;
 
-	alloc->timestamp = current_timestamp() + lifetime * 1000;
+	alloc->timestamp = cached_timestamp() + lifetime * 1000;
 	memcpy(alloc->transaction_id, msg->transaction_id, STUN_TRANSACTION_ID_SIZE);
 
 	addr_record_t records[MAX_RELAYED_RECORDS_COUNT];
@@ -907,7 +962,7 @@ int server_process_turn_allocate(juice_server_t *server, const stun_message_t *m
 
 	server_prepare_credentials(server, src, credentials, &ans);
 
-	return server_stun_send(server, src, &ans, credentials->password);
+	return server_stun_send(server, src, &ans, credentials);
 
 error:
 	delete_allocation(alloc);
@@ -924,7 +979,7 @@ int server_process_turn_create_permission(juice_server_t *server, const stun_mes
 	JLOG_DEBUG(server->logger, "Processing STUN CreatePermission request");
 
 	if (!msg->peer.len) {
-		JLOG_WARN(server->logger, "Missing peer address in TURN CreatePermission request");
+		JLOG_WARN_LIMITED(server->logger, "Missing peer address in TURN CreatePermission request");
 		return -1;
 	}
 
@@ -956,7 +1011,7 @@ int server_process_turn_create_permission(juice_server_t *server, const stun_mes
 
 	server_prepare_credentials(server, src, credentials, &ans);
 
-	return server_stun_send(server, src, &ans, credentials->password);
+	return server_stun_send(server, src, &ans, credentials);
 }
 
 int server_process_turn_channel_bind(juice_server_t *server, const stun_message_t *msg,
@@ -968,11 +1023,11 @@ int server_process_turn_channel_bind(juice_server_t *server, const stun_message_
 	JLOG_DEBUG(server->logger, "Processing STUN ChannelBind request");
 
 	if (!msg->peer.len) {
-		JLOG_WARN(server->logger, "Missing peer address in TURN ChannelBind request");
+		JLOG_WARN_LIMITED(server->logger, "Missing peer address in TURN ChannelBind request");
 		return -1;
 	}
 	if (!msg->channel_number) {
-		JLOG_WARN(server->logger, "Missing channel number in TURN ChannelBind request");
+		JLOG_WARN_LIMITED(server->logger, "Missing channel number in TURN ChannelBind request");
 		return -1;
 	}
 
@@ -991,7 +1046,7 @@ int server_process_turn_channel_bind(juice_server_t *server, const stun_message_
 
 	uint16_t channel = msg->channel_number;
 	if (!is_valid_channel(channel)) {
-		JLOG_WARN(server->logger, "TURN channel 0x%hX is invalid", channel);
+		JLOG_WARN_LIMITED(server->logger, "TURN channel 0x%hX is invalid", channel);
 		return server_answer_stun_error(server, msg->transaction_id, src, msg->msg_method,
 		                                400, // Bad request
 		                                credentials);
@@ -1012,7 +1067,7 @@ int server_process_turn_channel_bind(juice_server_t *server, const stun_message_
 
 	server_prepare_credentials(server, src, credentials, &ans);
 
-	return server_stun_send(server, src, &ans, credentials->password);
+	return server_stun_send(server, src, &ans, credentials);
 }
 
 int server_process_turn_send(juice_server_t *server, const stun_message_t *msg,
@@ -1023,22 +1078,22 @@ int server_process_turn_send(juice_server_t *server, const stun_message_t *msg,
 	JLOG_DEBUG(server->logger, "Processing STUN Send indication");
 
 	if (!msg->data) {
-		JLOG_WARN(server->logger, "Missing data in TURN Send indication");
+		JLOG_WARN_LIMITED(server->logger, "Missing data in TURN Send indication");
 		return -1;
 	}
 	if (!msg->peer.len) {
-		JLOG_WARN(server->logger, "Missing peer address in TURN Send indication");
+		JLOG_WARN_LIMITED(server->logger, "Missing peer address in TURN Send indication");
 		return -1;
 	}
 
 	server_turn_alloc_t *alloc = find_allocation(server->allocs, server->allocs_count, src, false,server->logger);
 	if (!alloc || alloc->state != SERVER_TURN_ALLOC_FULL) {
-		JLOG_WARN(server->logger,"Allocation mismatch for TURN Send indication");
+		JLOG_WARN_LIMITED(server->logger,"Allocation mismatch for TURN Send indication");
 		return -1;
 	}
 
 	if (!turn_has_permission(&alloc->map, &msg->peer,server->logger)) {
-		JLOG_WARN(server->logger,"No permission for peer address");
+		JLOG_WARN_LIMITED(server->logger,"No permission for peer address");
 		return -1;
 	}
 
@@ -1054,7 +1109,7 @@ int server_process_turn_send(juice_server_t *server, const stun_message_t *msg,
 	                 (const struct sockaddr *)&msg->peer.addr, msg->peer.len);
 #endif
 	if (ret < 0 && sockerrno != SEAGAIN && sockerrno != SEWOULDBLOCK)
-		JLOG_WARN(server->logger,"Forwarding failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(server->logger,"Forwarding failed, errno=%d", sockerrno);
 
 	return ret;
 }
@@ -1063,12 +1118,12 @@ int server_process_channel_data(juice_server_t *server, char *buf, size_t len,
                                 const addr_record_t *src) {
 	server_turn_alloc_t *alloc = find_allocation(server->allocs, server->allocs_count, src, false, server->logger);
 	if (!alloc || alloc->state != SERVER_TURN_ALLOC_FULL) {
-		JLOG_WARN(server->logger,"Allocation mismatch for TURN Channel Data");
+		JLOG_WARN_LIMITED(server->logger,"Allocation mismatch for TURN Channel Data");
 		return -1;
 	}
 
 	if (len < sizeof(struct channel_data_header)) {
-		JLOG_WARN(server->logger,"ChannelData is too short");
+		JLOG_WARN_LIMITED(server->logger,"ChannelData is too short");
 		return -1;
 	}
 
@@ -1079,14 +1134,14 @@ int server_process_channel_data(juice_server_t *server, char *buf, size_t len,
 	uint16_t length = ntohs(header->length);
 	JLOG_VERBOSE(server->logger,"Received ChannelData, channel=0x%hX, length=%hu", channel, length);
 	if (length > len) {
-		JLOG_WARN(server->logger,"ChannelData has invalid length");
+		JLOG_WARN_LIMITED(server->logger,"ChannelData has invalid length");
 		return -1;
 	}
 	len = length;
 
 	addr_record_t record;
 	if (!turn_find_bound_channel(&alloc->map, channel, &record,server->logger)) {
-		JLOG_WARN(server->logger,"server->logger,Channel 0x%hX is not bound", channel);
+		JLOG_WARN_LIMITED(server->logger,"Channel 0x%hX is not bound", channel);
 		return -1;
 	}
 
@@ -1100,7 +1155,7 @@ int server_process_channel_data(juice_server_t *server, char *buf, size_t len,
 	int ret = sendto(alloc->sock, buf, len, 0, (const struct sockaddr *)&record.addr, record.len);
 #endif
 	if (ret < 0 && sockerrno != SEAGAIN && sockerrno != SEWOULDBLOCK)
-		JLOG_WARN(server->logger,"Send failed, errno=%d", sockerrno);
+		JLOG_WARN_LIMITED(server->logger,"Send failed, errno=%d", sockerrno);
 
 	return 0;
 }
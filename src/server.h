@@ -32,6 +32,7 @@
 #include "thread.h"
 #include "timestamp.h"
 #include "turn.h"
+#include "wakeup.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -65,9 +66,12 @@ typedef struct server_turn_alloc {
 typedef struct juice_server {
 	juice_server_config_t config;
 	uint8_t **credentials_userhash;
+	hmac_key_t **credentials_md5_key;    // long-term keys for the MD5 password algorithm
+	hmac_key_t **credentials_sha256_key; // long-term keys for the SHA-256 password algorithm
 	uint8_t nonce_key[SERVER_NONCE_KEY_SIZE];
 	timestamp_t nonce_key_timestamp;
 	socket_t sock;
+	wakeup_t wakeup;
 	thread_t thread;
 	mutex_t mutex;
 	bool thread_stopped;
@@ -85,7 +89,7 @@ uint16_t server_get_port(juice_server_t *server);
 void server_run(juice_server_t *server);
 int server_send(juice_server_t *agent, const addr_record_t *dst, const char *data, size_t size);
 int server_stun_send(juice_server_t *server, const addr_record_t *dst, const stun_message_t *msg,
-                     const char *password // password may be NULL
+                     const juice_server_credentials_t *credentials // credentials may be NULL
 );
 int server_recv(juice_server_t *server);
 int server_forward(juice_server_t *server, server_turn_alloc_t *alloc);
@@ -96,6 +100,9 @@ int server_bookkeeping(juice_server_t *agent, timestamp_t *next_timestamp);
 void server_get_nonce(juice_server_t *server, const addr_record_t *src, char *nonce);
 void server_prepare_credentials(juice_server_t *server, const addr_record_t *src,
                                 const juice_server_credentials_t *credentials, stun_message_t *msg);
+const hmac_key_t *server_get_hmac_key(juice_server_t *server,
+                                      const juice_server_credentials_t *credentials,
+                                      const stun_credentials_t *msg_credentials);
 
 int server_dispatch_stun(juice_server_t *server, void *buf, size_t size, stun_message_t *msg,
                          const addr_record_t *src);
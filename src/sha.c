@@ -0,0 +1,306 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "sha.h"
+#include "cpu.h"
+
+#include <string.h>
+
+#if CPU_X86
+#include <immintrin.h>
+#define SHA_NI_SUPPORTED 1
+#define SHA_NI_TARGET CPU_X86_TARGET("sha,sse4.1,ssse3")
+#define SHA_NI_FEATURES (CPU_FEATURE_SHA | CPU_FEATURE_SSE41 | CPU_FEATURE_SSSE3)
+#else
+#define SHA_NI_SUPPORTED 0
+#endif
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha1_init_state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                                            0xC3D2E1F0};
+
+static const uint32_t sha256_init_state[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                                              0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+
+static const uint32_t sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+static uint32_t load_be32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void store_be32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void sha1_compress(uint32_t *state, const uint8_t *blocks, size_t count) {
+	while (count--) {
+		uint32_t w[80];
+		for (int i = 0; i < 16; ++i)
+			w[i] = load_be32(blocks + 4 * i);
+		for (int i = 16; i < 80; ++i)
+			w[i] = ROTL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+		for (int i = 0; i < 80; ++i) {
+			uint32_t f, k;
+			if (i < 20) {
+				f = d ^ (b & (c ^ d));
+				k = 0x5A827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			} else if (i < 60) {
+				f = (b & c) | (d & (b | c));
+				k = 0x8F1BBCDC;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t t = ROTL32(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = ROTL32(b, 30);
+			b = a;
+			a = t;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		blocks += SHA_BLOCK_SIZE;
+	}
+}
+
+static void sha256_compress(uint32_t *state, const uint8_t *blocks, size_t count) {
+	while (count--) {
+		uint32_t w[64];
+		for (int i = 0; i < 16; ++i)
+			w[i] = load_be32(blocks + 4 * i);
+		for (int i = 16; i < 64; ++i) {
+			uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32_t s[8];
+		memcpy(s, state, sizeof(s));
+		for (int i = 0; i < 64; ++i) {
+			uint32_t S1 = ROTR32(s[4], 6) ^ ROTR32(s[4], 11) ^ ROTR32(s[4], 25);
+			uint32_t ch = s[6] ^ (s[4] & (s[5] ^ s[6]));
+			uint32_t t1 = s[7] + S1 + ch + sha256_k[i] + w[i];
+			uint32_t S0 = ROTR32(s[0], 2) ^ ROTR32(s[0], 13) ^ ROTR32(s[0], 22);
+			uint32_t maj = (s[0] & s[1]) | (s[2] & (s[0] | s[1]));
+			uint32_t t2 = S0 + maj;
+			s[7] = s[6];
+			s[6] = s[5];
+			s[5] = s[4];
+			s[4] = s[3] + t1;
+			s[3] = s[2];
+			s[2] = s[1];
+			s[1] = s[0];
+			s[0] = t1 + t2;
+		}
+		for (int i = 0; i < 8; ++i)
+			state[i] += s[i];
+
+		blocks += SHA_BLOCK_SIZE;
+	}
+}
+
+#if SHA_NI_SUPPORTED
+
+// Four rounds of SHA-1 with the next message words, the function selector must be an immediate
+#define SHA1_NI_ROUNDS(func)                                                                       \
+	if (g >= 4) {                                                                                  \
+		msg[g & 3] = _mm_sha1msg2_epu32(                                                           \
+		    _mm_xor_si128(_mm_sha1msg1_epu32(msg[g & 3], msg[(g + 1) & 3]), msg[(g + 2) & 3]),     \
+		    msg[(g + 3) & 3]);                                                                     \
+	}                                                                                              \
+	e = g == 0 ? _mm_add_epi32(e, msg[0]) : _mm_sha1nexte_epu32(prev_abcd, msg[g & 3]);           \
+	prev_abcd = abcd;                                                                              \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, func);
+
+SHA_NI_TARGET static void sha1_compress_ni(uint32_t *state, const uint8_t *blocks, size_t count) {
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	while (count--) {
+		const __m128i abcd_save = abcd;
+		const __m128i e0_save = e0;
+		__m128i msg[4];
+		for (int i = 0; i < 4; ++i)
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16 * i)), mask);
+
+		__m128i e = e0;
+		__m128i prev_abcd = abcd;
+		int g = 0;
+		for (; g < 5; ++g) {
+			SHA1_NI_ROUNDS(0)
+		}
+		for (; g < 10; ++g) {
+			SHA1_NI_ROUNDS(1)
+		}
+		for (; g < 15; ++g) {
+			SHA1_NI_ROUNDS(2)
+		}
+		for (; g < 20; ++g) {
+			SHA1_NI_ROUNDS(3)
+		}
+
+		e0 = _mm_sha1nexte_epu32(prev_abcd, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		blocks += SHA_BLOCK_SIZE;
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+SHA_NI_TARGET static void sha256_compress_ni(uint32_t *state, const uint8_t *blocks,
+                                             size_t count) {
+	const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1); // CDAB
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); // EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                    // ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                          // CDGH
+
+	while (count--) {
+		const __m128i abef_save = state0;
+		const __m128i cdgh_save = state1;
+		__m128i msg[4];
+		for (int i = 0; i < 4; ++i)
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16 * i)), mask);
+
+		for (int g = 0; g < 16; ++g) {
+			if (g >= 4) {
+				__m128i w = _mm_sha256msg1_epu32(msg[g & 3], msg[(g + 1) & 3]);
+				w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(g + 3) & 3], msg[(g + 2) & 3], 4));
+				msg[g & 3] = _mm_sha256msg2_epu32(w, msg[(g + 3) & 3]);
+			}
+			__m128i wk = _mm_add_epi32(msg[g & 3],
+			                           _mm_loadu_si128((const __m128i *)(sha256_k + 4 * g)));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+		}
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+		blocks += SHA_BLOCK_SIZE;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);       // FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1);    // DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+	state1 = _mm_alignr_epi8(state1, tmp, 8);    // ABEF
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+#endif // SHA_NI_SUPPORTED
+
+bool sha_is_accelerated(void) {
+#if SHA_NI_SUPPORTED
+	return cpu_has_features(SHA_NI_FEATURES);
+#else
+	return false;
+#endif
+}
+
+void sha_init_sha1(sha_ctx_t *ctx) {
+	memset(ctx, 0, sizeof(*ctx));
+	memcpy(ctx->state, sha1_init_state, sizeof(sha1_init_state));
+	ctx->digest_size = SHA1_DIGEST_SIZE;
+#if SHA_NI_SUPPORTED
+	ctx->compress = sha_is_accelerated() ? sha1_compress_ni : sha1_compress;
+#else
+	ctx->compress = sha1_compress;
+#endif
+}
+
+void sha_init_sha256(sha_ctx_t *ctx) {
+	memset(ctx, 0, sizeof(*ctx));
+	memcpy(ctx->state, sha256_init_state, sizeof(sha256_init_state));
+	ctx->digest_size = SHA256_DIGEST_SIZE;
+#if SHA_NI_SUPPORTED
+	ctx->compress = sha_is_accelerated() ? sha256_compress_ni : sha256_compress;
+#else
+	ctx->compress = sha256_compress;
+#endif
+}
+
+void sha_update(sha_ctx_t *ctx, const void *data, size_t size) {
+	const uint8_t *p = data;
+	size_t used = (size_t)(ctx->length % SHA_BLOCK_SIZE);
+	ctx->length += size;
+
+	if (used) {
+		size_t left = SHA_BLOCK_SIZE - used;
+		if (size < left) {
+			memcpy(ctx->buffer + used, p, size);
+			return;
+		}
+		memcpy(ctx->buffer + used, p, left);
+		ctx->compress(ctx->state, ctx->buffer, 1);
+		p += left;
+		size -= left;
+	}
+
+	size_t count = size / SHA_BLOCK_SIZE;
+	if (count) {
+		ctx->compress(ctx->state, p, count);
+		p += count * SHA_BLOCK_SIZE;
+		size -= count * SHA_BLOCK_SIZE;
+	}
+
+	memcpy(ctx->buffer, p, size);
+}
+
+void sha_final(sha_ctx_t *ctx, void *digest) {
+	size_t used = (size_t)(ctx->length % SHA_BLOCK_SIZE);
+	uint64_t bits = ctx->length * 8;
+
+	ctx->buffer[used++] = 0x80;
+	if (used > SHA_BLOCK_SIZE - 8) {
+		memset(ctx->buffer + used, 0, SHA_BLOCK_SIZE - used);
+		ctx->compress(ctx->state, ctx->buffer, 1);
+		used = 0;
+	}
+	memset(ctx->buffer + used, 0, SHA_BLOCK_SIZE - 8 - used);
+	store_be32(ctx->buffer + SHA_BLOCK_SIZE - 8, (uint32_t)(bits >> 32));
+	store_be32(ctx->buffer + SHA_BLOCK_SIZE - 4, (uint32_t)bits);
+	ctx->compress(ctx->state, ctx->buffer, 1);
+
+	uint8_t *out = digest;
+	for (size_t i = 0; i < ctx->digest_size / 4; ++i)
+		store_be32(out + 4 * i, ctx->state[i]);
+}
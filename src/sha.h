@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef JUICE_SHA_H
+#define JUICE_SHA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SHA_BLOCK_SIZE 64
+#define SHA1_DIGEST_SIZE 20
+#define SHA256_DIGEST_SIZE 32
+
+// Built-in SHA-1 and SHA-256, the compression function is selected at runtime and uses the x86 SHA
+// extensions if the CPU supports them. Contexts may be copied to save an intermediate state.
+typedef struct sha_ctx {
+	uint32_t state[8];
+	uint64_t length;
+	uint8_t buffer[SHA_BLOCK_SIZE];
+	size_t digest_size;
+	void (*compress)(uint32_t *state, const uint8_t *blocks, size_t count);
+} sha_ctx_t;
+
+void sha_init_sha1(sha_ctx_t *ctx);
+void sha_init_sha256(sha_ctx_t *ctx);
+void sha_update(sha_ctx_t *ctx, const void *data, size_t size);
+void sha_final(sha_ctx_t *ctx, void *digest);
+
+bool sha_is_accelerated(void);
+
+#endif
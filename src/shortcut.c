@@ -0,0 +1,209 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "shortcut.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NO_ATOMICS
+#define shortcut_load(var) (var)
+#define shortcut_store(var, value) ((var) = (value))
+#else
+#define shortcut_load(var) atomic_load(&(var))
+#define shortcut_store(var, value) atomic_store(&(var), (value))
+#endif
+
+static mutex_t registry_mutex = MUTEX_INITIALIZER;
+static shortcut_t *registry = NULL;
+
+void shortcut_init(shortcut_t *shortcut, wakeup_t *wakeup) {
+	shortcut->slots = NULL;
+	shortcut->wakeup = wakeup;
+#ifdef NO_ATOMICS
+	shortcut->head = 0;
+	shortcut->tail = 0;
+	shortcut->waiting = false;
+	shortcut->peer = NULL;
+#else
+	atomic_init(&shortcut->head, 0);
+	atomic_init(&shortcut->tail, 0);
+	atomic_init(&shortcut->waiting, false);
+	atomic_init(&shortcut->peer, NULL);
+#endif
+	mutex_init(&shortcut->mutex, 0);
+	shortcut->registered = false;
+	*shortcut->ufrag = '\0';
+	*shortcut->pwd = '\0';
+	*shortcut->remote_ufrag = '\0';
+	*shortcut->remote_pwd = '\0';
+	shortcut->next = NULL;
+}
+
+void shortcut_cleanup(shortcut_t *shortcut) {
+	mutex_lock(&registry_mutex);
+	shortcut_t **pos = &registry;
+	while (*pos && *pos != shortcut)
+		pos = &(*pos)->next;
+	if (*pos)
+		*pos = shortcut->next;
+
+	shortcut->registered = false;
+
+	// Only registered shortcuts may link, so this unlinks every producer to the ring
+	for (shortcut_t *other = registry; other; other = other->next) {
+		if (shortcut_load(other->peer) == shortcut) {
+			mutex_lock(&other->mutex);
+			shortcut_store(other->peer, NULL);
+			mutex_unlock(&other->mutex);
+		}
+	}
+	mutex_unlock(&registry_mutex);
+
+	shortcut_unlink(shortcut);
+	mutex_destroy(&shortcut->mutex);
+	free(shortcut->slots);
+	shortcut->slots = NULL;
+}
+
+int shortcut_register(shortcut_t *shortcut, const char *ufrag, const char *pwd) {
+	if (!shortcut->slots) {
+		shortcut->slots = malloc(SHORTCUT_RING_SIZE * sizeof(shortcut_slot_t));
+		if (!shortcut->slots)
+			return -1;
+	}
+
+	mutex_lock(&registry_mutex);
+	snprintf(shortcut->ufrag, SHORTCUT_MAX_CREDENTIAL_LEN, "%s", ufrag);
+	snprintf(shortcut->pwd, SHORTCUT_MAX_CREDENTIAL_LEN, "%s", pwd);
+	if (!shortcut->registered) {
+		shortcut->next = registry;
+		registry = shortcut;
+		shortcut->registered = true;
+	}
+	mutex_unlock(&registry_mutex);
+	return 0;
+}
+
+void shortcut_set_remote(shortcut_t *shortcut, const char *remote_ufrag, const char *remote_pwd) {
+	mutex_lock(&registry_mutex);
+	snprintf(shortcut->remote_ufrag, SHORTCUT_MAX_CREDENTIAL_LEN, "%s", remote_ufrag);
+	snprintf(shortcut->remote_pwd, SHORTCUT_MAX_CREDENTIAL_LEN, "%s", remote_pwd);
+	mutex_unlock(&registry_mutex);
+}
+
+static bool is_linkable(const shortcut_t *shortcut, const shortcut_t *other) {
+	return other != shortcut && strcmp(other->ufrag, shortcut->remote_ufrag) == 0 &&
+	       strcmp(other->pwd, shortcut->remote_pwd) == 0 &&
+	       strcmp(other->remote_ufrag, shortcut->ufrag) == 0 &&
+	       strcmp(other->remote_pwd, shortcut->pwd) == 0;
+}
+
+bool shortcut_link(shortcut_t *shortcut) {
+	mutex_lock(&registry_mutex);
+	shortcut_t *found = NULL;
+	if (shortcut->registered && *shortcut->remote_ufrag != '\0') {
+		for (shortcut_t *other = registry; other; other = other->next) {
+			if (is_linkable(shortcut, other)) {
+				found = other;
+				break;
+			}
+		}
+	}
+
+	// Links are only set with the registry mutex locked, so this keeps a single producer per ring
+	if (found) {
+		for (shortcut_t *other = registry; other; other = other->next) {
+			if (other != shortcut && shortcut_load(other->peer) == found) {
+				found = NULL;
+				break;
+			}
+		}
+	}
+
+	mutex_lock(&shortcut->mutex);
+	shortcut_store(shortcut->peer, found);
+	mutex_unlock(&shortcut->mutex);
+
+	mutex_unlock(&registry_mutex);
+	return found != NULL;
+}
+
+void shortcut_unlink(shortcut_t *shortcut) {
+	mutex_lock(&shortcut->mutex);
+	shortcut_store(shortcut->peer, NULL);
+	mutex_unlock(&shortcut->mutex);
+}
+
+int shortcut_send(shortcut_t *shortcut, const char *data, size_t size) {
+	if (!shortcut_load(shortcut->peer) || size > SHORTCUT_SLOT_SIZE)
+		return -1;
+
+	mutex_lock(&shortcut->mutex);
+	shortcut_t *peer = shortcut_load(shortcut->peer);
+	if (!peer) {
+		mutex_unlock(&shortcut->mutex);
+		return -1;
+	}
+
+	unsigned int tail = shortcut_load(peer->tail);
+	if (tail - shortcut_load(peer->head) >= SHORTCUT_RING_SIZE) {
+		mutex_unlock(&shortcut->mutex);
+		return -1; // full
+	}
+
+	shortcut_slot_t *slot = peer->slots + (tail & (SHORTCUT_RING_SIZE - 1));
+	memcpy(slot->data, data, size);
+	slot->size = size;
+	shortcut_store(peer->tail, tail + 1);
+
+#ifdef NO_ATOMICS
+	wakeup_trigger(peer->wakeup);
+#else
+	// The consumer drains the ring before waiting, so it only needs a wakeup if it is waiting
+	if (atomic_exchange(&peer->waiting, false))
+		wakeup_trigger(peer->wakeup);
+#endif
+
+	mutex_unlock(&shortcut->mutex);
+	return 0;
+}
+
+const shortcut_slot_t *shortcut_peek(shortcut_t *shortcut) {
+	if (!shortcut->slots)
+		return NULL;
+
+	unsigned int head = shortcut_load(shortcut->head);
+	if (head == shortcut_load(shortcut->tail))
+		return NULL;
+
+	return shortcut->slots + (head & (SHORTCUT_RING_SIZE - 1));
+}
+
+void shortcut_release(shortcut_t *shortcut) {
+	unsigned int head = shortcut_load(shortcut->head);
+	shortcut_store(shortcut->head, head + 1);
+}
+
+bool shortcut_prepare_wait(shortcut_t *shortcut) {
+	shortcut_store(shortcut->waiting, true);
+	return shortcut_peek(shortcut) == NULL;
+}
+
+void shortcut_end_wait(shortcut_t *shortcut) { shortcut_store(shortcut->waiting, false); }
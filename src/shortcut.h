@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef JUICE_SHORTCUT_H
+#define JUICE_SHORTCUT_H
+
+#ifdef __STDC_NO_ATOMICS__
+#define NO_ATOMICS
+#endif
+
+#include "thread.h"
+#include "wakeup.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef NO_ATOMICS
+#include <stdatomic.h>
+#endif
+
+#define SHORTCUT_RING_SIZE 32    // slots, must be a power of 2
+#define SHORTCUT_SLOT_SIZE 2048  // larger datagrams go through the socket
+#define SHORTCUT_MAX_CREDENTIAL_LEN 256 + 1
+
+// In-process shortcut between co-located agents
+// Agents enabling it register their ICE credentials in a process-wide registry. Once an agent
+// selects a pair, it links to the registered agent whose local credentials match its remote ones
+// and whose remote credentials match its local ones, if any, and application datagrams are then
+// delivered into the inbound ring of the linked agent instead of being sent on the network. ICE
+// runs as usual, including consent checks on the selected pair.
+// Each ring has a single producer, the only agent linked to it, sending with its shortcut mutex
+// locked, and a single consumer, the thread of the agent owning it.
+
+typedef struct shortcut_slot {
+	size_t size;
+	char data[SHORTCUT_SLOT_SIZE];
+} shortcut_slot_t;
+
+typedef struct shortcut {
+	// Inbound ring, allocated on registration
+	shortcut_slot_t *slots;
+	wakeup_t *wakeup; // of the consumer thread
+#ifdef NO_ATOMICS
+	volatile unsigned int head; // written by the consumer
+	volatile unsigned int tail; // written by the producer
+	volatile bool waiting;      // the consumer is about to wait for the wakeup
+#else
+	_Atomic(unsigned int) head;
+	_Atomic(unsigned int) tail;
+	_Atomic(bool) waiting;
+#endif
+
+	// Outbound link, set and unset with the mutex locked
+	mutex_t mutex;
+#ifdef NO_ATOMICS
+	struct shortcut *volatile peer;
+#else
+	_Atomic(struct shortcut *) peer;
+#endif
+
+	// Registry, guarded by the registry mutex
+	bool registered;
+	char ufrag[SHORTCUT_MAX_CREDENTIAL_LEN];
+	char pwd[SHORTCUT_MAX_CREDENTIAL_LEN];
+	char remote_ufrag[SHORTCUT_MAX_CREDENTIAL_LEN];
+	char remote_pwd[SHORTCUT_MAX_CREDENTIAL_LEN];
+	struct shortcut *next;
+} shortcut_t;
+
+void shortcut_init(shortcut_t *shortcut, wakeup_t *wakeup);
+void shortcut_cleanup(shortcut_t *shortcut); // unregisters and unlinks from and to it
+
+// Registers or updates the local credentials, returns -1 on allocation failure
+int shortcut_register(shortcut_t *shortcut, const char *ufrag, const char *pwd);
+
+// Sets the remote credentials, they must match the local ones of the agent to link to and the
+// other way around
+void shortcut_set_remote(shortcut_t *shortcut, const char *remote_ufrag, const char *remote_pwd);
+
+// Links to the matching registered agent if no other agent is linked to it, returns true if linked
+bool shortcut_link(shortcut_t *shortcut);
+void shortcut_unlink(shortcut_t *shortcut);
+
+// Producer side, returns -1 if the datagram was not delivered and must go through the socket
+int shortcut_send(shortcut_t *shortcut, const char *data, size_t size);
+
+// Consumer side, to be called by the thread of the owning agent
+const shortcut_slot_t *shortcut_peek(shortcut_t *shortcut); // NULL if the ring is empty
+void shortcut_release(shortcut_t *shortcut);                 // releases the peeked slot
+bool shortcut_prepare_wait(shortcut_t *shortcut); // returns false if datagrams are pending
+void shortcut_end_wait(shortcut_t *shortcut);
+
+#endif // JUICE_SHORTCUT_H
@@ -25,6 +25,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -55,21 +56,21 @@ static size_t align32(size_t len) {
 	return len;
 }
 
-static size_t generate_hmac_key(const stun_message_t *msg, const char *password, void *key,
-                                juice_logger_t *logger) {
-	if (*msg->credentials.realm != '\0') {
+static size_t generate_hmac_key(const stun_credentials_t *credentials, const char *password,
+                                void *key, juice_logger_t *logger) {
+	if (*credentials->realm != '\0') {
 		// long-term credentials
-		if (*msg->credentials.username == '\0')
+		if (*credentials->username == '\0')
 			JLOG_WARN(logger,
 			          "Generating HMAC key for long-term credentials with empty STUN username");
 
 		char input[MAX_HMAC_INPUT_LEN];
-		int input_len = snprintf(input, MAX_HMAC_INPUT_LEN, "%s:%s:%s", msg->credentials.username,
-		                         msg->credentials.realm, password ? password : "");
+		int input_len = snprintf(input, MAX_HMAC_INPUT_LEN, "%s:%s:%s", credentials->username,
+		                         credentials->realm, password ? password : "");
 		if (input_len < 0)
 			return 0;
 
-		switch (msg->credentials.password_algorithm) {
+		switch (credentials->password_algorithm) {
 		case STUN_PASSWORD_ALGORITHM_SHA256:
 			hash_sha256(input, input_len, key);
 			return HASH_SHA256_SIZE;
@@ -84,6 +85,22 @@ static size_t generate_hmac_key(const stun_message_t *msg, const char *password,
 	}
 }
 
+// Computes the HMAC with the precomputed key if set, or with the key generated from the password
+static void compute_hmac(bool sha256, const void *message, size_t size, const uint8_t *key,
+                         size_t key_len, const hmac_key_t *hkey, void *digest) {
+	if (hkey) {
+		if (sha256)
+			hmac_key_sha256(hkey, message, size, digest);
+		else
+			hmac_key_sha1(hkey, message, size, digest);
+	} else {
+		if (sha256)
+			hmac_sha256(message, size, key, key_len, digest);
+		else
+			hmac_sha1(message, size, key, key_len, digest);
+	}
+}
+
 static size_t generate_password_algorithms_attr(uint8_t *attr) {
 	// attr size must be at least STUN_PASSWORD_ALGORITHMS_ATTR_MAX_SIZE
 	struct stun_value_password_algorithm *pwa = (struct stun_value_password_algorithm *)attr;
@@ -96,8 +113,8 @@ static size_t generate_password_algorithms_attr(uint8_t *attr) {
 	return (uint8_t *)pwa - attr;
 }
 
-int stun_write(void *buf, size_t size, const stun_message_t *msg, const char *password,
-               juice_logger_t *logger) {
+static int write_message(void *buf, size_t size, const stun_message_t *msg, const char *password,
+                         const hmac_key_t *hkey, juice_logger_t *logger) {
 	uint8_t *begin = buf;
 	uint8_t *pos = begin;
 	uint8_t *end = begin + size;
@@ -329,7 +346,7 @@ int stun_write(void *buf, size_t size, const stun_message_t *msg, const char *pa
 			}
 		}
 	}
-	if (msg->msg_class != STUN_CLASS_INDICATION && password) {
+	if (msg->msg_class != STUN_CLASS_INDICATION && (password || hkey)) {
 		// According to RFC 8489, the agent must include both MESSAGE-INTEGRITY and
 		// MESSAGE-INTEGRITY-SHA256. However, this make legacy agents and servers fail with error
 		// 420 Unknown Attribute. Therefore, only MESSAGE-INTEGRITY is included in the message for
@@ -337,7 +354,7 @@ int stun_write(void *buf, size_t size, const stun_message_t *msg, const char *pa
 		size_t tmp_length = pos - attr_begin + STUN_ATTR_SIZE + HMAC_SHA1_SIZE;
 		stun_update_header_length(begin, tmp_length);
 		uint8_t key[MAX_HMAC_KEY_LEN];
-		size_t key_len = generate_hmac_key(msg, password, key, logger);
+		size_t key_len = hkey ? 0 : generate_hmac_key(&msg->credentials, password, key, logger);
 
 		// According to RFC 8489, the agent must include both MESSAGE-INTEGRITY and
 		// MESSAGE-INTEGRITY-SHA256. However, this makes older servers fail with error 420 Unknown
@@ -348,7 +365,7 @@ int stun_write(void *buf, size_t size, const stun_message_t *msg, const char *pa
 			// subsequent requests MUST be authenticated using MESSAGE-INTEGRITY-
 			// SHA256 only.
 			uint8_t hmac[HMAC_SHA256_SIZE];
-			hmac_sha256(begin, pos - begin, key, key_len, hmac);
+			compute_hmac(true, begin, pos - begin, key, key_len, hkey, hmac);
 			len = stun_write_attr(pos, end - pos, STUN_ATTR_MESSAGE_INTEGRITY_SHA256, hmac,
 			                      HMAC_SHA256_SIZE, logger);
 			if (len <= 0)
@@ -357,7 +374,7 @@ int stun_write(void *buf, size_t size, const stun_message_t *msg, const char *pa
 		}
 
 		uint8_t hmac[HMAC_SHA1_SIZE];
-		hmac_sha1(begin, pos - begin, key, key_len, hmac);
+		compute_hmac(false, begin, pos - begin, key, key_len, hkey, hmac);
 		len = stun_write_attr(pos, end - pos, STUN_ATTR_MESSAGE_INTEGRITY, hmac, HMAC_SHA1_SIZE,
 		                      logger);
 		if (len <= 0)
@@ -385,6 +402,16 @@ overflow:
 	return -1;
 }
 
+int stun_write(void *buf, size_t size, const stun_message_t *msg, const char *password,
+               juice_logger_t *logger) {
+	return write_message(buf, size, msg, password, NULL, logger);
+}
+
+int stun_write_hmac(void *buf, size_t size, const stun_message_t *msg, const hmac_key_t *hkey,
+                    juice_logger_t *logger) {
+	return write_message(buf, size, msg, NULL, hkey, logger);
+}
+
 int stun_write_header(void *buf, size_t size, stun_class_t class, stun_method_t method,
                       const uint8_t *transaction_id) {
 	if (size < sizeof(struct stun_header))
@@ -510,8 +537,11 @@ bool is_stun_datagram(const void *data, size_t size, juice_logger_t *logger) {
 	return true;
 }
 
-int stun_read(void *data, size_t size, stun_message_t *msg, juice_logger_t *logger) {
-	memset(msg, 0, sizeof(*msg));
+int stun_read_view(const void *data, size_t size, stun_view_t *view, juice_logger_t *logger) {
+	if (size < sizeof(struct stun_header)) {
+		JLOG_ERROR(logger, "STUN message too short, size=%zu", size);
+		return -1;
+	}
 
 	const struct stun_header *header = data;
 	const size_t length = ntohs(header->length);
@@ -522,25 +552,153 @@ int stun_read(void *data, size_t size, stun_message_t *msg, juice_logger_t *logg
 	}
 
 	uint16_t type = ntohs(header->type);
-	msg->msg_class = (stun_class_t)(type & STUN_CLASS_MASK);
-	msg->msg_method = (stun_method_t)(type & ~STUN_CLASS_MASK);
-	memcpy(msg->transaction_id, header->transaction_id, STUN_TRANSACTION_ID_SIZE);
+	view->data = data;
+	view->size = sizeof(struct stun_header) + length;
+	view->msg_class = (stun_class_t)(type & STUN_CLASS_MASK);
+	view->msg_method = (stun_method_t)(type & ~STUN_CLASS_MASK);
+	view->transaction_id = header->transaction_id;
+	view->attrs_count = 0;
+	view->has_integrity = false;
+	view->has_fingerprint = false;
 	JLOG_VERBOSE(logger, "Reading STUN message, class=0x%X, method=0x%X",
-	             (unsigned int)msg->msg_class, (unsigned int)msg->msg_method);
-
-	uint32_t security_bits = 0;
+	             (unsigned int)view->msg_class, (unsigned int)view->msg_method);
 
-	uint8_t *begin = data;
-	uint8_t *attr_begin = begin + sizeof(struct stun_header);
-	uint8_t *end = attr_begin + length;
-	const uint8_t *pos = attr_begin;
+	const uint8_t *begin = data;
+	const uint8_t *end = begin + view->size;
+	const uint8_t *pos = begin + sizeof(struct stun_header);
 	while (pos != end) {
-		int ret = stun_read_attr(pos, end - pos, msg, begin, attr_begin, &security_bits, logger);
-		if (ret <= 0) {
+		// RFC 8489: When present, the FINGERPRINT attribute MUST be the last attribute in the
+		// message and thus will appear after MESSAGE-INTEGRITY and MESSAGE-INTEGRITY-SHA256.
+		if (view->has_fingerprint) {
+			JLOG_DEBUG(logger, "Invalid STUN attribute after fingerprint");
+			return -1;
+		}
+
+		if ((size_t)(end - pos) < sizeof(struct stun_attr)) {
+			JLOG_VERBOSE(logger, "STUN attribute too short");
+			return -1;
+		}
+
+		const struct stun_attr *attr = (const struct stun_attr *)pos;
+		size_t attr_length = ntohs(attr->length);
+		stun_attr_type_t attr_type = (stun_attr_type_t)ntohs(attr->type);
+		JLOG_VERBOSE(logger, "Indexing attribute 0x%X, length=%zu", (unsigned int)attr_type,
+		             attr_length);
+		if ((size_t)(end - pos) < sizeof(struct stun_attr) + attr_length) {
+			JLOG_DEBUG(logger, "STUN attribute length invalid, length=%zu, available=%zu",
+			           attr_length, (size_t)(end - pos) - sizeof(struct stun_attr));
+			return -1;
+		}
+
+		// Attributes are aligned on 4 bytes, tolerate missing padding on the last one
+		size_t padded_length = sizeof(struct stun_attr) + align32(attr_length);
+		const uint8_t *next = (size_t)(end - pos) > padded_length ? pos + padded_length : end;
+
+		// RFC 8489: Note that agents MUST ignore all attributes that follow MESSAGE-INTEGRITY, with
+		// the exception of the MESSAGE-INTEGRITY-SHA256 and FINGERPRINT attributes.
+		if (view->has_integrity && attr_type != STUN_ATTR_FINGERPRINT) {
+			JLOG_DEBUG(logger, "Ignoring STUN attribute 0x%X after message integrity",
+			           (unsigned int)attr_type);
+			pos = next;
+			continue;
+		}
+
+		switch (attr_type) {
+		case STUN_ATTR_MESSAGE_INTEGRITY:
+		case STUN_ATTR_MESSAGE_INTEGRITY_SHA256: {
+			size_t expected_length = attr_type == STUN_ATTR_MESSAGE_INTEGRITY ? HMAC_SHA1_SIZE
+			                                                                  : HMAC_SHA256_SIZE;
+			if (attr_length != expected_length) {
+				JLOG_DEBUG(logger, "STUN message integrity length invalid, length=%zu",
+				           attr_length);
+				return -1;
+			}
+			view->has_integrity = true;
+			break;
+		}
+		case STUN_ATTR_FINGERPRINT: {
+			if (attr_length != 4) {
+				JLOG_DEBUG(logger, "STUN fingerprint length invalid, length=%zu", attr_length);
+				return -1;
+			}
+			if (next != end) {
+				JLOG_DEBUG(logger, "Invalid STUN attribute after fingerprint");
+				return -1;
+			}
+			// As the fingerprint is last, the header length already covers it
+			uint32_t expected = CRC32(begin, pos - begin) ^ STUN_FINGERPRINT_XOR;
+			uint32_t fingerprint = ntohl(*((uint32_t *)attr->value));
+			if (fingerprint != expected) {
+				JLOG_ERROR(logger, "STUN fingerprint check failed, expected=%lX, actual=%lX",
+				           (unsigned long)expected, (unsigned long)fingerprint);
+				return -1;
+			}
+			JLOG_VERBOSE(logger, "STUN fingerprint check succeeded");
+			view->has_fingerprint = true;
+			break;
+		}
+		default:
+			break;
+		}
+
+		if (view->attrs_count == STUN_VIEW_MAX_ATTRS) {
+			// Past the limit, comprehension-optional attributes may be skipped like unknown ones
+			if (!STUN_IS_OPTIONAL_ATTR(attr_type)) {
+				JLOG_DEBUG(logger, "Too many STUN attributes, max=%d", STUN_VIEW_MAX_ATTRS);
+				return -1;
+			}
+			JLOG_DEBUG(logger, "Skipping optional STUN attribute 0x%X, too many attributes",
+			           (unsigned int)attr_type);
+			pos = next;
+			continue;
+		}
+
+		stun_attr_ref_t *ref = view->attrs + view->attrs_count++;
+		ref->type = (uint16_t)attr_type;
+		ref->length = (uint16_t)attr_length;
+		ref->offset = (uint32_t)(attr->value - begin);
+		pos = next;
+	}
+
+	return (int)view->size;
+}
+
+static void init_message(stun_message_t *msg) {
+	// Zeroing the whole message would touch the large credential buffers, so only reset what
+	// tells whether they are set
+	memset(msg, 0, offsetof(stun_message_t, credentials));
+	stun_credentials_t *credentials = &msg->credentials;
+	credentials->username[0] = '\0';
+	credentials->realm[0] = '\0';
+	credentials->nonce[0] = '\0';
+	credentials->enable_userhash = false;
+	credentials->password_algorithm = STUN_PASSWORD_ALGORITHM_UNSET;
+	credentials->password_algorithms_value_size = 0;
+	size_t tail_offset = offsetof(stun_message_t, credentials) + sizeof(stun_credentials_t);
+	memset((uint8_t *)msg + tail_offset, 0, sizeof(stun_message_t) - tail_offset);
+}
+
+static int read_attr_value(stun_attr_type_t type, const uint8_t *value, size_t length,
+                           stun_message_t *msg, uint32_t *security_bits, juice_logger_t *logger);
+
+int stun_read_from_view(const stun_view_t *view, stun_message_t *msg, juice_logger_t *logger) {
+	init_message(msg);
+	msg->msg_class = view->msg_class;
+	msg->msg_method = view->msg_method;
+	memcpy(msg->transaction_id, view->transaction_id, STUN_TRANSACTION_ID_SIZE);
+	msg->has_integrity = view->has_integrity;
+	msg->has_fingerprint = view->has_fingerprint;
+
+	uint32_t security_bits = 0;
+	for (int i = 0; i < view->attrs_count; ++i) {
+		const stun_attr_ref_t *ref = view->attrs + i;
+		JLOG_VERBOSE(logger, "Reading attribute 0x%X, length=%u", (unsigned int)ref->type,
+		             (unsigned int)ref->length);
+		if (read_attr_value((stun_attr_type_t)ref->type, view->data + ref->offset, ref->length,
+		                    msg, &security_bits, logger) < 0) {
 			JLOG_DEBUG(logger, "Reading STUN attribute failed");
 			return -1;
 		}
-		pos += ret;
 	}
 
 	JLOG_VERBOSE(logger, "Finished reading STUN attributes");
@@ -600,48 +758,24 @@ int stun_read(void *data, size_t size, stun_message_t *msg, juice_logger_t *logg
 		credentials->enable_userhash = true;
 	}
 
-	return (int)(sizeof(struct stun_header) + length);
+	return (int)view->size;
 }
 
-int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *begin,
-                   uint8_t *attr_begin, uint32_t *security_bits, juice_logger_t *logger) {
-	// RFC 8489: When present, the FINGERPRINT attribute MUST be the last attribute in the
-	// message and thus will appear after MESSAGE-INTEGRITY and MESSAGE-INTEGRITY-SHA256.
-	if (msg->has_fingerprint) {
-		JLOG_DEBUG(logger, "Invalid STUN attribute after fingerprint");
-		return -1;
-	}
-
-	if (size < sizeof(struct stun_attr)) {
-		JLOG_VERBOSE(logger, "STUN attribute too short");
-		return -1;
-	}
-
-	const struct stun_attr *attr = data;
-	size_t length = ntohs(attr->length);
-	stun_attr_type_t type = (stun_attr_type_t)ntohs(attr->type);
-	JLOG_VERBOSE(logger, "Reading attribute 0x%X, length=%zu", (unsigned int)type, length);
-	if (size < sizeof(struct stun_attr) + length) {
-		JLOG_DEBUG(logger, "STUN attribute length invalid, length=%zu, available=%zu", length,
-		           size - sizeof(struct stun_attr));
+int stun_read(void *data, size_t size, stun_message_t *msg, juice_logger_t *logger) {
+	stun_view_t view;
+	if (stun_read_view(data, size, &view, logger) < 0)
 		return -1;
-	}
 
-	// RFC 8489: Note that agents MUST ignore all attributes that follow MESSAGE-INTEGRITY, with
-	// the exception of the MESSAGE-INTEGRITY-SHA256 and FINGERPRINT attributes.
-	if (msg->has_integrity && type != STUN_ATTR_FINGERPRINT) {
-		JLOG_DEBUG(logger, "Ignoring STUN attribute 0x%X after message integrity",
-		           (unsigned int)type);
-		while (length & 0x03)
-			++length; // attributes are aligned on 4 bytes
-		return (int)(sizeof(struct stun_attr) + length);
-	}
+	return stun_read_from_view(&view, msg, logger);
+}
 
+static int read_attr_value(stun_attr_type_t type, const uint8_t *value, size_t length,
+                           stun_message_t *msg, uint32_t *security_bits, juice_logger_t *logger) {
 	switch (type) {
 	case STUN_ATTR_MAPPED_ADDRESS: {
 		JLOG_VERBOSE(logger, "Reading mapped address");
 		uint8_t zero_mask[16] = {0};
-		if (stun_read_value_mapped_address(attr->value, length, &msg->mapped, zero_mask, logger) <
+		if (stun_read_value_mapped_address(value, length, &msg->mapped, zero_mask, logger) <
 		    0)
 			return -1;
 		break;
@@ -651,7 +785,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 		uint8_t mask[16];
 		*((uint32_t *)mask) = htonl(STUN_MAGIC);
 		memcpy(mask + 4, msg->transaction_id, 12);
-		if (stun_read_value_mapped_address(attr->value, length, &msg->mapped, mask, logger) < 0)
+		if (stun_read_value_mapped_address(value, length, &msg->mapped, mask, logger) < 0)
 			return -1;
 		break;
 	}
@@ -662,7 +796,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			return -1;
 		}
 		const struct stun_value_error_code *error =
-		    (const struct stun_value_error_code *)attr->value;
+		    (const struct stun_value_error_code *)value;
 		msg->error_code = (error->code_class & 0x07) * 100 + error->code_number;
 
 		size_t reason_length = length - sizeof(struct stun_value_error_code);
@@ -675,8 +809,8 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 	}
 	case STUN_ATTR_UNKNOWN_ATTRIBUTES: {
 		JLOG_VERBOSE(logger, "Reading STUN unknown attributes");
-		const uint16_t *attributes = (const uint16_t *)attr->value;
-		for (int i = 0; i < (int)ntohs(attr->length) / 2; ++i) {
+		const uint16_t *attributes = (const uint16_t *)value;
+		for (int i = 0; i < (int)length / 2; ++i) {
 			stun_attr_type_t type = (stun_attr_type_t)ntohs(attributes[i]);
 			JLOG_INFO(logger, "Got unknown attribute response for attribute 0x%X",
 			          (unsigned int)type);
@@ -689,57 +823,23 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_WARN(logger, "STUN username attribute value too long, length=%zu", length);
 			return -1;
 		}
-		memcpy(msg->credentials.username, (const char *)attr->value, length);
+		memcpy(msg->credentials.username, (const char *)value, length);
 		msg->credentials.username[length] = '\0';
 		JLOG_VERBOSE(logger, "Got username: %s", msg->credentials.username);
 		break;
 	}
-	case STUN_ATTR_MESSAGE_INTEGRITY: {
-		JLOG_VERBOSE(logger, "Reading message integrity");
-		if (length != HMAC_SHA1_SIZE) {
-			JLOG_DEBUG(logger, "STUN message integrity length invalid, length=%zu", length);
-			return -1;
-		}
-		msg->has_integrity = true;
-		break;
-	}
-	case STUN_ATTR_MESSAGE_INTEGRITY_SHA256: {
-		JLOG_VERBOSE(logger, "Reading message integrity SHA256");
-		if (length != HMAC_SHA256_SIZE) {
-			JLOG_DEBUG(logger, "STUN message integrity SHA256 length invalid, length=%zu", length);
-			return -1;
-		}
-		msg->has_integrity = true;
-		break;
-	}
-	case STUN_ATTR_FINGERPRINT: {
-		JLOG_VERBOSE(logger, "Reading fingerprint");
-		if (length != 4) {
-			JLOG_DEBUG(logger, "STUN fingerprint length invalid, length=%zu", length);
-			return -1;
-		}
-		size_t tmp_length = (uint8_t *)data - attr_begin + STUN_ATTR_SIZE + 4;
-		size_t prev_length = stun_update_header_length(begin, tmp_length);
-		uint32_t expected = CRC32(begin, (uint8_t *)data - begin) ^ STUN_FINGERPRINT_XOR;
-		stun_update_header_length(begin, prev_length);
-
-		uint32_t fingerprint = ntohl(*((uint32_t *)attr->value));
-		if (fingerprint != expected) {
-			JLOG_ERROR(logger, "STUN fingerprint check failed, expected=%lX, actual=%lX",
-			           (unsigned long)expected, (unsigned long)fingerprint);
-			return -1;
-		}
-		JLOG_VERBOSE(logger, "STUN fingerprint check succeeded");
-		msg->has_fingerprint = true;
+	case STUN_ATTR_MESSAGE_INTEGRITY:
+	case STUN_ATTR_MESSAGE_INTEGRITY_SHA256:
+	case STUN_ATTR_FINGERPRINT:
+		// Checked while indexing
 		break;
-	}
 	case STUN_ATTR_REALM: {
 		JLOG_VERBOSE(logger, "Reading realm");
 		if (length + 1 > STUN_MAX_REALM_LEN) {
 			JLOG_WARN(logger, "STUN realm attribute value too long, length=%zu", length);
 			return -1;
 		}
-		memcpy(msg->credentials.realm, (const char *)attr->value, length);
+		memcpy(msg->credentials.realm, (const char *)value, length);
 		msg->credentials.realm[length] = '\0';
 		JLOG_VERBOSE(logger, "Got realm: %s", msg->credentials.realm);
 		break;
@@ -750,7 +850,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_WARN(logger, "STUN nonce attribute value too long, length=%zu", length);
 			return -1;
 		}
-		memcpy(msg->credentials.nonce, (const char *)attr->value, length);
+		memcpy(msg->credentials.nonce, (const char *)value, length);
 		msg->credentials.nonce[length] = '\0';
 		JLOG_VERBOSE(logger, "Got nonce: %s", msg->credentials.nonce);
 
@@ -775,7 +875,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 				          "Nonce has cookie, but the encoded Security Feature bits field \"%s\" is "
 				          "invalid",
 				          encoded_security_bits);
-				security_bits = 0;
+				*security_bits = 0;
 			}
 		} else if (msg->msg_class == STUN_CLASS_RESP_ERROR) {
 			JLOG_INFO(logger, "Remote agent does not support RFC 8489");
@@ -790,7 +890,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 		}
 		if (!STUN_IS_RESPONSE(msg->msg_class)) {
 			const struct stun_value_password_algorithm *pwa =
-			    (const struct stun_value_password_algorithm *)attr->value;
+			    (const struct stun_value_password_algorithm *)value;
 			stun_password_algorithm_t algorithm = ntohs(pwa->algorithm);
 			if (algorithm == STUN_PASSWORD_ALGORITHM_MD5 ||
 			    algorithm == STUN_PASSWORD_ALGORITHM_SHA256)
@@ -813,11 +913,11 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			return -1;
 		}
 
-		memcpy(msg->credentials.password_algorithms_value, attr->value, length);
+		memcpy(msg->credentials.password_algorithms_value, value, length);
 		msg->credentials.password_algorithms_value_size = length;
 
 		if (!STUN_IS_RESPONSE(msg->msg_class)) {
-			const uint8_t *pos = attr->value;
+			const uint8_t *pos = value;
 			const uint8_t *end = pos + length;
 			while (pos < end) {
 				if ((size_t)(end - pos) < sizeof(struct stun_value_password_algorithm)) {
@@ -861,7 +961,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_WARN(logger, "STUN user hash value too long, length=%zu", length);
 			return -1;
 		}
-		memcpy(msg->credentials.userhash, attr->value, HASH_SHA256_SIZE);
+		memcpy(msg->credentials.userhash, value, HASH_SHA256_SIZE);
 		msg->credentials.enable_userhash = true;
 		break;
 	}
@@ -872,7 +972,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			return -1;
 		}
 		char buffer[STUN_MAX_SOFTWARE_LEN];
-		memcpy(buffer, (const char *)attr->value, length);
+		memcpy(buffer, (const char *)value, length);
 		buffer[length] = '\0';
 		JLOG_VERBOSE(logger, "Remote agent is \"%s\"", buffer);
 		break;
@@ -883,7 +983,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_DEBUG(logger, "STUN priority length invalid, length=%zu", length);
 			return -1;
 		}
-		msg->priority = ntohl(*((uint32_t *)attr->value));
+		msg->priority = ntohl(*((uint32_t *)value));
 		JLOG_VERBOSE(logger, "Got priority: %lu", (unsigned long)msg->priority);
 		break;
 	}
@@ -898,7 +998,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_DEBUG(logger, "STUN ICE controlling attribute length invalid, length=%zu", length);
 			return -1;
 		}
-		msg->ice_controlling = ntohll(*((uint64_t *)attr->value));
+		msg->ice_controlling = ntohll(*((uint64_t *)value));
 		break;
 	}
 	case STUN_ATTR_ICE_CONTROLLED: {
@@ -907,7 +1007,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_DEBUG(logger, "STUN ICE controlled attribute length invalid, length=%zu", length);
 			return -1;
 		}
-		msg->ice_controlled = ntohll(*((uint64_t *)attr->value));
+		msg->ice_controlled = ntohll(*((uint64_t *)value));
 		break;
 	}
 	case STUN_ATTR_CHANNEL_NUMBER: {
@@ -917,7 +1017,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			return -1;
 		}
 		const struct stun_value_channel_number *channel_number =
-		    (const struct stun_value_channel_number *)attr->value;
+		    (const struct stun_value_channel_number *)value;
 		msg->channel_number = ntohs(channel_number->channel_number);
 		break;
 	}
@@ -927,7 +1027,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_DEBUG(logger, "STUN lifetime attribute length invalid, length=%zu", length);
 			return -1;
 		}
-		msg->lifetime = ntohl(*((uint32_t *)attr->value));
+		msg->lifetime = ntohl(*((uint32_t *)value));
 		msg->lifetime_set = true;
 		break;
 	}
@@ -936,7 +1036,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 		uint8_t mask[16];
 		*((uint32_t *)mask) = htonl(STUN_MAGIC);
 		memcpy(mask + 4, msg->transaction_id, 12);
-		if (stun_read_value_mapped_address(attr->value, length, &msg->peer, mask, logger) < 0)
+		if (stun_read_value_mapped_address(value, length, &msg->peer, mask, logger) < 0)
 			return -1;
 		break;
 	}
@@ -945,13 +1045,13 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 		uint8_t mask[16];
 		*((uint32_t *)mask) = htonl(STUN_MAGIC);
 		memcpy(mask + 4, msg->transaction_id, 12);
-		if (stun_read_value_mapped_address(attr->value, length, &msg->relayed, mask, logger) < 0)
+		if (stun_read_value_mapped_address(value, length, &msg->relayed, mask, logger) < 0)
 			return -1;
 		break;
 	}
 	case STUN_ATTR_DATA: {
 		JLOG_VERBOSE(logger, "Found data");
-		msg->data = (const char *)attr->value;
+		msg->data = (const char *)value;
 		msg->data_size = length;
 		break;
 	}
@@ -962,7 +1062,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			return -1;
 		}
 		msg->even_port = true;
-		msg->next_port = ((struct stun_value_even_port *)attr->value)->r & 0x80;
+		msg->next_port = ((struct stun_value_even_port *)value)->r & 0x80;
 		break;
 	}
 	case STUN_ATTR_REQUESTED_TRANSPORT: {
@@ -973,7 +1073,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			return -1;
 		}
 		const struct stun_value_requested_transport *requested_transport =
-		    (const struct stun_value_requested_transport *)attr->value;
+		    (const struct stun_value_requested_transport *)value;
 		if (requested_transport->protocol != 17) { // UDP
 			JLOG_WARN(logger, "Unexpected requested transport protocol: %d",
 			          (int)requested_transport->protocol);
@@ -993,7 +1093,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 			JLOG_DEBUG(logger, "STUN reservation token length invalid, length=%zu", length);
 			return -1;
 		}
-		msg->reservation_token = ntohll(*((uint64_t *)attr->value));
+		msg->reservation_token = ntohll(*((uint64_t *)value));
 		break;
 	}
 	default: {
@@ -1006,7 +1106,7 @@ int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *
 		break;
 	}
 	}
-	return (int)(sizeof(struct stun_attr) + align32(length));
+	return 0;
 }
 
 int stun_read_value_mapped_address(const void *data, size_t size, addr_record_t *mapped,
@@ -1060,8 +1160,8 @@ int stun_read_value_mapped_address(const void *data, size_t size, addr_record_t
 	return (int)len;
 }
 
-bool stun_check_integrity(void *buf, size_t size, const stun_message_t *msg, const char *password,
-                          juice_logger_t *logger) {
+static bool check_integrity(void *buf, size_t size, const stun_message_t *msg,
+                            const char *password, const hmac_key_t *hkey, juice_logger_t *logger) {
 	if (!msg->has_integrity)
 		return false;
 
@@ -1071,7 +1171,7 @@ bool stun_check_integrity(void *buf, size_t size, const stun_message_t *msg, con
 		return false;
 
 	uint8_t key[MAX_HMAC_KEY_LEN];
-	size_t key_len = generate_hmac_key(msg, password, key, logger);
+	size_t key_len = hkey ? 0 : generate_hmac_key(&msg->credentials, password, key, logger);
 
 	bool success = false;
 	uint8_t *begin = buf;
@@ -1093,7 +1193,7 @@ bool stun_check_integrity(void *buf, size_t size, const stun_message_t *msg, con
 			size_t tmp_length = pos - attr_begin + STUN_ATTR_SIZE + HMAC_SHA1_SIZE;
 			size_t prev_length = stun_update_header_length(begin, tmp_length);
 			uint8_t hmac[HMAC_SHA1_SIZE];
-			hmac_sha1(begin, pos - begin, key, key_len, hmac);
+			compute_hmac(false, begin, pos - begin, key, key_len, hkey, hmac);
 			stun_update_header_length(begin, prev_length);
 
 			const uint8_t *expected_hmac = attr->value;
@@ -1112,7 +1212,7 @@ bool stun_check_integrity(void *buf, size_t size, const stun_message_t *msg, con
 			size_t tmp_length = pos - attr_begin + STUN_ATTR_SIZE + HMAC_SHA256_SIZE;
 			size_t prev_length = stun_update_header_length(begin, tmp_length);
 			uint8_t hmac[HMAC_SHA256_SIZE];
-			hmac_sha256(begin, pos - begin, key, key_len, hmac);
+			compute_hmac(true, begin, pos - begin, key, key_len, hkey, hmac);
 			stun_update_header_length(begin, prev_length);
 
 			const uint8_t *expected_hmac = attr->value;
@@ -1139,6 +1239,25 @@ bool stun_check_integrity(void *buf, size_t size, const stun_message_t *msg, con
 	return true;
 }
 
+bool stun_check_integrity(void *buf, size_t size, const stun_message_t *msg, const char *password,
+                          juice_logger_t *logger) {
+	return check_integrity(buf, size, msg, password, NULL, logger);
+}
+
+bool stun_check_integrity_hmac(void *buf, size_t size, const stun_message_t *msg,
+                               const hmac_key_t *hkey, juice_logger_t *logger) {
+	return check_integrity(buf, size, msg, NULL, hkey, logger);
+}
+
+hmac_key_t *stun_create_hmac_key(const stun_credentials_t *credentials, const char *password,
+                                 juice_logger_t *logger) {
+	uint8_t key[MAX_HMAC_KEY_LEN];
+	size_t key_len = generate_hmac_key(credentials, password, key, logger);
+	hmac_key_t *hkey = hmac_key_create(key, key_len);
+	memset(key, 0, MAX_HMAC_KEY_LEN);
+	return hkey;
+}
+
 void stun_prepend_nonce_cookie(char *nonce) {
 	// RFC 8489: To indicate that it supports this specification, a server MUST prepend the
 	// NONCE attribute value with the character string composed of "obMatJos2" concatenated with
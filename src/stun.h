@@ -349,8 +349,33 @@ typedef struct stun_message {
 
 } stun_message_t;
 
+// Indexed attributes per message, comprehension-optional attributes past it are skipped while
+// comprehension-required ones make the message invalid
+#define STUN_VIEW_MAX_ATTRS 32
+
+typedef struct stun_attr_ref {
+	uint16_t type;
+	uint16_t length;
+	uint32_t offset; // of the value from the beginning of the message
+} stun_attr_ref_t;
+
+// Validated message referencing the original buffer, nothing is copied
+typedef struct stun_view {
+	const uint8_t *data;
+	size_t size;
+	stun_class_t msg_class;
+	stun_method_t msg_method;
+	const uint8_t *transaction_id;
+	stun_attr_ref_t attrs[STUN_VIEW_MAX_ATTRS]; // attributes ignored after integrity are omitted
+	int attrs_count;
+	bool has_integrity;
+	bool has_fingerprint;
+} stun_view_t;
+
 int stun_write(void *buf, size_t size, const stun_message_t *msg, const char *password,
                juice_logger_t *logger); // password may be NULL
+int stun_write_hmac(void *buf, size_t size, const stun_message_t *msg, const hmac_key_t *hkey,
+                    juice_logger_t *logger); // hkey may be NULL
 int stun_write_header(void *buf, size_t size, stun_class_t class, stun_method_t method,
                       const uint8_t *transaction_id);
 size_t stun_update_header_length(void *buf, size_t length);
@@ -361,14 +386,23 @@ int stun_write_value_mapped_address(void *buf, size_t size, const struct sockadd
 
 bool is_stun_datagram(const void *data, size_t size, juice_logger_t *logger);
 
+// Reading is done in two passes: the message is first validated and its attributes indexed in
+// place, then the attribute values are decoded from the original buffer into the message.
+int stun_read_view(const void *data, size_t size, stun_view_t *view, juice_logger_t *logger);
+int stun_read_from_view(const stun_view_t *view, stun_message_t *msg, juice_logger_t *logger);
 int stun_read(void *data, size_t size, stun_message_t *msg, juice_logger_t *logger);
-int stun_read_attr(const void *data, size_t size, stun_message_t *msg, uint8_t *begin,
-                   uint8_t *attr_begin, uint32_t *security_bits, juice_logger_t *logger);
 int stun_read_value_mapped_address(const void *data, size_t size, addr_record_t *mapped,
                                    const uint8_t *mask, juice_logger_t *logger);
 
 bool stun_check_integrity(void *buf, size_t size, const stun_message_t *msg, const char *password,
                           juice_logger_t *logger);
+bool stun_check_integrity_hmac(void *buf, size_t size, const stun_message_t *msg,
+                               const hmac_key_t *hkey, juice_logger_t *logger);
+
+// Precomputes the HMAC key for the credentials, long-term if the realm is set, short-term
+// otherwise. The password algorithm must match the one of the messages it is used with.
+hmac_key_t *stun_create_hmac_key(const stun_credentials_t *credentials, const char *password,
+                                 juice_logger_t *logger);
 
 void stun_compute_userhash(const char *username, const char *realm, uint8_t *out);
 void stun_prepend_nonce_cookie(char *nonce);
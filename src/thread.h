@@ -71,6 +71,7 @@ static inline void thread_join_impl(thread_t t, thread_return_t *res) {
 #define thread_init(t, func, arg)                                                                  \
 	((*(t) = CreateThread(NULL, 0, func, arg, 0, NULL)) != NULL ? 0 : (int)GetLastError())
 #define thread_join(t, res) thread_join_impl(t, res)
+#define thread_detach(t) (void)CloseHandle(t)
 
 #else // POSIX
 
@@ -102,7 +103,16 @@ static inline int mutex_init_impl(mutex_t *m, int flags) {
 
 #define thread_init(t, func, arg) pthread_create(t, NULL, func, arg)
 #define thread_join(t, res) (void)pthread_join(t, res)
+#define thread_detach(t) (void)pthread_detach(t)
 
 #endif
 
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
 #endif // JUICE_THREAD_H
@@ -17,6 +17,9 @@
  */
 
 #include "timestamp.h"
+#include "thread.h" // for THREAD_LOCAL
+
+#include <stdbool.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -24,13 +27,47 @@
 #include <time.h>
 #endif
 
+// The coarse clock is much cheaper to read but only has a resolution of a few msecs
+#if JUICE_ENABLE_COARSE_TIMESTAMP && defined(CLOCK_MONOTONIC_COARSE)
+#define TIMESTAMP_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define TIMESTAMP_CLOCK CLOCK_MONOTONIC
+#endif
+
+static THREAD_LOCAL bool cached_valid = false;
+static THREAD_LOCAL timestamp_t cached_now;
+
 timestamp_t current_timestamp() {
 #ifdef _WIN32
 	return (timestamp_t)GetTickCount();
 #else // POSIX
 	struct timespec ts;
-	if (clock_gettime(CLOCK_REALTIME, &ts))
+	if (clock_gettime(TIMESTAMP_CLOCK, &ts))
 		return 0;
 	return (timestamp_t)ts.tv_sec * 1000 + (timestamp_t)ts.tv_nsec / 1000000;
 #endif
 }
+
+timestamp_t current_timestamp_us() {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	if (!QueryPerformanceFrequency(&frequency) || !QueryPerformanceCounter(&counter))
+		return (timestamp_t)GetTickCount() * 1000;
+	return (timestamp_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+	       (timestamp_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else // POSIX
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (timestamp_t)ts.tv_sec * 1000000 + (timestamp_t)ts.tv_nsec / 1000;
+#endif
+}
+
+void timestamp_update(void) {
+	cached_now = current_timestamp();
+	cached_valid = true;
+}
+
+void timestamp_reset(void) { cached_valid = false; }
+
+timestamp_t cached_timestamp() { return cached_valid ? cached_now : current_timestamp(); }
@@ -25,6 +25,14 @@
 typedef int64_t timestamp_t;
 typedef timestamp_t timediff_t;
 
-timestamp_t current_timestamp();
+// Monotonic clock, unaffected by changes of the system time
+timestamp_t current_timestamp();    // msecs
+timestamp_t current_timestamp_us(); // usecs
+
+// Per-thread time read once per loop iteration, so bookkeeping, pacing, and rate limiting agree on
+// the current time. On threads without a loop, the clock is read directly.
+void timestamp_update(void);
+void timestamp_reset(void);
+timestamp_t cached_timestamp(); // msecs
 
 #endif
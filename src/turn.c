@@ -219,7 +219,7 @@ static bool update_timestamp(turn_map_t *map, turn_entry_type_t type, const uint
 			return false;
 	}
 
-	entry->timestamp = current_timestamp() + duration;
+	entry->timestamp = cached_timestamp() + duration;
 	entry->fresh_transaction_id = false;
 	return true;
 }
@@ -261,7 +261,7 @@ bool turn_has_permission(turn_map_t *map, const addr_record_t *record, juice_log
 	if (!entry || entry->type != TURN_ENTRY_TYPE_PERMISSION)
 		return false;
 
-	return current_timestamp() < entry->timestamp;
+	return cached_timestamp() < entry->timestamp;
 }
 
 bool turn_bind_channel(turn_map_t *map, const addr_record_t *record, const uint8_t *transaction_id,
@@ -281,7 +281,7 @@ bool turn_bind_channel(turn_map_t *map, const addr_record_t *record, const uint8
 			return false;
 		}
 
-		entry->timestamp = current_timestamp() + duration;
+		entry->timestamp = cached_timestamp() + duration;
 		return true;
 	}
 
@@ -305,7 +305,7 @@ bool turn_bind_channel(turn_map_t *map, const addr_record_t *record, const uint8
 	map->channels_count++;
 
 	entry->channel = channel;
-	entry->timestamp = current_timestamp() + duration;
+	entry->timestamp = cached_timestamp() + duration;
 
 	if (transaction_id) {
 		memcpy(entry->transaction_id, transaction_id, STUN_TRANSACTION_ID_SIZE);
@@ -355,7 +355,7 @@ bool turn_get_bound_channel(turn_map_t *map, const addr_record_t *record, uint16
 	if (!entry || entry->type != TURN_ENTRY_TYPE_CHANNEL)
 		return false;
 
-	if (!entry->channel || current_timestamp() >= entry->timestamp)
+	if (!entry->channel || cached_timestamp() >= entry->timestamp)
 		return false;
 
 	if (channel)
@@ -397,7 +397,7 @@ bool turn_find_bound_channel(turn_map_t *map, uint16_t channel, addr_record_t *r
 		return false;
 
 	const turn_entry_t *entry = map->ordered_channels[pos];
-	if (entry->channel != channel || current_timestamp() >= entry->timestamp)
+	if (entry->channel != channel || cached_timestamp() >= entry->timestamp)
 		return false;
 
 	if (record)
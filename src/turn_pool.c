@@ -0,0 +1,581 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "turn_pool.h"
+#include "log.h"
+#include "random.h"
+#include "resolver.h"
+#include "thread.h"
+#include "udp.h"
+#include "wakeup.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BUFFER_SIZE 4096
+
+typedef struct turn_pool_server {
+	char host[RESOLVER_MAX_HOSTNAME_LEN];
+	char service[RESOLVER_MAX_SERVICE_LEN];
+	char username[STUN_MAX_USERNAME_LEN];
+	char password[STUN_MAX_PASSWORD_LEN];
+	int target;                  // allocations to keep ready
+	timestamp_t retry_timestamp; // no new allocation before, set on failure
+} turn_pool_server_t;
+
+typedef enum turn_pool_entry_state {
+	TURN_POOL_ENTRY_STATE_EMPTY,
+	TURN_POOL_ENTRY_STATE_ALLOCATING,
+	TURN_POOL_ENTRY_STATE_READY
+} turn_pool_entry_state_t;
+
+typedef struct turn_pool_entry {
+	turn_pool_entry_state_t state;
+	turn_pool_server_t *server;
+	turn_pool_allocation_t allocation;
+	uint8_t transaction_id[STUN_TRANSACTION_ID_SIZE];
+	bool pending; // a request is in flight
+	int transmissions;
+	timestamp_t next_transmission;
+} turn_pool_entry_t;
+
+static mutex_t pool_mutex = MUTEX_INITIALIZER;
+static turn_pool_server_t servers[TURN_POOL_MAX_SERVERS];
+static turn_pool_entry_t entries[TURN_POOL_MAX_ALLOCATIONS];
+static bool thread_running = false;
+static bool wakeup_initialized = false;
+static wakeup_t pool_wakeup;
+static juice_logger_t *pool_logger = NULL;
+
+// Must be called with the mutex locked
+static turn_pool_server_t *find_server(const juice_turn_server_t *turn_server) {
+	char service[RESOLVER_MAX_SERVICE_LEN];
+	snprintf(service, RESOLVER_MAX_SERVICE_LEN, "%hu",
+	         turn_server->port ? turn_server->port : 3478);
+
+	for (int i = 0; i < TURN_POOL_MAX_SERVERS; ++i) {
+		turn_pool_server_t *server = servers + i;
+		if (*server->host && strcmp(server->host, turn_server->host) == 0 &&
+		    strcmp(server->service, service) == 0 &&
+		    strcmp(server->username, turn_server->username) == 0 &&
+		    strcmp(server->password, turn_server->password) == 0)
+			return server;
+	}
+	return NULL;
+}
+
+// Must be called with the mutex locked
+static int count_entries(const turn_pool_server_t *server) {
+	int count = 0;
+	for (int i = 0; i < TURN_POOL_MAX_ALLOCATIONS; ++i)
+		if (entries[i].state != TURN_POOL_ENTRY_STATE_EMPTY && entries[i].server == server)
+			++count;
+
+	return count;
+}
+
+static void entry_release(turn_pool_entry_t *entry) {
+	if (entry->state != TURN_POOL_ENTRY_STATE_EMPTY && entry->allocation.sock != INVALID_SOCKET)
+		closesocket(entry->allocation.sock);
+
+	memset(entry, 0, sizeof(*entry));
+	entry->state = TURN_POOL_ENTRY_STATE_EMPTY;
+	entry->allocation.sock = INVALID_SOCKET;
+}
+
+static void entry_fail(turn_pool_entry_t *entry, timestamp_t now) {
+	JLOG_WARN(pool_logger, "Pre-warmed TURN allocation on %s:%s failed", entry->server->host,
+	          entry->server->service);
+	entry->server->retry_timestamp = now + TURN_POOL_RETRY_PERIOD;
+	entry_release(entry);
+}
+
+static int entry_send(turn_pool_entry_t *entry, timestamp_t now) {
+	stun_method_t method = entry->state == TURN_POOL_ENTRY_STATE_ALLOCATING ? STUN_METHOD_ALLOCATE
+	                                                                         : STUN_METHOD_REFRESH;
+	stun_message_t msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_class = STUN_CLASS_REQUEST;
+	msg.msg_method = method;
+	memcpy(msg.transaction_id, entry->transaction_id, STUN_TRANSACTION_ID_SIZE);
+
+	msg.credentials = entry->allocation.credentials;
+	msg.lifetime = TURN_POOL_LIFETIME / 1000; // seconds
+	msg.requested_transport = true;
+	msg.dont_fragment = true;
+
+	const char *password = *msg.credentials.nonce != '\0' ? entry->server->password : NULL;
+
+	char buffer[BUFFER_SIZE];
+	int size = stun_write(buffer, BUFFER_SIZE, &msg, password, pool_logger);
+	if (size <= 0) {
+		JLOG_ERROR(pool_logger, "STUN message write failed");
+		return -1;
+	}
+
+	const addr_record_t *record = &entry->allocation.server;
+	if (sendto(entry->allocation.sock, buffer, size, 0, (const struct sockaddr *)&record->addr,
+	           record->len) < 0) {
+		JLOG_WARN(pool_logger, "STUN message send failed, errno=%d", sockerrno);
+		// The request is retransmitted like a lost one
+	}
+
+	JLOG_DEBUG(pool_logger, "Sent TURN %s request for pre-warmed allocation",
+	           method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh");
+	entry->pending = true;
+	entry->next_transmission = now + (TURN_POOL_RETRANSMISSION_TIMEOUT << entry->transmissions);
+	++entry->transmissions;
+	return 0;
+}
+
+static int entry_start(turn_pool_entry_t *entry, turn_pool_server_t *server,
+                       const addr_record_t *record, timestamp_t now) {
+	udp_socket_config_t socket_config;
+	memset(&socket_config, 0, sizeof(socket_config));
+	socket_t sock = udp_create_socket(&socket_config, pool_logger);
+	if (sock == INVALID_SOCKET) {
+		JLOG_ERROR(pool_logger, "UDP socket creation for TURN pool failed");
+		return -1;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	entry->state = TURN_POOL_ENTRY_STATE_ALLOCATING;
+	entry->server = server;
+	entry->allocation.sock = sock;
+	entry->allocation.server = *record;
+	snprintf(entry->allocation.credentials.username, STUN_MAX_USERNAME_LEN, "%s",
+	         server->username);
+	juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, pool_logger);
+	return entry_send(entry, now);
+}
+
+static void entry_process(turn_pool_entry_t *entry, char *buf, size_t size, timestamp_t now) {
+	if (!is_stun_datagram(buf, size, pool_logger))
+		return;
+
+	stun_view_t view;
+	if (stun_read_view(buf, size, &view, pool_logger) < 0)
+		return;
+
+	// Only decode the attributes once the message is known to be expected
+	stun_method_t method = entry->state == TURN_POOL_ENTRY_STATE_ALLOCATING ? STUN_METHOD_ALLOCATE
+	                                                                         : STUN_METHOD_REFRESH;
+	if (!entry->pending || view.msg_method != method ||
+	    memcmp(view.transaction_id, entry->transaction_id, STUN_TRANSACTION_ID_SIZE) != 0) {
+		JLOG_DEBUG(pool_logger, "Ignoring unexpected STUN message for pre-warmed allocation");
+		return;
+	}
+
+	stun_message_t msg;
+	if (stun_read_from_view(&view, &msg, pool_logger) < 0)
+		return;
+
+	stun_credentials_t *credentials = &entry->allocation.credentials;
+	switch (msg.msg_class) {
+	case STUN_CLASS_RESP_SUCCESS: {
+		if (!msg.has_integrity) {
+			JLOG_WARN(pool_logger, "Missing integrity in TURN response");
+			return;
+		}
+		strcpy(msg.credentials.realm, credentials->realm);
+		strcpy(msg.credentials.nonce, credentials->nonce);
+		strcpy(msg.credentials.username, credentials->username);
+		if (!stun_check_integrity(buf, size, &msg, entry->server->password, pool_logger)) {
+			JLOG_WARN(pool_logger, "STUN integrity check failed");
+			return;
+		}
+
+		if (entry->state == TURN_POOL_ENTRY_STATE_ALLOCATING) {
+			if (!msg.relayed.len) {
+				JLOG_ERROR(pool_logger, "Expected relayed address in TURN Allocate response");
+				entry_fail(entry, now);
+				return;
+			}
+			entry->allocation.relayed = msg.relayed;
+			entry->allocation.mapped = msg.mapped;
+			entry->state = TURN_POOL_ENTRY_STATE_READY;
+			JLOG_INFO(pool_logger, "Pre-warmed TURN allocation on %s:%s ready",
+			          entry->server->host, entry->server->service);
+		}
+
+		entry->pending = false;
+		entry->transmissions = 0;
+		entry->allocation.refresh_timestamp = now + TURN_POOL_REFRESH_PERIOD;
+		juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, pool_logger);
+		break;
+	}
+	case STUN_CLASS_RESP_ERROR: {
+		if ((msg.error_code == 401 && *credentials->realm == '\0') || // Unauthorized
+		    msg.error_code == 438) {                                  // Stale Nonce
+			if (*msg.credentials.realm == '\0' || *msg.credentials.nonce == '\0') {
+				JLOG_ERROR(pool_logger, "Expected realm and nonce in TURN error response");
+				entry_fail(entry, now);
+				return;
+			}
+			stun_process_credentials(&msg.credentials, credentials);
+
+			// Resend immediately with the new nonce
+			entry->transmissions = 0;
+			juice_random(entry->transaction_id, STUN_TRANSACTION_ID_SIZE, pool_logger);
+			entry_send(entry, now);
+			break;
+		}
+
+		JLOG_WARN(pool_logger, "Got TURN %s error response, code=%u",
+		          method == STUN_METHOD_ALLOCATE ? "Allocate" : "Refresh",
+		          (unsigned int)msg.error_code);
+		entry_fail(entry, now);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static void entry_recv(turn_pool_entry_t *entry, timestamp_t now) {
+	while (entry->state != TURN_POOL_ENTRY_STATE_EMPTY) {
+		char buffer[BUFFER_SIZE];
+		addr_record_t record;
+		record.len = sizeof(record.addr);
+		int len = recvfrom(entry->allocation.sock, buffer, BUFFER_SIZE, 0,
+		                   (struct sockaddr *)&record.addr, &record.len);
+		if (len < 0) {
+			if (sockerrno == SECONNRESET || sockerrno == SENETRESET || sockerrno == SECONNREFUSED)
+				continue; // See agent_recv()
+
+			if (sockerrno != SEAGAIN && sockerrno != SEWOULDBLOCK)
+				JLOG_WARN(pool_logger, "recvfrom failed, errno=%d", sockerrno);
+
+			break;
+		}
+
+		addr_unmap_inet6_v4mapped((struct sockaddr *)&record.addr, &record.len);
+		if (!addr_record_is_equal(&record, &entry->allocation.server, true))
+			continue; // Only the TURN server is expected before adoption
+
+		entry_process(entry, buffer, len, now);
+	}
+}
+
+// Must be called with the mutex locked, returns the next timestamp to wake up at
+static timestamp_t update_servers(timestamp_t now) {
+	timestamp_t next_timestamp = now + TURN_POOL_RETRY_PERIOD;
+	for (int i = 0; i < TURN_POOL_MAX_SERVERS; ++i) {
+		turn_pool_server_t *server = servers + i;
+		if (!*server->host)
+			continue;
+
+		// Release extra allocations, starting with the ones not ready yet
+		int count = count_entries(server);
+		for (int j = 0; j < TURN_POOL_MAX_ALLOCATIONS && count > server->target; ++j) {
+			turn_pool_entry_t *entry = entries + j;
+			if (entry->server == server && entry->state == TURN_POOL_ENTRY_STATE_ALLOCATING) {
+				entry_release(entry);
+				--count;
+			}
+		}
+		for (int j = 0; j < TURN_POOL_MAX_ALLOCATIONS && count > server->target; ++j) {
+			turn_pool_entry_t *entry = entries + j;
+			if (entry->server == server && entry->state != TURN_POOL_ENTRY_STATE_EMPTY) {
+				entry_release(entry);
+				--count;
+			}
+		}
+
+		if (server->target == 0) {
+			memset(server, 0, sizeof(*server));
+			continue;
+		}
+		if (count >= server->target)
+			continue;
+
+		if (now < server->retry_timestamp) {
+			if (next_timestamp > server->retry_timestamp)
+				next_timestamp = server->retry_timestamp;
+			continue;
+		}
+
+		// Resolution might block, the server is not released by another thread in the meantime
+		char host[RESOLVER_MAX_HOSTNAME_LEN];
+		char service[RESOLVER_MAX_SERVICE_LEN];
+		strcpy(host, server->host);
+		strcpy(service, server->service);
+		mutex_unlock(&pool_mutex);
+		addr_record_t records[RESOLVER_MAX_RECORDS_COUNT];
+		int records_count =
+		    resolver_resolve(host, service, records, RESOLVER_MAX_RECORDS_COUNT, pool_logger);
+		mutex_lock(&pool_mutex);
+
+		// Prefer IPv4 for TURN
+		const addr_record_t *record = NULL;
+		for (int j = 0; j < records_count; ++j) {
+			int family = records[j].addr.ss_family;
+			if (family == AF_INET) {
+				record = records + j;
+				break;
+			}
+			if (family == AF_INET6 && !record)
+				record = records + j;
+		}
+		if (!record) {
+			JLOG_WARN(pool_logger, "TURN address resolution failed for %s:%s", host, service);
+			server->retry_timestamp = now + TURN_POOL_RETRY_PERIOD;
+			continue;
+		}
+
+		count = count_entries(server);
+		for (int j = 0; j < TURN_POOL_MAX_ALLOCATIONS && count < server->target; ++j) {
+			turn_pool_entry_t *entry = entries + j;
+			if (entry->state != TURN_POOL_ENTRY_STATE_EMPTY)
+				continue;
+
+			if (entry_start(entry, server, record, now) < 0) {
+				entry_release(entry);
+				server->retry_timestamp = now + TURN_POOL_RETRY_PERIOD;
+				break;
+			}
+			++count;
+		}
+	}
+	return next_timestamp;
+}
+
+// Must be called with the mutex locked, returns the next timestamp to wake up at
+static timestamp_t update_entries(timestamp_t now, timestamp_t next_timestamp) {
+	for (int i = 0; i < TURN_POOL_MAX_ALLOCATIONS; ++i) {
+		turn_pool_entry_t *entry = entries + i;
+		if (entry->state == TURN_POOL_ENTRY_STATE_EMPTY)
+			continue;
+
+		if (entry->pending) {
+			if (entry->next_transmission <= now) {
+				if (entry->transmissions >= TURN_POOL_MAX_TRANSMISSIONS) {
+					entry_fail(entry, now);
+					continue;
+				}
+				entry_send(entry, now);
+			}
+		} else if (entry->allocation.refresh_timestamp <= now) {
+			entry_send(entry, now);
+		}
+
+		timestamp_t timestamp =
+		    entry->pending ? entry->next_transmission : entry->allocation.refresh_timestamp;
+		if (next_timestamp > timestamp)
+			next_timestamp = timestamp;
+	}
+	return next_timestamp;
+}
+
+static thread_return_t THREAD_CALL turn_pool_thread_entry(void *arg) {
+	(void)arg;
+#ifdef _WIN32
+	WSADATA wsaData;
+	bool wsa_started = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#endif
+
+	mutex_lock(&pool_mutex);
+	wakeup_initialized = wakeup_init(&pool_wakeup, pool_logger) == 0;
+	if (!wakeup_initialized)
+		JLOG_ERROR(pool_logger, "Wakeup creation for TURN pool failed");
+
+	while (wakeup_initialized) {
+		timestamp_t now = current_timestamp();
+		timestamp_t next_timestamp = update_servers(now);
+
+		bool active = false;
+		for (int i = 0; i < TURN_POOL_MAX_SERVERS; ++i)
+			if (*servers[i].host)
+				active = true;
+
+		if (!active)
+			break;
+
+		now = current_timestamp();
+		next_timestamp = update_entries(now, next_timestamp);
+
+		timediff_t timediff = next_timestamp - now;
+		if (timediff < 0)
+			timediff = 0;
+
+		struct timeval timeout;
+		timeout.tv_sec = (long)(timediff / 1000);
+		timeout.tv_usec = (long)((timediff % 1000) * 1000);
+
+		fd_set readfds;
+		FD_ZERO(&readfds);
+		FD_SET(pool_wakeup.read_fd, &readfds);
+		int n = SOCKET_TO_INT(pool_wakeup.read_fd) + 1;
+		for (int i = 0; i < TURN_POOL_MAX_ALLOCATIONS; ++i) {
+			socket_t sock = entries[i].allocation.sock;
+			if (entries[i].state == TURN_POOL_ENTRY_STATE_EMPTY || sock == INVALID_SOCKET)
+				continue;
+
+			FD_SET(sock, &readfds);
+			if (n < SOCKET_TO_INT(sock) + 1)
+				n = SOCKET_TO_INT(sock) + 1;
+		}
+
+		mutex_unlock(&pool_mutex);
+		int ret = select(n, &readfds, NULL, NULL, &timeout);
+		mutex_lock(&pool_mutex);
+		if (ret < 0) {
+			if (sockerrno == SEINTR || sockerrno == SEAGAIN)
+				continue;
+
+			JLOG_FATAL(pool_logger, "select failed, errno=%d", sockerrno);
+			break;
+		}
+
+		if (FD_ISSET(pool_wakeup.read_fd, &readfds))
+			wakeup_drain(&pool_wakeup);
+
+		// Adopted entries are empty now, their sockets belong to agents
+		now = current_timestamp();
+		for (int i = 0; i < TURN_POOL_MAX_ALLOCATIONS; ++i) {
+			turn_pool_entry_t *entry = entries + i;
+			if (entry->state != TURN_POOL_ENTRY_STATE_EMPTY &&
+			    FD_ISSET(entry->allocation.sock, &readfds))
+				entry_recv(entry, now);
+		}
+	}
+
+	for (int i = 0; i < TURN_POOL_MAX_ALLOCATIONS; ++i)
+		if (entries[i].state != TURN_POOL_ENTRY_STATE_EMPTY)
+			entry_release(entries + i);
+
+	if (wakeup_initialized) {
+		wakeup_destroy(&pool_wakeup);
+		wakeup_initialized = false;
+	}
+	juice_logger_destroy(pool_logger);
+	pool_logger = NULL;
+	thread_running = false;
+	mutex_unlock(&pool_mutex);
+
+#ifdef _WIN32
+	if (wsa_started)
+		WSACleanup();
+#endif
+	return (thread_return_t)0;
+}
+
+int turn_pool_prewarm(const juice_turn_server_t *turn_server, int count) {
+	if (strlen(turn_server->host) >= RESOLVER_MAX_HOSTNAME_LEN ||
+	    strlen(turn_server->username) >= STUN_MAX_USERNAME_LEN ||
+	    strlen(turn_server->password) >= STUN_MAX_PASSWORD_LEN)
+		return -1;
+
+	if (count > TURN_POOL_MAX_ALLOCATIONS)
+		count = TURN_POOL_MAX_ALLOCATIONS;
+
+	mutex_lock(&pool_mutex);
+	turn_pool_server_t *server = find_server(turn_server);
+	if (!server) {
+		if (count == 0) {
+			mutex_unlock(&pool_mutex);
+			return 0;
+		}
+		for (int i = 0; i < TURN_POOL_MAX_SERVERS; ++i) {
+			if (!*servers[i].host) {
+				server = servers + i;
+				break;
+			}
+		}
+		if (!server) {
+			mutex_unlock(&pool_mutex);
+			return -1;
+		}
+		strcpy(server->host, turn_server->host);
+		snprintf(server->service, RESOLVER_MAX_SERVICE_LEN, "%hu",
+		         turn_server->port ? turn_server->port : 3478);
+		strcpy(server->username, turn_server->username);
+		strcpy(server->password, turn_server->password);
+	}
+	server->target = count;
+	server->retry_timestamp = 0;
+
+	if (thread_running) {
+		if (wakeup_initialized)
+			wakeup_trigger(&pool_wakeup);
+
+		mutex_unlock(&pool_mutex);
+		return 0;
+	}
+
+	juice_log_config_t log_config;
+	memset(&log_config, 0, sizeof(log_config));
+	pool_logger = juice_logger_create(&log_config);
+	if (!pool_logger) {
+		memset(server, 0, sizeof(*server));
+		mutex_unlock(&pool_mutex);
+		return -1;
+	}
+
+	thread_t thread;
+	if (thread_init(&thread, turn_pool_thread_entry, NULL) != 0) {
+		juice_logger_destroy(pool_logger);
+		pool_logger = NULL;
+		memset(server, 0, sizeof(*server));
+		mutex_unlock(&pool_mutex);
+		return -1;
+	}
+	thread_detach(thread);
+	thread_running = true;
+	mutex_unlock(&pool_mutex);
+	return 0;
+}
+
+int turn_pool_adopt(const juice_turn_server_t *turn_server, uint16_t port_begin, uint16_t port_end,
+                    turn_pool_allocation_t *allocation) {
+	mutex_lock(&pool_mutex);
+	turn_pool_server_t *server = thread_running ? find_server(turn_server) : NULL;
+	if (!server) {
+		mutex_unlock(&pool_mutex);
+		return -1;
+	}
+
+	for (int i = 0; i < TURN_POOL_MAX_ALLOCATIONS; ++i) {
+		turn_pool_entry_t *entry = entries + i;
+		// Entries with a request in flight are skipped, the response would reach the agent
+		if (entry->server != server || entry->state != TURN_POOL_ENTRY_STATE_READY ||
+		    entry->pending)
+			continue;
+
+		if (port_begin || port_end) {
+			uint16_t port = udp_get_port(entry->allocation.sock, pool_logger);
+			if (port < port_begin || (port_end && port > port_end))
+				continue;
+		}
+
+		*allocation = entry->allocation;
+		entry->allocation.sock = INVALID_SOCKET; // now owned by the caller
+		entry_release(entry);
+
+		// Replace the allocation in the background
+		if (wakeup_initialized)
+			wakeup_trigger(&pool_wakeup);
+
+		mutex_unlock(&pool_mutex);
+		return 0;
+	}
+
+	mutex_unlock(&pool_mutex);
+	return -1;
+}
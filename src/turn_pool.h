@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef JUICE_TURN_POOL_H
+#define JUICE_TURN_POOL_H
+
+#include "addr.h"
+#include "juice.h"
+#include "socket.h"
+#include "stun.h"
+#include "timestamp.h"
+
+#include <stdint.h>
+
+#define TURN_POOL_MAX_SERVERS 4
+#define TURN_POOL_MAX_ALLOCATIONS 16
+#define TURN_POOL_LIFETIME 600000                             // msecs, 10 min
+#define TURN_POOL_REFRESH_PERIOD (TURN_POOL_LIFETIME - 60000) // msecs, lifetime - 1 min
+#define TURN_POOL_RETRANSMISSION_TIMEOUT 500                  // msecs
+#define TURN_POOL_MAX_TRANSMISSIONS 5
+#define TURN_POOL_RETRY_PERIOD 10000 // msecs, after a failed allocation
+
+// Process-wide pool of pre-warmed TURN allocations
+// A single pool thread, spawned on demand, keeps the requested number of allocations ready for
+// each TURN server and refreshes them. An allocation is bound to the 5-tuple of its socket, so an
+// agent adopting one takes over the socket as its own along with the allocation state.
+
+typedef struct turn_pool_allocation {
+	socket_t sock;
+	addr_record_t server; // resolved TURN server address
+	addr_record_t relayed;
+	addr_record_t mapped;           // len is 0 if not present in the response
+	stun_credentials_t credentials; // with realm and nonce
+	timestamp_t refresh_timestamp;  // when the next Refresh request is due
+} turn_pool_allocation_t;
+
+// Sets the number of allocations to keep ready for the server, 0 releases them
+int turn_pool_prewarm(const juice_turn_server_t *turn_server, int count);
+
+// Takes a ready allocation for the server out of the pool, the caller then owns the socket.
+// If port_begin and port_end are not 0, the socket must be bound in the range.
+// Returns -1 if no allocation is available.
+int turn_pool_adopt(const juice_turn_server_t *turn_server, uint16_t port_begin, uint16_t port_end,
+                    turn_pool_allocation_t *allocation);
+
+#endif // JUICE_TURN_POOL_H
@@ -25,6 +25,18 @@
 #include <string.h>
 #include <time.h>
 
+#ifndef NO_ATOMICS
+#include <stdatomic.h>
+#endif
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define USE_NETLINK
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#define UDP_MAX_IFADDRS_COUNT 32
+
 static struct addrinfo *find_family(struct addrinfo *ai_list, int family) {
 	struct addrinfo *ai = ai_list;
 	while (ai && ai->ai_family != family)
@@ -314,22 +326,8 @@ static int has_duplicate_addr(struct sockaddr *addr, const addr_record_t *record
 	return false;
 }
 
-int udp_get_addrs(socket_t sock, addr_record_t *records, size_t count, juice_logger_t *logger) {
-	addr_record_t bound;
-	if (udp_get_bound_addr(sock, &bound, logger) < 0) {
-		JLOG_ERROR(logger, "Getting UDP bound address failed");
-		return -1;
-	}
-
-	if (!addr_is_any((struct sockaddr *)&bound.addr)) {
-		if (count > 0)
-			records[0] = bound;
-
-		return 1;
-	}
-
-	uint16_t port = addr_get_port((struct sockaddr *)&bound.addr, logger);
-
+static int enumerate_interface_addrs(socket_t sock, uint16_t port, addr_record_t *records,
+                                     size_t count, juice_logger_t *logger) {
 	// RFC 8445 5.1.1.1. Host Candidates:
 	// Addresses from a loopback interface MUST NOT be included in the candidate addresses.
 	// [...]
@@ -350,25 +348,6 @@ int udp_get_addrs(socket_t sock, addr_record_t *records, size_t count, juice_log
 	addr_record_t *end = records + count;
 	int ret = 0;
 
-#if JUICE_ENABLE_LOCALHOST_ADDRESS
-	// Add localhost for test purposes
-	addr_record_t local;
-	if (bound.addr.ss_family == AF_INET6 && udp_get_local_addr(sock, AF_INET6, &local) == 0) {
-		++ret;
-	if (current != end) {
-			*current = local;
-		++current;
-	}
-	}
-	if (udp_get_local_addr(sock, AF_INET, &local) == 0) {
-		++ret;
-	if (current != end) {
-			*current = local;
-		++current;
-		}
-	}
-#endif
-
 #ifdef _WIN32
 	char buf[4096];
 	DWORD len = 0;
@@ -408,6 +387,7 @@ int udp_get_addrs(socket_t sock, addr_record_t *records, size_t count, juice_log
 	}
 #else // POSIX
 #ifndef NO_IFADDRS
+	(void)sock;
 	struct ifaddrs *ifas;
 	if (getifaddrs(&ifas)) {
 		JLOG_ERROR(logger, "getifaddrs failed, errno=%d", sockerrno);
@@ -526,3 +506,229 @@ int udp_get_addrs(socket_t sock, addr_record_t *records, size_t count, juice_log
 
 	return ret;
 }
+
+// Interface addresses are cached process-wide, which is only possible where we can be notified
+// of changes. On Linux, a thread listens for address and link changes on a netlink socket.
+static mutex_t ifaddrs_mutex = MUTEX_INITIALIZER;
+static addr_record_t ifaddrs_records[UDP_MAX_IFADDRS_COUNT];
+static int ifaddrs_count = -1; // -1 if the cache is invalid
+static int ifaddrs_listener_state = 0; // 0 if not started, 1 if running, -1 if unavailable
+static udp_addrs_watcher_t *ifaddrs_watchers = NULL;
+
+// Written with the mutex locked, read without it by agents on each bookkeeping pass
+#ifdef NO_ATOMICS
+static volatile unsigned int ifaddrs_generation = 0;
+#else
+static atomic_uint ifaddrs_generation = 0;
+#endif
+
+// Must be called with the mutex locked
+static void invalidate_interface_addrs(void) {
+	ifaddrs_count = -1;
+#ifdef NO_ATOMICS
+	++ifaddrs_generation;
+#else
+	atomic_fetch_add(&ifaddrs_generation, 1);
+#endif
+
+	// Wake up watchers so they gather host candidates again right away
+	for (udp_addrs_watcher_t *watcher = ifaddrs_watchers; watcher; watcher = watcher->next)
+		wakeup_trigger(watcher->wakeup);
+}
+
+#ifdef USE_NETLINK
+
+static socket_t ifaddrs_netlink_sock = INVALID_SOCKET;
+
+static thread_return_t THREAD_CALL ifaddrs_listener_entry(void *arg) {
+	(void)arg;
+	char buffer[4096];
+	while (true) {
+		int len = recv(ifaddrs_netlink_sock, buffer, sizeof(buffer), 0);
+		if (len < 0) {
+			int err = sockerrno;
+			if (err == SEINTR)
+				continue;
+
+			mutex_lock(&ifaddrs_mutex);
+			invalidate_interface_addrs();
+			if (err != ENOBUFS) { // ENOBUFS means notifications were lost
+				ifaddrs_listener_state = -1;
+				mutex_unlock(&ifaddrs_mutex);
+				break;
+			}
+			mutex_unlock(&ifaddrs_mutex);
+			continue;
+		}
+
+		bool changed = false;
+		for (struct nlmsghdr *nh = (struct nlmsghdr *)buffer; NLMSG_OK(nh, (unsigned int)len);
+		     nh = NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_type == RTM_NEWADDR || nh->nlmsg_type == RTM_DELADDR ||
+			    nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_DELLINK)
+				changed = true;
+		}
+
+		if (changed) {
+			mutex_lock(&ifaddrs_mutex);
+			invalidate_interface_addrs();
+			mutex_unlock(&ifaddrs_mutex);
+		}
+	}
+
+	closesocket(ifaddrs_netlink_sock);
+	ifaddrs_netlink_sock = INVALID_SOCKET;
+	return (thread_return_t)0;
+}
+
+// Must be called with the mutex locked
+static int start_ifaddrs_listener(juice_logger_t *logger) {
+	socket_t sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (sock == INVALID_SOCKET) {
+		JLOG_WARN(logger, "netlink socket creation failed, errno=%d", sockerrno);
+		return -1;
+	}
+
+	struct sockaddr_nl snl;
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	snl.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if (bind(sock, (struct sockaddr *)&snl, sizeof(snl))) {
+		JLOG_WARN(logger, "netlink socket binding failed, errno=%d", sockerrno);
+		closesocket(sock);
+		return -1;
+	}
+
+	ifaddrs_netlink_sock = sock;
+	thread_t thread;
+	int ret = thread_init(&thread, ifaddrs_listener_entry, NULL);
+	if (ret) {
+		JLOG_WARN(logger, "thread_create for netlink listener failed, error=%d", ret);
+		closesocket(sock);
+		ifaddrs_netlink_sock = INVALID_SOCKET;
+		return -1;
+	}
+	thread_detach(thread);
+	return 0;
+}
+
+#else
+
+static int start_ifaddrs_listener(juice_logger_t *logger) {
+	(void)logger;
+	return -1; // no change notifications
+}
+
+#endif
+
+static int get_interface_addrs(socket_t sock, addr_record_t *records, size_t count,
+                               juice_logger_t *logger) {
+	mutex_lock(&ifaddrs_mutex);
+	if (ifaddrs_listener_state == 0)
+		ifaddrs_listener_state = start_ifaddrs_listener(logger) == 0 ? 1 : -1;
+
+	if (ifaddrs_listener_state < 0) {
+		mutex_unlock(&ifaddrs_mutex);
+		return enumerate_interface_addrs(sock, 0, records, count, logger);
+	}
+
+	if (ifaddrs_count < 0) {
+		JLOG_VERBOSE(logger, "Enumerating interface addresses");
+		int ret =
+		    enumerate_interface_addrs(sock, 0, ifaddrs_records, UDP_MAX_IFADDRS_COUNT, logger);
+		if (ret < 0) {
+			mutex_unlock(&ifaddrs_mutex);
+			return -1;
+		}
+		ifaddrs_count = ret < UDP_MAX_IFADDRS_COUNT ? ret : UDP_MAX_IFADDRS_COUNT;
+	}
+
+	int ret = ifaddrs_count;
+	size_t n = (size_t)ret < count ? (size_t)ret : count;
+	memcpy(records, ifaddrs_records, n * sizeof(addr_record_t));
+	mutex_unlock(&ifaddrs_mutex);
+	return ret;
+}
+
+unsigned int udp_get_addrs_generation(void) {
+#ifdef NO_ATOMICS
+	return ifaddrs_generation;
+#else
+	return atomic_load(&ifaddrs_generation);
+#endif
+}
+
+void udp_watch_addrs(udp_addrs_watcher_t *watcher, wakeup_t *wakeup) {
+	mutex_lock(&ifaddrs_mutex);
+	watcher->wakeup = wakeup;
+	if (!watcher->watching) {
+		watcher->next = ifaddrs_watchers;
+		ifaddrs_watchers = watcher;
+		watcher->watching = true;
+	}
+	mutex_unlock(&ifaddrs_mutex);
+}
+
+void udp_unwatch_addrs(udp_addrs_watcher_t *watcher) {
+	mutex_lock(&ifaddrs_mutex);
+	udp_addrs_watcher_t **pos = &ifaddrs_watchers;
+	while (*pos && *pos != watcher)
+		pos = &(*pos)->next;
+	if (*pos)
+		*pos = watcher->next;
+
+	watcher->watching = false;
+	mutex_unlock(&ifaddrs_mutex);
+}
+
+int udp_get_addrs(socket_t sock, addr_record_t *records, size_t count, juice_logger_t *logger) {
+	addr_record_t bound;
+	if (udp_get_bound_addr(sock, &bound, logger) < 0) {
+		JLOG_ERROR(logger, "Getting UDP bound address failed");
+		return -1;
+	}
+
+	if (!addr_is_any((struct sockaddr *)&bound.addr)) {
+		if (count > 0)
+			records[0] = bound;
+
+		return 1;
+	}
+
+	uint16_t port = addr_get_port((struct sockaddr *)&bound.addr, logger);
+
+	addr_record_t *current = records;
+	addr_record_t *end = records + count;
+	int ret = 0;
+
+#if JUICE_ENABLE_LOCALHOST_ADDRESS
+	// Add localhost for test purposes
+	addr_record_t local;
+	if (bound.addr.ss_family == AF_INET6 && udp_get_local_addr(sock, AF_INET6, &local) == 0) {
+		++ret;
+	if (current != end) {
+			*current = local;
+		++current;
+	}
+	}
+	if (udp_get_local_addr(sock, AF_INET, &local) == 0) {
+		++ret;
+	if (current != end) {
+			*current = local;
+		++current;
+		}
+	}
+#endif
+
+	// Interface addresses are enumerated without port
+	int ifaddrs_count = get_interface_addrs(sock, current, end - current, logger);
+	if (ifaddrs_count < 0)
+		return -1;
+
+	for (int i = 0; i < ifaddrs_count && current != end; ++i) {
+		addr_set_port((struct sockaddr *)&current->addr, port, logger);
+		++current;
+	}
+
+	return ret + ifaddrs_count;
+}
@@ -22,6 +22,7 @@
 #include "addr.h"
 #include "log.h"
 #include "socket.h"
+#include "wakeup.h"
 
 #include <stdint.h>
 
@@ -38,4 +39,17 @@ int udp_get_bound_addr(socket_t sock, addr_record_t *record, juice_logger_t *log
 int udp_get_local_addr(socket_t sock, int family, addr_record_t *record, juice_logger_t *logger); // family may be AF_UNSPEC
 int udp_get_addrs(socket_t sock, addr_record_t *records, size_t count, juice_logger_t *logger);
 
+// Incremented each time local interface addresses change, if supported by the platform
+unsigned int udp_get_addrs_generation(void);
+
+// Watchers have their wakeup triggered each time the generation is incremented
+typedef struct udp_addrs_watcher {
+	wakeup_t *wakeup;
+	struct udp_addrs_watcher *next;
+	bool watching;
+} udp_addrs_watcher_t;
+
+void udp_watch_addrs(udp_addrs_watcher_t *watcher, wakeup_t *wakeup);
+void udp_unwatch_addrs(udp_addrs_watcher_t *watcher); // no-op if not watching
+
 #endif // JUICE_UDP_H
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "wakeup.h"
+#include "log.h"
+
+#include <string.h>
+
+#ifdef USE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+int wakeup_init(wakeup_t *wakeup, juice_logger_t *logger) {
+	wakeup->read_fd = INVALID_SOCKET;
+	wakeup->write_fd = INVALID_SOCKET;
+
+#if defined(_WIN32)
+	socket_t sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == INVALID_SOCKET) {
+		JLOG_ERROR(logger, "Wakeup socket creation failed, errno=%d", sockerrno);
+		return -1;
+	}
+
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = 0;
+	socklen_t len = sizeof(sin);
+	if (bind(sock, (struct sockaddr *)&sin, len) ||
+	    getsockname(sock, (struct sockaddr *)&sin, &len) ||
+	    connect(sock, (struct sockaddr *)&sin, len)) {
+		JLOG_ERROR(logger, "Wakeup socket setup failed, errno=%d", sockerrno);
+		closesocket(sock);
+		return -1;
+	}
+
+	ctl_t nbio = 1;
+	if (ioctlsocket(sock, FIONBIO, &nbio)) {
+		JLOG_ERROR(logger, "Setting non-blocking mode on wakeup socket failed, errno=%d",
+		           sockerrno);
+		closesocket(sock);
+		return -1;
+	}
+
+	wakeup->read_fd = sock;
+	wakeup->write_fd = sock;
+
+#elif defined(USE_EVENTFD)
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		JLOG_ERROR(logger, "eventfd creation failed, errno=%d", errno);
+		return -1;
+	}
+
+	wakeup->read_fd = fd;
+	wakeup->write_fd = fd;
+
+#else
+	int fds[2];
+	if (pipe(fds)) {
+		JLOG_ERROR(logger, "pipe creation failed, errno=%d", errno);
+		return -1;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		int flags = fcntl(fds[i], F_GETFL, 0);
+		if (flags < 0 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) < 0 ||
+		    fcntl(fds[i], F_SETFD, FD_CLOEXEC) < 0) {
+			JLOG_ERROR(logger, "Setting non-blocking mode on pipe failed, errno=%d", errno);
+			close(fds[0]);
+			close(fds[1]);
+			return -1;
+		}
+	}
+
+	wakeup->read_fd = fds[0];
+	wakeup->write_fd = fds[1];
+#endif
+	return 0;
+}
+
+void wakeup_destroy(wakeup_t *wakeup) {
+	if (wakeup->read_fd != INVALID_SOCKET)
+		closesocket(wakeup->read_fd);
+
+	if (wakeup->write_fd != INVALID_SOCKET && wakeup->write_fd != wakeup->read_fd)
+		closesocket(wakeup->write_fd);
+
+	wakeup->read_fd = INVALID_SOCKET;
+	wakeup->write_fd = INVALID_SOCKET;
+}
+
+int wakeup_trigger(wakeup_t *wakeup) {
+#if defined(_WIN32)
+	char dummy = 0;
+	if (send(wakeup->write_fd, &dummy, 1, 0) < 0 && sockerrno != SEWOULDBLOCK)
+		return -1;
+#elif defined(USE_EVENTFD)
+	uint64_t value = 1;
+	if (write(wakeup->write_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+		return -1;
+#else
+	char dummy = 0;
+	if (write(wakeup->write_fd, &dummy, 1) < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		return -1;
+#endif
+	// A full buffer means a wakeup is already pending
+	return 0;
+}
+
+void wakeup_drain(wakeup_t *wakeup) {
+#if defined(_WIN32)
+	char buffer[64];
+	while (recv(wakeup->read_fd, buffer, sizeof(buffer), 0) >= 0)
+		;
+#elif defined(USE_EVENTFD)
+	uint64_t value;
+	while (read(wakeup->read_fd, &value, sizeof(value)) > 0)
+		;
+#else
+	char buffer[64];
+	while (read(wakeup->read_fd, buffer, sizeof(buffer)) > 0)
+		;
+#endif
+}
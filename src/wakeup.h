@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef JUICE_WAKEUP_H
+#define JUICE_WAKEUP_H
+
+#include "log.h"
+#include "socket.h"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define USE_EVENTFD
+#endif
+
+// Wakeup primitive to interrupt a thread waiting in select()
+// It is an eventfd on Linux, a pipe on other POSIX platforms, and a loopback UDP socket connected
+// to itself on Windows, where select() only accepts sockets.
+typedef struct wakeup {
+	socket_t read_fd; // to watch for reading
+	socket_t write_fd;
+} wakeup_t;
+
+int wakeup_init(wakeup_t *wakeup, juice_logger_t *logger);
+void wakeup_destroy(wakeup_t *wakeup);
+int wakeup_trigger(wakeup_t *wakeup);
+void wakeup_drain(wakeup_t *wakeup);
+
+#endif // JUICE_WAKEUP_H
@@ -168,6 +168,18 @@ int test_connectivity() {
 		printf("Remote address 2: %s\n", remoteAddr);
 	}
 
+	// Retrieve statistics
+	juice_agent_stats_t stats;
+	if (success &= (juice_get_stats(agent1, &stats) == 0)) {
+		printf("Statistics 1: sent=%llu, received=%llu, checks=%llu, completed in %lld ms\n",
+		       (unsigned long long)stats.direct.packets_sent,
+		       (unsigned long long)stats.direct.packets_received,
+		       (unsigned long long)stats.checks_sent, (long long)stats.completed_time);
+		if (stats.direct.packets_sent == 0 || stats.direct.packets_received == 0 ||
+		    stats.checks_sent == 0 || stats.completed_time < 0)
+			success = false;
+	}
+
 	// Agent 1: destroy
 	juice_destroy(agent1);
 
@@ -19,7 +19,37 @@
 #include "crc32.h"
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#define LARGE_SIZE (1024 * 1024 + 13)
+#define BENCHMARK_SIZE (1024 * 1024)
+#define BENCHMARK_ITERATIONS 64
+
+// Bitwise reference implementation
+static uint32_t reference_crc32(const uint8_t *p, size_t size) {
+	uint32_t crc = 0xFFFFFFFF;
+	while (size--) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; ++i)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+static void benchmark_crc32(const uint8_t *buffer) {
+	uint32_t sink = 0;
+	clock_t start = clock();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; ++i)
+		sink += CRC32(buffer, BENCHMARK_SIZE);
+
+	double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	double total = (double)BENCHMARK_SIZE * BENCHMARK_ITERATIONS / (1024 * 1024);
+	if (secs > 0)
+		printf("CRC32 throughput: %.0f MiB/s (%08x)\n", total / secs, (unsigned int)sink);
+}
 
 int test_crc32(void) {
 	const char *str = "The quick brown fox jumps over the lazy dog";
@@ -28,5 +58,38 @@ int test_crc32(void) {
 	if (CRC32(str, strlen(str)) != expected)
 		return -1;
 
+	if (CRC32("123456789", 9) != 0xcbf43926)
+		return -1;
+
+	if (CRC32("", 0) != 0)
+		return -1;
+
+	uint8_t *buffer = malloc(LARGE_SIZE);
+	if (!buffer)
+		return -1;
+
+	uint32_t seed = 1;
+	for (size_t i = 0; i < LARGE_SIZE; ++i) {
+		seed = seed * 1103515245 + 12345;
+		buffer[i] = (uint8_t)(seed >> 16);
+	}
+
+	// All sizes around the block boundaries and all alignments
+	for (size_t offset = 0; offset < 16; ++offset) {
+		for (size_t size = 0; size <= 300; ++size) {
+			if (CRC32(buffer + offset, size) != reference_crc32(buffer + offset, size)) {
+				free(buffer);
+				return -1;
+			}
+		}
+	}
+
+	if (CRC32(buffer, LARGE_SIZE) != reference_crc32(buffer, LARGE_SIZE)) {
+		free(buffer);
+		return -1;
+	}
+
+	benchmark_crc32(buffer);
+	free(buffer);
 	return 0;
 }
@@ -26,11 +26,15 @@ int test_base64(void);
 int test_stun(void);
 int test_connectivity(void);
 int test_notrickle(void);
+int test_restart(void);
+int test_shortcut(void);
 int test_gathering(void);
 int test_turn(void);
 
 #ifndef NO_SERVER
 int test_server(void);
+int test_prewarm(void);
+int test_restart_turn(void);
 #endif
 
 int main(int argc, char **argv) {
@@ -76,12 +80,36 @@ int main(int argc, char **argv) {
 		return -1;
 	}
 
+	printf("\nRunning ICE restart test...\n");
+	if (test_restart()) {
+		fprintf(stderr, "ICE restart test failed\n");
+		return -1;
+	}
+
+	printf("\nRunning co-located agents shortcut test...\n");
+	if (test_shortcut()) {
+		fprintf(stderr, "Co-located agents shortcut test failed\n");
+		return -1;
+	}
+
 #ifndef NO_SERVER
 	printf("\nRunning server test...\n");
 	if (test_server()) {
 		fprintf(stderr, "Server test failed\n");
 		return -1;
 	}
+
+	printf("\nRunning TURN allocation pool test...\n");
+	if (test_prewarm()) {
+		fprintf(stderr, "TURN allocation pool test failed\n");
+		return -1;
+	}
+
+	printf("\nRunning ICE restart with TURN test...\n");
+	if (test_restart_turn()) {
+		fprintf(stderr, "ICE restart with TURN test failed\n");
+		return -1;
+	}
 #endif
 
 	return 0;
@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef NO_SERVER
+
+#include "juice/juice.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+static void sleep(unsigned int secs) { Sleep(secs * 1000); }
+#else
+#include <unistd.h> // for sleep
+#endif
+
+#define BUFFER_SIZE 4096
+
+#define TURN_USERNAME "prewarm_test"
+#define TURN_PASSWORD "53178962437025"
+
+static juice_agent_t *agent1;
+static juice_agent_t *agent2;
+static bool gathering = false;
+static bool relay_success = false;
+
+static void on_state_changed1(juice_agent_t *agent, juice_state_t state, void *user_ptr);
+static void on_state_changed2(juice_agent_t *agent, juice_state_t state, void *user_ptr);
+
+static void on_candidate1(juice_agent_t *agent, const char *sdp, void *user_ptr);
+static void on_candidate2(juice_agent_t *agent, const char *sdp, void *user_ptr);
+
+static void on_recv1(juice_agent_t *agent, const char *data, size_t size, void *user_ptr);
+static void on_recv2(juice_agent_t *agent, const char *data, size_t size, void *user_ptr);
+
+int test_prewarm() {
+	// Create server
+	juice_server_credentials_t credentials[1];
+	memset(&credentials, 0, sizeof(credentials));
+	credentials[0].username = TURN_USERNAME;
+	credentials[0].password = TURN_PASSWORD;
+
+	juice_server_config_t server_config;
+	memset(&server_config, 0, sizeof(server_config));
+	server_config.port = 3478;
+	server_config.credentials = credentials;
+	server_config.credentials_count = 1;
+	server_config.max_allocations = 100;
+	server_config.realm = "Juice test server";
+	juice_server_t *server = juice_server_create(&server_config);
+
+	// Pre-warm a TURN allocation
+	juice_turn_server_t turn_server;
+	memset(&turn_server, 0, sizeof(turn_server));
+	turn_server.host = "localhost";
+	turn_server.port = 3478;
+	turn_server.username = TURN_USERNAME;
+	turn_server.password = TURN_PASSWORD;
+	bool success = juice_prewarm_turn_allocations(&turn_server, 1) == 0;
+	sleep(1);
+
+	// Agent 1: Create agent with the same TURN server
+	juice_config_t config1;
+	memset(&config1, 0, sizeof(config1));
+	config1.turn_servers = &turn_server;
+	config1.turn_servers_count = 1;
+	config1.cb_state_changed = on_state_changed1;
+	config1.cb_candidate = on_candidate1;
+	config1.cb_recv = on_recv1;
+	config1.user_ptr = NULL;
+
+	agent1 = juice_create(&config1);
+	juice_set_log_level(agent1, JUICE_LOG_LEVEL_DEBUG);
+
+	// Agent 2: Create agent
+	juice_config_t config2;
+	memset(&config2, 0, sizeof(config2));
+	config2.cb_state_changed = on_state_changed2;
+	config2.cb_candidate = on_candidate2;
+	config2.cb_recv = on_recv2;
+	config2.user_ptr = NULL;
+
+	agent2 = juice_create(&config2);
+	juice_set_log_level(agent2, JUICE_LOG_LEVEL_DEBUG);
+
+	// Exchange descriptions
+	char sdp1[JUICE_MAX_SDP_STRING_LEN];
+	juice_get_local_description(agent1, sdp1, JUICE_MAX_SDP_STRING_LEN);
+	juice_set_remote_description(agent2, sdp1);
+
+	char sdp2[JUICE_MAX_SDP_STRING_LEN];
+	juice_get_local_description(agent2, sdp2, JUICE_MAX_SDP_STRING_LEN);
+	juice_set_remote_description(agent1, sdp2);
+
+	// Agent 1: Gather candidates, the relayed candidate must be emitted right away
+	gathering = true;
+	juice_gather_candidates(agent1);
+	gathering = false;
+
+	// Agent 2: Gather candidates
+	juice_gather_candidates(agent2);
+	sleep(2);
+
+	// -- Connection should be finished --
+
+	juice_state_t state1 = juice_get_state(agent1);
+	juice_state_t state2 = juice_get_state(agent2);
+	success &= (state1 == JUICE_STATE_COMPLETED && state2 == JUICE_STATE_COMPLETED);
+
+	juice_agent_stats_t stats;
+	if (success &= (juice_get_stats(agent1, &stats) == 0)) {
+		printf("TURN allocations 1: count=%d, ready=%d\n", stats.turn_allocations_count,
+		       stats.turn_allocations_ready);
+		if (stats.turn_allocations_ready != 1)
+			success = false;
+	}
+
+	// Agent 1: destroy
+	juice_destroy(agent1);
+
+	// Agent 2: destroy
+	juice_destroy(agent2);
+
+	// Release the replacement allocation
+	juice_prewarm_turn_allocations(&turn_server, 0);
+
+	// Destroy server
+	juice_server_destroy(server);
+
+	// Sleep so we can check destruction went well
+	sleep(2);
+
+	if (success && relay_success) {
+		printf("Success\n");
+		return 0;
+	} else {
+		printf("Failure\n");
+		return -1;
+	}
+}
+
+// Agent 1: on state changed
+static void on_state_changed1(juice_agent_t *agent, juice_state_t state, void *user_ptr) {
+	printf("State 1: %s\n", juice_state_to_string(state));
+}
+
+// Agent 2: on state changed
+static void on_state_changed2(juice_agent_t *agent, juice_state_t state, void *user_ptr) {
+	printf("State 2: %s\n", juice_state_to_string(state));
+	if (state == JUICE_STATE_CONNECTED) {
+		// Agent 2: on connected, send a message
+		const char *message = "Hello from 2";
+		juice_send(agent, message, strlen(message));
+	}
+}
+
+// Agent 1: on local candidate gathered
+static void on_candidate1(juice_agent_t *agent, const char *sdp, void *user_ptr) {
+	printf("Candidate 1: %s\n", sdp);
+
+	// Success if the relayed candidate is emitted while gathering starts
+	if (strstr(sdp, " typ relay ") && gathering)
+		relay_success = true;
+
+	// Agent 2: Receive it from agent 1
+	juice_add_remote_candidate(agent2, sdp);
+}
+
+// Agent 2: on local candidate gathered
+static void on_candidate2(juice_agent_t *agent, const char *sdp, void *user_ptr) {
+	printf("Candidate 2: %s\n", sdp);
+
+	// Agent 1: Receive it from agent 2
+	juice_add_remote_candidate(agent1, sdp);
+}
+
+// Agent 1: on message received
+static void on_recv1(juice_agent_t *agent, const char *data, size_t size, void *user_ptr) {
+	char buffer[BUFFER_SIZE];
+	if (size > BUFFER_SIZE - 1)
+		size = BUFFER_SIZE - 1;
+	memcpy(buffer, data, size);
+	buffer[size] = '\0';
+	printf("Received 1: %s\n", buffer);
+}
+
+// Agent 2: on message received
+static void on_recv2(juice_agent_t *agent, const char *data, size_t size, void *user_ptr) {
+	char buffer[BUFFER_SIZE];
+	if (size > BUFFER_SIZE - 1)
+		size = BUFFER_SIZE - 1;
+	memcpy(buffer, data, size);
+	buffer[size] = '\0';
+	printf("Received 2: %s\n", buffer);
+}
+
+#endif // ifndef NO_SERVER
@@ -0,0 +1,382 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "juice/juice.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+static void sleep(unsigned int secs) { Sleep(secs * 1000); }
+#else
+#include <unistd.h> // for sleep
+#endif
+
+#define BUFFER_SIZE 4096
+#define RESTART_MESSAGES_COUNT 10
+
+static juice_agent_t *agent1;
+static juice_agent_t *agent2;
+
+static int recv_count1;
+static int recv_count2;
+
+static void on_state_changed1(juice_agent_t *agent, juice_state_t state, void *user_ptr);
+static void on_state_changed2(juice_agent_t *agent, juice_state_t state, void *user_ptr);
+
+static void on_candidate1(juice_agent_t *agent, const char *sdp, void *user_ptr);
+static void on_candidate2(juice_agent_t *agent, const char *sdp, void *user_ptr);
+
+static void on_recv1(juice_agent_t *agent, const char *data, size_t size, void *user_ptr);
+static void on_recv2(juice_agent_t *agent, const char *data, size_t size, void *user_ptr);
+
+static bool has_same_port(const char *addr1, const char *addr2) {
+	const char *port1 = strrchr(addr1, ':');
+	const char *port2 = strrchr(addr2, ':');
+	return port1 && port2 && strcmp(port1, port2) == 0;
+}
+
+static void exchange_descriptions(char *sdp1, char *sdp2) {
+	// Agent 1: Generate local description
+	juice_get_local_description(agent1, sdp1, JUICE_MAX_SDP_STRING_LEN);
+	printf("Local description 1:\n%s\n", sdp1);
+
+	// Agent 2: Receive description from agent 1
+	juice_set_remote_description(agent2, sdp1);
+
+	// Agent 2: Generate local description
+	juice_get_local_description(agent2, sdp2, JUICE_MAX_SDP_STRING_LEN);
+	printf("Local description 2:\n%s\n", sdp2);
+
+	// Agent 1: Receive description from agent 2
+	juice_set_remote_description(agent1, sdp2);
+}
+
+int test_restart() {
+	// Agent 1: Create agent, host candidates only
+	juice_config_t config1;
+	memset(&config1, 0, sizeof(config1));
+	config1.cb_state_changed = on_state_changed1;
+	config1.cb_candidate = on_candidate1;
+	config1.cb_recv = on_recv1;
+	config1.user_ptr = NULL;
+
+	agent1 = juice_create(&config1);
+	juice_set_log_level(agent1, JUICE_LOG_LEVEL_DEBUG);
+
+	// Agent 2: Create agent, host candidates only
+	juice_config_t config2;
+	memset(&config2, 0, sizeof(config2));
+	config2.cb_state_changed = on_state_changed2;
+	config2.cb_candidate = on_candidate2;
+	config2.cb_recv = on_recv2;
+	config2.user_ptr = NULL;
+
+	agent2 = juice_create(&config2);
+	juice_set_log_level(agent2, JUICE_LOG_LEVEL_DEBUG);
+
+	char sdp1[JUICE_MAX_SDP_STRING_LEN];
+	char sdp2[JUICE_MAX_SDP_STRING_LEN];
+	exchange_descriptions(sdp1, sdp2);
+
+	// Agents: Gather candidates
+	juice_gather_candidates(agent1);
+	juice_gather_candidates(agent2);
+	sleep(2);
+
+	// -- Connection should be finished --
+	bool success = juice_get_state(agent1) == JUICE_STATE_COMPLETED &&
+	               juice_get_state(agent2) == JUICE_STATE_COMPLETED;
+
+	char localAddr[JUICE_MAX_ADDRESS_STRING_LEN];
+	char remoteAddr[JUICE_MAX_ADDRESS_STRING_LEN];
+	char previousLocalAddr[JUICE_MAX_ADDRESS_STRING_LEN];
+	success &= juice_get_selected_addresses(agent1, previousLocalAddr, JUICE_MAX_ADDRESS_STRING_LEN,
+	                                        remoteAddr, JUICE_MAX_ADDRESS_STRING_LEN) == 0;
+
+	juice_agent_stats_t stats2;
+	juice_get_stats(agent2, &stats2);
+	uint64_t previous_packets2 = stats2.direct.packets_received;
+
+	// Agents: Restart ICE
+	int previous_count1 = recv_count1;
+	int previous_count2 = recv_count2;
+	success &= juice_restart_ice(agent1) == JUICE_ERR_SUCCESS;
+	success &= juice_restart_ice(agent2) == JUICE_ERR_SUCCESS;
+
+	// Agent 1: Send messages before a new pair can be nominated, they should still go through the
+	// previously selected pair
+	for (int i = 0; i < RESTART_MESSAGES_COUNT; ++i) {
+		const char *message = "Hello from 1 while restarting";
+		success &= juice_send(agent1, message, strlen(message)) == JUICE_ERR_SUCCESS;
+	}
+
+	char new_sdp1[JUICE_MAX_SDP_STRING_LEN];
+	char new_sdp2[JUICE_MAX_SDP_STRING_LEN];
+	exchange_descriptions(new_sdp1, new_sdp2);
+	sleep(2);
+
+	// -- Connection should be finished again, with new credentials --
+	success &= juice_get_state(agent1) == JUICE_STATE_COMPLETED &&
+	           juice_get_state(agent2) == JUICE_STATE_COMPLETED;
+	success &= strcmp(sdp1, new_sdp1) != 0 && strcmp(sdp2, new_sdp2) != 0;
+
+	// Messages sent while restarting and when connected again should be received over the network
+	success &= recv_count1 > previous_count1;
+	success &= recv_count2 > previous_count2 + RESTART_MESSAGES_COUNT;
+	juice_get_stats(agent2, &stats2);
+	success &= stats2.direct.packets_received > previous_packets2 + RESTART_MESSAGES_COUNT;
+	success &= stats2.shortcut.packets_received == 0;
+
+	// The socket is kept, so the selected local port should be unchanged, while the address family
+	// may differ as both host pairs succeed
+	if (success &= (juice_get_selected_addresses(agent1, localAddr, JUICE_MAX_ADDRESS_STRING_LEN,
+	                                             remoteAddr, JUICE_MAX_ADDRESS_STRING_LEN) == 0)) {
+		printf("Local address  1: %s\n", localAddr);
+		printf("Remote address 1: %s\n", remoteAddr);
+		success &= has_same_port(localAddr, previousLocalAddr);
+	}
+
+	// Agent 1: destroy
+	juice_destroy(agent1);
+
+	// Agent 2: destroy
+	juice_destroy(agent2);
+
+	// Sleep so we can check destruction went well
+	sleep(2);
+
+	if (success) {
+		printf("Success\n");
+		return 0;
+	} else {
+		printf("Failure\n");
+		return -1;
+	}
+}
+
+#ifndef NO_SERVER
+
+#define TURN_USERNAME "restart_test"
+#define TURN_PASSWORD "30749116386129"
+#define TURN_PORT 3479
+
+// Copies the relayed candidate of a description, including its address and port
+static bool get_relay_candidate(const char *sdp, char *buffer, size_t size) {
+	const char *end = strstr(sdp, " typ relay");
+	if (!end)
+		return false;
+
+	const char *begin = end;
+	while (begin > sdp && *(begin - 1) != '\n')
+		--begin;
+
+	size_t len = end - begin;
+	if (len >= size)
+		return false;
+
+	memcpy(buffer, begin, len);
+	buffer[len] = '\0';
+	return true;
+}
+
+int test_restart_turn() {
+	// Create server
+	juice_server_credentials_t credentials[1];
+	memset(&credentials, 0, sizeof(credentials));
+	credentials[0].username = TURN_USERNAME;
+	credentials[0].password = TURN_PASSWORD;
+
+	juice_server_config_t server_config;
+	memset(&server_config, 0, sizeof(server_config));
+	server_config.port = TURN_PORT;
+	server_config.credentials = credentials;
+	server_config.credentials_count = 1;
+	server_config.max_allocations = 100;
+	server_config.realm = "Juice test server";
+	juice_server_t *server = juice_server_create(&server_config);
+
+	// Set TURN server
+	juice_turn_server_t turn_server;
+	memset(&turn_server, 0, sizeof(turn_server));
+	turn_server.host = "localhost";
+	turn_server.port = TURN_PORT;
+	turn_server.username = TURN_USERNAME;
+	turn_server.password = TURN_PASSWORD;
+
+	// Agent 1: Create agent with a TURN server
+	juice_config_t config1;
+	memset(&config1, 0, sizeof(config1));
+	config1.turn_servers = &turn_server;
+	config1.turn_servers_count = 1;
+	config1.cb_state_changed = on_state_changed1;
+	config1.cb_candidate = on_candidate1;
+	config1.cb_recv = on_recv1;
+	config1.user_ptr = NULL;
+
+	agent1 = juice_create(&config1);
+
+	// Agent 2: Create agent with a TURN server
+	juice_config_t config2;
+	memset(&config2, 0, sizeof(config2));
+	config2.turn_servers = &turn_server;
+	config2.turn_servers_count = 1;
+	config2.cb_state_changed = on_state_changed2;
+	config2.cb_candidate = on_candidate2;
+	config2.cb_recv = on_recv2;
+	config2.user_ptr = NULL;
+
+	agent2 = juice_create(&config2);
+
+	char sdp1[JUICE_MAX_SDP_STRING_LEN];
+	char sdp2[JUICE_MAX_SDP_STRING_LEN];
+	exchange_descriptions(sdp1, sdp2);
+
+	// Agents: Gather candidates
+	juice_gather_candidates(agent1);
+	juice_gather_candidates(agent2);
+	sleep(2);
+
+	// -- Connection should be finished, with a relayed candidate --
+	bool success = juice_get_state(agent1) == JUICE_STATE_COMPLETED &&
+	               juice_get_state(agent2) == JUICE_STATE_COMPLETED;
+
+	char relay1[JUICE_MAX_SDP_STRING_LEN];
+	juice_get_local_description(agent1, sdp1, JUICE_MAX_SDP_STRING_LEN);
+	success &= get_relay_candidate(sdp1, relay1, JUICE_MAX_SDP_STRING_LEN);
+
+	char localAddr[JUICE_MAX_ADDRESS_STRING_LEN];
+	char remoteAddr[JUICE_MAX_ADDRESS_STRING_LEN];
+	char previousLocalAddr[JUICE_MAX_ADDRESS_STRING_LEN];
+	success &= juice_get_selected_addresses(agent1, previousLocalAddr, JUICE_MAX_ADDRESS_STRING_LEN,
+	                                        remoteAddr, JUICE_MAX_ADDRESS_STRING_LEN) == 0;
+
+	// Agents: Restart ICE
+	int previous_count2 = recv_count2;
+	success &= juice_restart_ice(agent1) == JUICE_ERR_SUCCESS;
+	success &= juice_restart_ice(agent2) == JUICE_ERR_SUCCESS;
+
+	char new_sdp1[JUICE_MAX_SDP_STRING_LEN];
+	char new_sdp2[JUICE_MAX_SDP_STRING_LEN];
+	exchange_descriptions(new_sdp1, new_sdp2);
+	sleep(2);
+
+	// -- Connection should be finished again, keeping the socket and the TURN allocation --
+	success &= juice_get_state(agent1) == JUICE_STATE_COMPLETED &&
+	           juice_get_state(agent2) == JUICE_STATE_COMPLETED;
+	success &= recv_count2 > previous_count2;
+
+	char new_relay1[JUICE_MAX_SDP_STRING_LEN];
+	success &= get_relay_candidate(new_sdp1, new_relay1, JUICE_MAX_SDP_STRING_LEN);
+	success &= strcmp(relay1, new_relay1) == 0;
+
+	juice_agent_stats_t stats1;
+	juice_get_stats(agent1, &stats1);
+	success &= stats1.turn_allocations_ready == 1 && stats1.turn_allocations_failed == 0;
+
+	if (success &= (juice_get_selected_addresses(agent1, localAddr, JUICE_MAX_ADDRESS_STRING_LEN,
+	                                             remoteAddr, JUICE_MAX_ADDRESS_STRING_LEN) == 0)) {
+		printf("Local address  1: %s\n", localAddr);
+		printf("Remote address 1: %s\n", remoteAddr);
+		success &= has_same_port(localAddr, previousLocalAddr);
+	}
+
+	// Agent 1: destroy
+	juice_destroy(agent1);
+
+	// Agent 2: destroy
+	juice_destroy(agent2);
+
+	// Destroy server
+	juice_server_destroy(server);
+
+	// Sleep so we can check destruction went well
+	sleep(2);
+
+	if (success) {
+		printf("Success\n");
+		return 0;
+	} else {
+		printf("Failure\n");
+		return -1;
+	}
+}
+
+#endif
+
+// Agent 1: on state changed
+static void on_state_changed1(juice_agent_t *agent, juice_state_t state, void *user_ptr) {
+	printf("State 1: %s\n", juice_state_to_string(state));
+
+	if (state == JUICE_STATE_CONNECTED) {
+		// Agent 1: on connected, send a message
+		const char *message = "Hello from 1";
+		juice_send(agent, message, strlen(message));
+	}
+}
+
+// Agent 2: on state changed
+static void on_state_changed2(juice_agent_t *agent, juice_state_t state, void *user_ptr) {
+	printf("State 2: %s\n", juice_state_to_string(state));
+	if (state == JUICE_STATE_CONNECTED) {
+		// Agent 2: on connected, send a message
+		const char *message = "Hello from 2";
+		juice_send(agent, message, strlen(message));
+	}
+}
+
+// Agent 1: on local candidate gathered
+static void on_candidate1(juice_agent_t *agent, const char *sdp, void *user_ptr) {
+	printf("Candidate 1: %s\n", sdp);
+
+	// Agent 2: Receive it from agent 1
+	juice_add_remote_candidate(agent2, sdp);
+}
+
+// Agent 2: on local candidate gathered
+static void on_candidate2(juice_agent_t *agent, const char *sdp, void *user_ptr) {
+	printf("Candidate 2: %s\n", sdp);
+
+	// Agent 1: Receive it from agent 2
+	juice_add_remote_candidate(agent1, sdp);
+}
+
+// Agent 1: on message received
+static void on_recv1(juice_agent_t *agent, const char *data, size_t size, void *user_ptr) {
+	char buffer[BUFFER_SIZE];
+	if (size > BUFFER_SIZE - 1)
+		size = BUFFER_SIZE - 1;
+	memcpy(buffer, data, size);
+	buffer[size] = '\0';
+	printf("Received 1: %s\n", buffer);
+	++recv_count1;
+}
+
+// Agent 2: on message received
+static void on_recv2(juice_agent_t *agent, const char *data, size_t size, void *user_ptr) {
+	char buffer[BUFFER_SIZE];
+	if (size > BUFFER_SIZE - 1)
+		size = BUFFER_SIZE - 1;
+	memcpy(buffer, data, size);
+	buffer[size] = '\0';
+	printf("Received 2: %s\n", buffer);
+	++recv_count2;
+}
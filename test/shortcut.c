@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2020 Paul-Louis Ageneau
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "juice/juice.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+static void sleep(unsigned int secs) { Sleep(secs * 1000); }
+#else
+#include <unistd.h> // for sleep
+#endif
+
+#define BUFFER_SIZE 4096
+#define BURST_COUNT 100 // more than the shortcut ring can hold
+#define LARGE_SIZE 3000 // more than a shortcut slot can hold
+
+static juice_agent_t *agent1;
+static juice_agent_t *agent2;
+
+static volatile int recv_count2;
+static volatile int large_count2;
+static volatile bool block_once2;
+
+static void on_state_changed1(juice_agent_t *agent, juice_state_t state, void *user_ptr);
+static void on_state_changed2(juice_agent_t *agent, juice_state_t state, void *user_ptr);
+
+static void on_candidate1(juice_agent_t *agent, const char *sdp, void *user_ptr);
+static void on_candidate2(juice_agent_t *agent, const char *sdp, void *user_ptr);
+
+static void on_recv2(juice_agent_t *agent, const char *data, size_t size, void *user_ptr);
+
+static void exchange_descriptions(void) {
+	char sdp1[JUICE_MAX_SDP_STRING_LEN];
+	char sdp2[JUICE_MAX_SDP_STRING_LEN];
+
+	// Agent 1: Generate local description, agent 2: Receive it
+	juice_get_local_description(agent1, sdp1, JUICE_MAX_SDP_STRING_LEN);
+	juice_set_remote_description(agent2, sdp1);
+
+	// Agent 2: Generate local description, agent 1: Receive it
+	juice_get_local_description(agent2, sdp2, JUICE_MAX_SDP_STRING_LEN);
+	juice_set_remote_description(agent1, sdp2);
+}
+
+static bool send_messages(int count) {
+	const char *message = "Hello from 1";
+	for (int i = 0; i < count; ++i)
+		if (juice_send(agent1, message, strlen(message)) != JUICE_ERR_SUCCESS)
+			return false;
+
+	return true;
+}
+
+int test_shortcut() {
+	// Agent 1: Create agent, host candidates only, shortcut enabled
+	juice_config_t config1;
+	memset(&config1, 0, sizeof(config1));
+	config1.cb_state_changed = on_state_changed1;
+	config1.cb_candidate = on_candidate1;
+	config1.user_ptr = NULL;
+	config1.enable_shortcut = true;
+
+	agent1 = juice_create(&config1);
+
+	// Agent 2: Create agent, host candidates only, shortcut enabled
+	juice_config_t config2;
+	memset(&config2, 0, sizeof(config2));
+	config2.cb_state_changed = on_state_changed2;
+	config2.cb_candidate = on_candidate2;
+	config2.cb_recv = on_recv2;
+	config2.user_ptr = NULL;
+	config2.enable_shortcut = true;
+
+	agent2 = juice_create(&config2);
+
+	exchange_descriptions();
+
+	// Agents: Gather candidates
+	juice_gather_candidates(agent1);
+	juice_gather_candidates(agent2);
+	sleep(2);
+
+	// -- Connection should be finished --
+	bool success = juice_get_state(agent1) == JUICE_STATE_COMPLETED &&
+	               juice_get_state(agent2) == JUICE_STATE_COMPLETED;
+
+	juice_agent_stats_t stats1, stats2;
+
+	// Small datagrams should go through the shortcut
+	success &= send_messages(10);
+	sleep(1);
+	juice_get_stats(agent1, &stats1);
+	juice_get_stats(agent2, &stats2);
+	success &= recv_count2 == 10;
+	success &= stats1.shortcut.packets_sent == 10 && stats1.direct.packets_sent == 0;
+	success &= stats2.shortcut.packets_received == 10;
+
+	// Oversized datagrams should fall back to the socket
+	char large[LARGE_SIZE];
+	memset(large, 'x', LARGE_SIZE);
+	success &= juice_send(agent1, large, LARGE_SIZE) == JUICE_ERR_SUCCESS;
+	sleep(1);
+	juice_get_stats(agent1, &stats1);
+	success &= large_count2 == 1;
+	success &= stats1.shortcut.packets_sent == 10 && stats1.direct.packets_sent == 1;
+
+	// Datagrams should fall back to the socket when the ring is full, here because agent 2 is
+	// blocked in its receive callback
+	block_once2 = true;
+	success &= send_messages(1 + BURST_COUNT);
+	sleep(3);
+	juice_get_stats(agent1, &stats1);
+	juice_get_stats(agent2, &stats2);
+	success &= recv_count2 == 10 + 1 + BURST_COUNT;
+	success &= stats1.shortcut.packets_sent > 10 && stats1.direct.packets_sent > 1;
+	success &= stats1.shortcut.packets_sent + stats1.direct.packets_sent ==
+	           10 + 1 + 1 + BURST_COUNT;
+	success &= stats2.shortcut.packets_received == stats1.shortcut.packets_sent;
+
+	// Agents: Restart ICE, the shortcut should be unlinked then linked again with new credentials
+	int previous_count2 = recv_count2;
+	uint64_t previous_shortcut = stats1.shortcut.packets_sent;
+	success &= juice_restart_ice(agent1) == JUICE_ERR_SUCCESS;
+	success &= juice_restart_ice(agent2) == JUICE_ERR_SUCCESS;
+	exchange_descriptions();
+	sleep(2);
+
+	success &= juice_get_state(agent1) == JUICE_STATE_COMPLETED &&
+	           juice_get_state(agent2) == JUICE_STATE_COMPLETED;
+
+	success &= send_messages(10);
+	sleep(1);
+	juice_get_stats(agent1, &stats1);
+	success &= recv_count2 == previous_count2 + 10;
+	success &= stats1.shortcut.packets_sent == previous_shortcut + 10;
+
+	// Agent 1: destroy
+	juice_destroy(agent1);
+
+	// Agent 2: destroy
+	juice_destroy(agent2);
+
+	// Sleep so we can check destruction went well
+	sleep(2);
+
+	if (success) {
+		printf("Success\n");
+		return 0;
+	} else {
+		printf("Failure\n");
+		return -1;
+	}
+}
+
+// Agent 1: on state changed
+static void on_state_changed1(juice_agent_t *agent, juice_state_t state, void *user_ptr) {
+	printf("State 1: %s\n", juice_state_to_string(state));
+}
+
+// Agent 2: on state changed
+static void on_state_changed2(juice_agent_t *agent, juice_state_t state, void *user_ptr) {
+	printf("State 2: %s\n", juice_state_to_string(state));
+}
+
+// Agent 1: on local candidate gathered
+static void on_candidate1(juice_agent_t *agent, const char *sdp, void *user_ptr) {
+	printf("Candidate 1: %s\n", sdp);
+
+	// Agent 2: Receive it from agent 1
+	juice_add_remote_candidate(agent2, sdp);
+}
+
+// Agent 2: on local candidate gathered
+static void on_candidate2(juice_agent_t *agent, const char *sdp, void *user_ptr) {
+	printf("Candidate 2: %s\n", sdp);
+
+	// Agent 1: Receive it from agent 2
+	juice_add_remote_candidate(agent1, sdp);
+}
+
+// Agent 2: on message received
+static void on_recv2(juice_agent_t *agent, const char *data, size_t size, void *user_ptr) {
+	if (size == LARGE_SIZE)
+		++large_count2;
+	else
+		++recv_count2;
+
+	if (block_once2) {
+		// Stall the agent thread so the ring of agent 2 fills up
+		block_once2 = false;
+		sleep(1);
+	}
+}
@@ -25,6 +25,7 @@ int do_test_stun(juice_logger_t *logger);
 
 int test_stun(void) {
 	juice_log_config_t log_config;
+	memset(&log_config, 0, sizeof(log_config));
 	juice_logger_t *logger = juice_logger_create(&log_config);
 	int ret = do_test_stun(logger);
 	juice_logger_destroy(logger);
@@ -89,6 +90,15 @@ int do_test_stun(juice_logger_t *logger) {
 	if(msg.error_code != 0)
 		return -1;
 
+	// Truncated message
+	if (_juice_stun_read(message1, sizeof(message1) - 4, &msg, logger) >= 0)
+		return -1;
+
+	// Invalid fingerprint
+	message1[sizeof(message1) - 1] ^= 0x01;
+	if (_juice_stun_read(message1, sizeof(message1), &msg, logger) >= 0)
+		return -1;
+
 	// The test vector in RFC 8489 is completely wrong
 	// See https://www.rfc-editor.org/errata_search.php?rfc=8489
 	uint8_t message2[] = {
@@ -170,5 +180,27 @@ int do_test_stun(juice_logger_t *logger) {
 	if(msg.error_code != STUN_ERROR_INTERNAL_VALIDATION_FAILED)
 		return -1;
 
+	// Comprehension-optional attributes past the indexing limit are skipped
+	uint8_t message3[20 + 8 + 40 * 8];
+	memset(message3, 0, sizeof(message3));
+	memcpy(message3, message1, 20); // header of the first message
+	message3[2] = (uint8_t)((sizeof(message3) - 20) >> 8);
+	message3[3] = (uint8_t)(sizeof(message3) - 20);
+	memcpy(message3 + 20, message1 + 40, 8); // PRIORITY attribute
+	for (int i = 0; i < 40; ++i) {
+		uint8_t *attr = message3 + 28 + i * 8;
+		attr[0] = 0x80; // unknown optional attribute type 0x8055
+		attr[1] = 0x55;
+		attr[3] = 0x04;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+
+	if (_juice_stun_read(message3, sizeof(message3), &msg, logger) <= 0)
+		return -1;
+
+	if (msg.priority != 0x6e0001ff)
+		return -1;
+
 	return 0;
 }